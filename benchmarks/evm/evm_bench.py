@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+"""Gas and code-size benchmarks for the EVM backend.
+
+Compiles every contract used by the runtime tests at each optimization
+level, runs all test calls with llvm-evm-run and records, per level:
+
+  contracts: bytecode size, deploy gas and compile time of every .ll file
+  calls:     gas used by every test call
+
+The results are compared against baseline.json, which is kept in the
+source tree. The run fails when a metric grows by more than its tolerance,
+or when a contract fails to compile or a call returns the wrong value and
+the baseline does not list it as failing already. Use --update to rewrite
+the baseline after an intended change. Compile times depend on the host, so
+they are only written to the baseline with --check-compile-time.
+
+Deploy gas is computed from the bytecode, as the backend does not emit a
+constructor: 21000 (transaction) + 32000 (creation) + 16 per non-zero and
+4 per zero byte of init code + 200 per byte of deployed code.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+from collections import OrderedDict
+from concurrent.futures import ThreadPoolExecutor
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+TESTSUITE_DIR = os.path.join(SCRIPT_DIR, "..", "..", "tools", "evm-test")
+sys.path.insert(0, TESTSUITE_DIR)
+
+import evm_testsuite
+
+RUNTIME_TESTS_DIR = os.path.normpath(
+    os.path.join(TESTSUITE_DIR, evm_testsuite.runtime_file_prefix))
+
+OPT_LEVELS = ["O0", "O1", "O2", "O3"]
+
+
+def deploy_gas(code: bytes) -> int:
+    calldata = sum(16 if b else 4 for b in code)
+    return 21000 + 32000 + calldata + 200 * len(code)
+
+
+def encode_inputs(inputs) -> str:
+    return "".join("{:064x}".format(int(i, 16)) for i in inputs)
+
+
+def compile_contract(llc: str, level: str, source: str, output: str,
+                     repeat: int):
+    """Compile source to output; returns (bytecode, best compile time), or
+    None when llc fails."""
+    command = [llc, "-mtriple=evm", "-" + level, "-filetype=obj",
+               source, "-o", output]
+    best = None
+    for _ in range(repeat):
+        start = time.perf_counter()
+        if subprocess.run(command, stdout=subprocess.DEVNULL).returncode:
+            return None
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    with open(output, "rb") as f:
+        return f.read(), best
+
+
+def run_level(args, level: str, cases, tmpdir: str):
+    files = sorted(set(val["file"] for _, val in cases))
+    objects = {f: os.path.join(tmpdir, "{}_{}.o".format(level, i))
+               for i, f in enumerate(files)}
+
+    def build(f):
+        return f, compile_contract(args.llc, level,
+                                   os.path.join(RUNTIME_TESTS_DIR, f),
+                                   objects[f], args.repeat)
+
+    contracts = OrderedDict()
+    wrong = []
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        for f, built in pool.map(build, files):
+            if built is None:
+                wrong.append("compile " + f)
+                continue
+            code, seconds = built
+            contracts[f] = OrderedDict([
+                ("size", len(code)),
+                ("deploy_gas", deploy_gas(code)),
+                ("compile_ms", round(seconds * 1000, 2)),
+            ])
+
+    # Run every call in one interpreter process. Test names may contain
+    # spaces, so cases are named by index.
+    batch = os.path.join(tmpdir, level + ".batch")
+    with open(batch, "w") as f:
+        for index, (_, val) in enumerate(cases):
+            if val["file"] not in contracts:
+                continue
+            line = "{} {}".format(index, objects[val["file"]])
+            data = encode_inputs(val["input"])
+            if data:
+                line += " 0x" + data
+            f.write(line + "\n")
+    result = subprocess.run([args.evm_run, "--batch", batch],
+                            stdout=subprocess.PIPE)
+
+    calls = OrderedDict()
+    for line in result.stdout.decode("utf-8").splitlines():
+        index, status, gas, output = line.split(" ")
+        name, val = cases[int(index)]
+        calls[name] = int(gas)
+        if status != "return" or int(output, 16) != int(val["output"], 16):
+            wrong.append("call \"{}\"".format(name))
+    return OrderedDict([("contracts", contracts), ("calls", calls),
+                        ("failures", wrong)])
+
+
+def compare(baseline, results, args) -> bool:
+    tolerances = {
+        "size": args.size_tolerance,
+        "deploy_gas": args.gas_tolerance,
+        "gas": args.gas_tolerance,
+        "compile_ms": args.time_tolerance if args.check_compile_time else None,
+    }
+    ok = True
+
+    def check(level, kind, name, metric, old, new):
+        nonlocal ok
+        tolerance = tolerances[metric]
+        if tolerance is None or old == new:
+            return
+        change = (new - old) / old if old else float("inf")
+        if change > tolerance:
+            ok = False
+            tag = "REGRESSION"
+        elif change < 0:
+            tag = "improved"
+        else:
+            return
+        print("{:>10} {} {} {} {}: {} -> {} ({:+.1%})".format(
+            tag, level, kind, name, metric, old, new, change))
+
+    for level, data in results.items():
+        base = baseline.get(level)
+        if base is None:
+            continue
+        known = set(base.get("failures", []))
+        for name in data["failures"]:
+            if name not in known:
+                print("{:>10} {} {}".format("FAILED", level, name))
+                ok = False
+        for name in sorted(known - set(data["failures"])):
+            print("{:>10} {} {}".format("fixed", level, name))
+        for name, metrics in data["contracts"].items():
+            old = base["contracts"].get(name)
+            if old is None:
+                continue
+            for metric, value in metrics.items():
+                if metric in old:
+                    check(level, "contract", name, metric, old[metric], value)
+        for name, gas in data["calls"].items():
+            if name in base["calls"]:
+                check(level, "call", name, "gas", base["calls"][name], gas)
+    return ok
+
+
+def print_summary(results):
+    print("{:<6} {:>12} {:>14} {:>14} {:>12}".format(
+        "level", "code bytes", "deploy gas", "call gas", "compile ms"))
+    for level, data in results.items():
+        contracts = data["contracts"].values()
+        print("{:<6} {:>12} {:>14} {:>14} {:>12.1f}".format(
+            level,
+            sum(c["size"] for c in contracts),
+            sum(c["deploy_gas"] for c in contracts),
+            sum(data["calls"].values()),
+            sum(c["compile_ms"] for c in contracts)))
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--llc", default="llc")
+    parser.add_argument("--evm-run", default="llvm-evm-run")
+    parser.add_argument("--baseline",
+                        default=os.path.join(SCRIPT_DIR, "baseline.json"))
+    parser.add_argument("--output", help="also write the results here")
+    parser.add_argument("--update", action="store_true",
+                        help="write the results to the baseline file")
+    parser.add_argument("-O", dest="levels", action="append",
+                        choices=["0", "1", "2", "3"],
+                        help="optimization levels to run (default: all)")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count())
+    parser.add_argument("--repeat", type=int, default=1,
+                        help="compile each contract this many times and "
+                             "keep the fastest")
+    parser.add_argument("--size-tolerance", type=float, default=0.0)
+    parser.add_argument("--gas-tolerance", type=float, default=0.0)
+    parser.add_argument("--time-tolerance", type=float, default=0.25)
+    parser.add_argument("--check-compile-time", action="store_true",
+                        help="also fail when compile time regresses")
+    args = parser.parse_args()
+
+    levels = ["O" + l for l in args.levels] if args.levels else OPT_LEVELS
+    cases = [(name, val) for testset in evm_testsuite.test_suite
+             for name, val in testset.items()]
+
+    if not args.update and not os.path.exists(args.baseline):
+        print("error: no baseline at {}; run with --update to create it"
+              .format(args.baseline), file=sys.stderr)
+        return 1
+
+    results = OrderedDict()
+    with tempfile.TemporaryDirectory(prefix="evm_bench_") as tmpdir:
+        for level in levels:
+            results[level] = run_level(args, level, cases, tmpdir)
+            for name in results[level]["failures"]:
+                print("{}: failed: {}".format(level, name))
+
+    print_summary(results)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2)
+            f.write("\n")
+
+    if args.update:
+        if not args.check_compile_time:
+            for data in results.values():
+                for metrics in data["contracts"].values():
+                    del metrics["compile_ms"]
+        with open(args.baseline, "w") as f:
+            json.dump(results, f, indent=2)
+            f.write("\n")
+        print("Baseline written to " + args.baseline)
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = json.load(f, object_pairs_hook=OrderedDict)
+    if not compare(baseline, results, args):
+        print("Benchmarks regressed beyond tolerance.")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Compile-time scaling check for the EVM stack allocation analysis.
+
+Generates functions with N, 2N, 4N, ... basic blocks, in which a fixed set
+of values loaded from call data stays live from the entry to the exit and
+the blocks form a chain of diamonds, and times the "Stack Allocation
+Analysis" pass on each with llc -time-passes. The analysis should take time
+about linear in the size of the function; the run fails when the fitted
+growth exponent exceeds --max-exponent.
+"""
+
+import argparse
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+PASS_NAME = "Stack Allocation Analysis"
+# The wall time is the last of the timer columns before the pass name.
+TIMER_RE = re.compile(r"([0-9.]+) \(\s*[0-9.]+%\)\s+" + re.escape(PASS_NAME) +
+                      r"\s*$")
+
+
+def generate(blocks: int, live: int) -> str:
+    """A function with 4 blocks per step and `live` long-lived values."""
+    lines = ["declare i256 @llvm.evm.calldataload(i256)",
+             "declare void @llvm.evm.mstore(i256, i256)",
+             "declare void @llvm.evm.return(i256, i256)",
+             "",
+             "define void @main() {",
+             "entry:"]
+    for i in range(live):
+        lines.append("  %v{0} = call i256 @llvm.evm.calldataload(i256 {1})"
+                     .format(i, 32 * i))
+    lines.append("  br label %b0")
+    acc = "%v0"
+    for b in range(blocks):
+        v = "%v{}".format(b % live)
+        lines += ["b{}:".format(b),
+                  "  %c{0} = icmp ult i256 {1}, {2}".format(b, acc, v),
+                  "  br i1 %c{0}, label %t{0}, label %f{0}".format(b),
+                  "t{}:".format(b),
+                  "  %x{0} = add i256 {1}, {2}".format(b, acc, v),
+                  "  br label %j{}".format(b),
+                  "f{}:".format(b),
+                  "  %y{0} = sub i256 {1}, {2}".format(b, acc, v),
+                  "  br label %j{}".format(b),
+                  "j{}:".format(b),
+                  "  %a{0} = phi i256 [ %x{0}, %t{0} ], [ %y{0}, %f{0} ]"
+                  .format(b),
+                  "  br label %b{}".format(b + 1)]
+        acc = "%a{}".format(b)
+    lines.append("b{}:".format(blocks))
+    total = acc
+    for i in range(live):
+        lines.append("  %s{0} = add i256 {1}, %v{0}".format(i, total))
+        total = "%s{}".format(i)
+    lines += ["  call void @llvm.evm.mstore(i256 64, i256 128)",
+              "  call void @llvm.evm.mstore(i256 0, i256 {})".format(total),
+              "  call void @llvm.evm.return(i256 0, i256 32)",
+              "  unreachable",
+              "}"]
+    return "\n".join(lines) + "\n"
+
+
+def time_pass(llc: str, source: str, repeat: int) -> float:
+    """Best wall time of the analysis over repeat runs, in seconds."""
+    best = None
+    for _ in range(repeat):
+        result = subprocess.run(
+            [llc, "-mtriple=evm", "-time-passes", "-filetype=obj", source,
+             "-o", os.devnull],
+            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+            universal_newlines=True)
+        if result.returncode:
+            sys.stderr.write(result.stderr)
+            raise RuntimeError("llc failed on " + source)
+        times = [float(m.group(1)) for m in
+                 map(TIMER_RE.search, result.stderr.splitlines()) if m]
+        if not times:
+            raise RuntimeError("no timer for '{}' in llc output"
+                               .format(PASS_NAME))
+        elapsed = sum(times)
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def growth_exponent(sizes, times) -> float:
+    """Least-squares slope of log(time) over log(size)."""
+    xs = [math.log(s) for s in sizes]
+    ys = [math.log(max(t, 1e-6)) for t in times]
+    mx = sum(xs) / len(xs)
+    my = sum(ys) / len(ys)
+    num = sum((x - mx) * (y - my) for x, y in zip(xs, ys))
+    den = sum((x - mx) ** 2 for x in xs)
+    return num / den
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--llc", default="llc")
+    parser.add_argument("--blocks", type=int, default=250,
+                        help="number of diamonds in the smallest function")
+    parser.add_argument("--steps", type=int, default=4,
+                        help="number of sizes, each twice the previous one")
+    parser.add_argument("--live", type=int, default=16,
+                        help="number of values live across the function")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="take the best of this many runs")
+    parser.add_argument("--max-exponent", type=float, default=1.3)
+    args = parser.parse_args()
+
+    sizes, times = [], []
+    with tempfile.TemporaryDirectory() as tmpdir:
+        for step in range(args.steps):
+            blocks = args.blocks << step
+            source = os.path.join(tmpdir, "chain{}.ll".format(blocks))
+            with open(source, "w") as f:
+                f.write(generate(blocks, args.live))
+            elapsed = time_pass(args.llc, source, args.repeat)
+            sizes.append(blocks)
+            times.append(elapsed)
+            print("{:8d} diamonds: {:8.4f}s".format(blocks, elapsed))
+
+    exponent = growth_exponent(sizes, times)
+    print("growth exponent: {:.2f} (limit {:.2f})".format(exponent,
+                                                         args.max_exponent))
+    return 1 if exponent > args.max_exponent else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -30,6 +30,19 @@ const uint32_t EVMMetadataVersion = 0x2;
 // EVM uses a 64k page size
 const uint32_t EVMPageSize = 65536;
 
+// A contract with a constructor is compiled into init code, which is written
+// first, followed by the runtime code that the init code returns.
+const char InitSectionName[] = ".evm.init";
+// Offset and size of the runtime code in the object.
+const char RuntimeOffsetSymbol[] = "evm.runtime.offset";
+const char RuntimeSizeSymbol[] = "evm.runtime.size";
+// Offset in the runtime code of the value of an immutable read, followed by
+// the number of the read.
+const char ImmutableSymbolPrefix[] = "evm.immutable.";
+// Topic, as a right-aligned ASCII word, of the log of the profile counters
+// of a contract built with -evm-profile-generate.
+const char ProfileLogTopic[] = "llvm.evm.profile";
+
 struct EVMObjectHeader {
   StringRef Magic;
   uint32_t Version;
@@ -331,7 +331,10 @@ bool BranchProbabilityInfo::calcMetadataWeights(const BasicBlock *BB) {
   assert(WeightSum <= UINT32_MAX &&
          "Expected weights to scale down to 32 bits");
 
-  if (WeightSum == 0 || ReachableIdxs.size() == 0) {
+  // Weights measured by a profile are kept even when every successor leads to
+  // unreachable, as in targets whose programs halt through a noreturn call.
+  if (WeightSum == 0 ||
+      (ReachableIdxs.size() == 0 && !BB->getParent()->hasProfileData())) {
     for (unsigned i = 0, e = TI->getNumSuccessors(); i != e; ++i)
       Weights[i] = 1;
     WeightSum = TI->getNumSuccessors();
@@ -21,6 +21,7 @@
 #include "llvm/MC/MCExpr.h"
 #include "llvm/MC/MCFixupKindInfo.h"
 #include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCSectionELF.h"
 #include "llvm/MC/MCValue.h"
 #include "llvm/MC/MCEVMObjectWriter.h"
 #include "llvm/Support/Casting.h"
@@ -86,12 +87,23 @@ void EVMBinaryObjectWriter::reset() {
 
 }
 
+static bool isInitSection(const MCSection &Sec) {
+  const auto *ELFSec = dyn_cast<MCSectionELF>(&Sec);
+  return ELFSec && ELFSec->getSectionName() == EVM::InitSectionName;
+}
+
 // TODO
 uint64_t EVMBinaryObjectWriter::writeObject(MCAssembler &Asm,
                                        const MCAsmLayout &Layout) {
   uint64_t StartOffset = W.OS.tell();
 
+  // The init code comes first; it copies out the rest.
+  for (const MCSection &Sec : Asm)
+    if (isInitSection(Sec))
+      Asm.writeSectionData(W.OS, &Sec, Layout);
   for (const MCSection &Sec : Asm) {
+    if (isInitSection(Sec))
+      continue;
     Asm.writeSectionData(W.OS, &Sec, Layout);
   }
 
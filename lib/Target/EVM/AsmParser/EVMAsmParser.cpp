@@ -13,6 +13,8 @@
 
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/StringSwitch.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/LLVMContext.h"
 #include "llvm/MC/MCContext.h"
 #include "llvm/MC/MCExpr.h"
 #include "llvm/MC/MCInst.h"
@@ -25,7 +27,9 @@
 #include "llvm/MC/MCSymbol.h"
 #include "llvm/MC/MCValue.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Mutex.h"
 #include "llvm/Support/TargetRegistry.h"
 
 #include <sstream>
@@ -56,6 +60,8 @@ class EVMAsmParser : public MCTargetAsmParser {
 
   bool ParseDirective(AsmToken DirectiveID) override;
 
+  bool parseOperand(OperandVector &Operands);
+
   unsigned validateTargetOperandClass(MCParsedAsmOperand &Op,
                                       unsigned Kind) override;
 
@@ -73,36 +79,10 @@ public:
   MCAsmLexer &getLexer() const { return Parser.getLexer(); }
 };
 
-bool EVMAsmParser::ParseRegister(unsigned &RegNo, SMLoc &StartLoc,
-                                 SMLoc &EndLoc) {
-  llvm_unreachable("EVM does not have registers.");
-}
-
-bool EVMAsmParser::ParseInstruction(ParseInstructionInfo &Info, StringRef Name,
-                                    SMLoc NameLoc, OperandVector &Operands) {
-  return false;
-}
-
-bool EVMAsmParser::ParseDirective(AsmToken DirectiveID) {
-  return false;
-}
-
-bool EVMAsmParser::MatchAndEmitInstruction(SMLoc IDLoc, unsigned &Opcode,
-                                           OperandVector &Operands,
-                                           MCStreamer &Out, uint64_t &ErrorInfo,
-                                           bool MatchingInlineAsm) {
-  return false;
-}
-
-unsigned EVMAsmParser::validateTargetOperandClass(MCParsedAsmOperand &Op,
-                                                  unsigned Kind) {
-  return 0;
-}
-
 /// An parsed EVM assembly operand.
 class EVMOperand : public MCParsedAsmOperand {
   typedef MCParsedAsmOperand Base;
-  enum KindTy { k_Immediate, k_Register, k_Token, k_Memri } Kind;
+  enum KindTy { k_Immediate, k_Register, k_Token, k_Memri, k_Word } Kind;
 
 public:
   EVMOperand(StringRef Tok, SMLoc const &S)
@@ -113,6 +93,8 @@ public:
       : Base(), Kind(k_Immediate), RegImm({0, Imm}), Start(S), End(E) {}
   EVMOperand(unsigned Reg, MCExpr const *Imm, SMLoc const &S, SMLoc const &E)
       : Base(), Kind(k_Memri), RegImm({Reg, Imm}), Start(S), End(E) {}
+  EVMOperand(ConstantInt const *Word, SMLoc const &S, SMLoc const &E)
+      : Base(), Kind(k_Word), Word(Word), Start(S), End(E) {}
 
   struct RegisterImmediate {
     unsigned Reg;
@@ -121,22 +103,35 @@ public:
   union {
     StringRef Tok;
     RegisterImmediate RegImm;
+    // A literal stack word, which may be wider than 64 bits.
+    ConstantInt const *Word;
   };
 
   SMLoc Start, End;
 
 public:
   void addRegOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    Inst.addOperand(MCOperand::createReg(getReg()));
   }
 
   void addExpr(MCInst &Inst, const MCExpr *Expr) const {
+    if (const auto *CE = dyn_cast<MCConstantExpr>(Expr))
+      Inst.addOperand(MCOperand::createImm(CE->getValue()));
+    else
+      Inst.addOperand(MCOperand::createExpr(Expr));
   }
 
   void addImmOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    if (Kind == k_Word)
+      Inst.addOperand(MCOperand::createCImm(Word));
+    else
+      addExpr(Inst, getImm());
   }
 
   bool isReg() const { return Kind == k_Register; }
-  bool isImm() const { return Kind == k_Immediate; }
+  bool isImm() const { return Kind == k_Immediate || Kind == k_Word; }
   bool isToken() const { return Kind == k_Token; }
   bool isMem() const { return Kind == k_Memri; }
   bool isMemri() const { return Kind == k_Memri; }
@@ -171,6 +166,11 @@ public:
     return std::make_unique<EVMOperand>(Val, S, E);
   }
 
+  static std::unique_ptr<EVMOperand> CreateWord(const ConstantInt *Val,
+                                                SMLoc S, SMLoc E) {
+    return std::make_unique<EVMOperand>(Val, S, E);
+  }
+
   static std::unique_ptr<EVMOperand>
   CreateMemri(unsigned RegNum, const MCExpr *Val, SMLoc S, SMLoc E) {
     return std::make_unique<EVMOperand>(RegNum, Val, S, E);
@@ -210,6 +210,9 @@ public:
     case k_Immediate:
       O << "Immediate: \"" << *getImm() << "\"";
       break;
+    case k_Word:
+      O << "Word: \"" << Word->getValue() << "\"";
+      break;
     case k_Memri: {
       // only manually print the size for non-negative values,
       // as the sign is inserted automatically.
@@ -221,6 +224,100 @@ public:
   }
 };
 
+bool EVMAsmParser::ParseRegister(unsigned &RegNo, SMLoc &StartLoc,
+                                 SMLoc &EndLoc) {
+  llvm_unreachable("EVM does not have registers.");
+}
+
+// Owns the ConstantInts of literal PUSH operands. They outlive the parser, as
+// tools such as llvm-mca keep the parsed instructions.
+static ManagedStatic<LLVMContext> WordContext;
+static ManagedStatic<sys::Mutex> WordContextLock;
+
+// Only PUSH takes an operand: a literal word, or an expression such as a
+// label.
+bool EVMAsmParser::parseOperand(OperandVector &Operands) {
+  SMLoc S = getLexer().getLoc();
+  const AsmToken &Tok = getLexer().getTok();
+
+  // Literals are kept as full words, as the code emitter takes any PUSH size
+  // from a CImm but only short ones from an Imm.
+  if ((Tok.is(AsmToken::Integer) || Tok.is(AsmToken::BigNum)) &&
+      getLexer().peekTok().is(AsmToken::EndOfStatement)) {
+    APInt Value = Tok.getAPIntVal();
+    if (Value.getActiveBits() > 256)
+      return Error(S, "literal does not fit in a stack word");
+    SMLoc E = Tok.getEndLoc();
+    Parser.Lex();
+    std::lock_guard<sys::Mutex> Lock(*WordContextLock);
+    Operands.push_back(EVMOperand::CreateWord(
+        ConstantInt::get(*WordContext, Value.zextOrTrunc(256)), S, E));
+    return false;
+  }
+
+  const MCExpr *Expr;
+  SMLoc E;
+  if (Parser.parseExpression(Expr, E))
+    return true;
+  Operands.push_back(EVMOperand::CreateImm(Expr, S, E));
+  return false;
+}
+
+bool EVMAsmParser::ParseInstruction(ParseInstructionInfo &Info, StringRef Name,
+                                    SMLoc NameLoc, OperandVector &Operands) {
+  // The generic parser hands over the mnemonic in lower case; EVM mnemonics
+  // are upper case, so take it from the source as written.
+  Name = StringRef(NameLoc.getPointer(), Name.size());
+  Operands.push_back(EVMOperand::CreateToken(Name, NameLoc));
+
+  if (getLexer().isNot(AsmToken::EndOfStatement)) {
+    if (parseOperand(Operands))
+      return true;
+    if (getLexer().isNot(AsmToken::EndOfStatement))
+      return Error(getLexer().getLoc(), "unexpected token in operand list");
+  }
+  Parser.Lex(); // Consume the EndOfStatement.
+  return false;
+}
+
+// All directives are the generic ones.
+bool EVMAsmParser::ParseDirective(AsmToken DirectiveID) {
+  return true;
+}
+
+bool EVMAsmParser::MatchAndEmitInstruction(SMLoc IDLoc, unsigned &Opcode,
+                                           OperandVector &Operands,
+                                           MCStreamer &Out, uint64_t &ErrorInfo,
+                                           bool MatchingInlineAsm) {
+  MCInst Inst;
+  switch (MatchInstructionImpl(Operands, Inst, ErrorInfo, MatchingInlineAsm)) {
+  case Match_Success:
+    Inst.setLoc(IDLoc);
+    Opcode = Inst.getOpcode();
+    Out.EmitInstruction(Inst, getSTI());
+    return false;
+  case Match_MissingFeature:
+    return Error(IDLoc, "instruction requires a feature not currently enabled");
+  case Match_MnemonicFail:
+    return Error(IDLoc, "invalid instruction");
+  case Match_InvalidOperand: {
+    SMLoc ErrorLoc = IDLoc;
+    if (ErrorInfo != ~0ULL) {
+      if (ErrorInfo >= Operands.size())
+        return Error(IDLoc, "too few operands for instruction");
+      ErrorLoc = Operands[ErrorInfo]->getStartLoc();
+    }
+    return Error(ErrorLoc, "invalid operand for instruction");
+  }
+  }
+  llvm_unreachable("Unknown match type detected!");
+}
+
+unsigned EVMAsmParser::validateTargetOperandClass(MCParsedAsmOperand &Op,
+                                                  unsigned Kind) {
+  return 0;
+}
+
 } // end anonymous namespace.
 
 extern "C" void LLVMInitializeEVMAsmParser() {
@@ -22,6 +22,7 @@
 #include "llvm/Support/TargetRegistry.h"
 
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/LLVMContext.h"
 #include <cstdint>
 
 using namespace llvm;
@@ -43,6 +44,13 @@ public:
   DecodeStatus getInstruction(MCInst &Instr, uint64_t &Size,
                               ArrayRef<uint8_t> Bytes, uint64_t Address,
                               raw_ostream &CStream) const override;
+
+private:
+  DecodeStatus decodePush(MCInst &Instr, uint64_t &Size,
+                          ArrayRef<uint8_t> Bytes, unsigned Length) const;
+
+  // Owns the ConstantInts of immediates wider than 64 bits.
+  mutable LLVMContext Context;
 };
 
 } // end anonymous namespace
@@ -63,122 +71,61 @@ extern "C" LLVM_EXTERNAL_VISIBILITY void LLVMInitializeEVMDisassembler() {
 
 #include "EVMGenDisassemblerTables.inc"
 
-static unsigned getPushSize(unsigned int opcode) {
-  switch (opcode) {
-#define CASE(x) \
-  case EVM::PUSH##x:\
-    return x
-    CASE(1);
-    CASE(2);
-    CASE(3);
-    CASE(4);
-    CASE(5);
-    CASE(6);
-    CASE(7);
-    CASE(8);
-    CASE(9);
-    CASE(10);
-    CASE(11);
-    CASE(12);
-    CASE(13);
-    CASE(14);
-    CASE(15);
-    CASE(16);
-    CASE(17);
-    CASE(18);
-    CASE(19);
-    CASE(20);
-    CASE(21);
-    CASE(22);
-    CASE(23);
-    CASE(24);
-    CASE(25);
-    CASE(26);
-    CASE(27);
-    CASE(28);
-    CASE(29);
-    CASE(30);
-    CASE(31);
-    CASE(32);
-#undef CASE(x)
-  default:
-    llvm_unreachable("Invalid PUSH opcode.");
-  }
-}
-
-static ConstantInt* extractPushOperand(ArrayRef<uint8_t> Bytes, uint64_t Address, unsigned opnd_length) {
-
-
-  // Fail if we reach the end of stream.
-  return nullptr;
+static const unsigned PushOpcodes[] = {
+    EVM::PUSH1,  EVM::PUSH2,  EVM::PUSH3,  EVM::PUSH4,  EVM::PUSH5,
+    EVM::PUSH6,  EVM::PUSH7,  EVM::PUSH8,  EVM::PUSH9,  EVM::PUSH10,
+    EVM::PUSH11, EVM::PUSH12, EVM::PUSH13, EVM::PUSH14, EVM::PUSH15,
+    EVM::PUSH16, EVM::PUSH17, EVM::PUSH18, EVM::PUSH19, EVM::PUSH20,
+    EVM::PUSH21, EVM::PUSH22, EVM::PUSH23, EVM::PUSH24, EVM::PUSH25,
+    EVM::PUSH26, EVM::PUSH27, EVM::PUSH28, EVM::PUSH29, EVM::PUSH30,
+    EVM::PUSH31, EVM::PUSH32};
+
+// PUSH1 (0x60) to PUSH32 (0x7f) carry 1 to 32 bytes of immediate.
+static unsigned getPushSize(uint8_t Opcode) {
+  return Opcode >= 0x60 && Opcode <= 0x7f ? Opcode - 0x5f : 0;
 }
 
-static DecodeStatus addOperandToPush(MCInst &Instr, ArrayRef<uint8_t> Bytes, uint64_t Address, unsigned opnd_length) {
-  // extract the operand value from 
-  const ConstantInt* CI = extractPushOperand(Bytes, Address, opnd_length);
-  if (!CI) {
+DecodeStatus EVMDisassembler::decodePush(MCInst &Instr, uint64_t &Size,
+                                         ArrayRef<uint8_t> Bytes,
+                                         unsigned Length) const {
+  // A truncated PUSH at the end of the code.
+  if (Bytes.size() < Length + 1)
     return MCDisassembler::Fail;
-  }
-  Instr.addOperand(MCOperand::createCImm(CI));
-}
 
+  Instr.setOpcode(PushOpcodes[Length - 1]);
+  Size = Length + 1;
+
+  ArrayRef<uint8_t> Imm = Bytes.slice(1, Length);
+  // Values that fit in a non-negative int64_t are plain immediates, which is
+  // also what the code emitter expects for short pushes.
+  if (Length < 8 || (Length == 8 && Imm[0] < 0x80)) {
+    uint64_t Value = 0;
+    for (uint8_t Byte : Imm)
+      Value = (Value << 8) | Byte;
+    Instr.addOperand(MCOperand::createImm(Value));
+    return MCDisassembler::Success;
+  }
 
+  APInt Value(256, 0);
+  for (uint8_t Byte : Imm)
+    Value = Value.shl(8) | Byte;
+  Instr.addOperand(MCOperand::createCImm(ConstantInt::get(Context, Value)));
+  return MCDisassembler::Success;
+}
 
 DecodeStatus EVMDisassembler::getInstruction(MCInst &Instr, uint64_t &Size,
                                              ArrayRef<uint8_t> Bytes,
                                              uint64_t Address,
                                              raw_ostream &CStream) const {
-                          
-  uint8_t insn;
-  DecodeStatus Result = decodeInstruction(DecoderTable8, Instr, insn, Address, this, STI);
-  Size = 1;
+  Size = 0;
+  if (Bytes.empty())
+    return MCDisassembler::Fail;
 
-  // if it is an PUSH instruction then we need to add operands and consume some bytes
-  switch (Instr.getOpcode()) {
-    case EVM::PUSH1:
-    case EVM::PUSH2:
-    case EVM::PUSH3:
-    case EVM::PUSH4:
-    case EVM::PUSH5:
-    case EVM::PUSH6:
-    case EVM::PUSH7:
-    case EVM::PUSH8:
-    case EVM::PUSH9:
-    case EVM::PUSH10:
-    case EVM::PUSH11:
-    case EVM::PUSH12:
-    case EVM::PUSH13:
-    case EVM::PUSH14:
-    case EVM::PUSH15:
-    case EVM::PUSH16:
-    case EVM::PUSH17:
-    case EVM::PUSH18:
-    case EVM::PUSH19:
-    case EVM::PUSH20:
-    case EVM::PUSH21:
-    case EVM::PUSH22:
-    case EVM::PUSH23:
-    case EVM::PUSH24:
-    case EVM::PUSH25:
-    case EVM::PUSH26:
-    case EVM::PUSH27:
-    case EVM::PUSH28:
-    case EVM::PUSH29:
-    case EVM::PUSH30:
-    case EVM::PUSH31:
-    case EVM::PUSH32: {
-      unsigned push_size = getPushSize(Instr.getOpcode());
-      // plus the length of operand;
-      Size += push_size;
-      DecodeStatus operandResult = addOperandToPush(Instr, Bytes, Address, push_size);
-      if (operandResult == MCDisassembler::Fail) {
-        return operandResult;
-      }
-      break;
-    }
-    default:
-      break;
-  }
+  // Skip a single byte on failure, like an invalid opcode.
+  Size = 1;
+  uint8_t Insn = Bytes[0];
+  if (unsigned Length = getPushSize(Insn))
+    return decodePush(Instr, Size, Bytes, Length);
 
-  return Result;
+  return decodeInstruction(DecoderTable8, Instr, Insn, Address, this, STI);
 }
@@ -34,6 +34,12 @@ bool LowerEVMMachineOperandToMCOperand(const MachineOperand &MO,
 FunctionPass  *createEVMISelDag(EVMTargetMachine &TM);
 
 ModulePass    *createEVMCallTransformation();
+ModulePass    *createEVMPackGlobals();
+ModulePass    *createEVMMergeReverts();
+ModulePass    *createEVMCodeGenPartition();
+ModulePass    *createEVMDeployCode();
+ModulePass    *createEVMInstrProfiling(StringRef MapFile);
+ModulePass    *createEVMArgumentOrder();
 FunctionPass  *createEVMPrepareStackification();
 FunctionPass  *createEVMVRegToMem();
 FunctionPass  *createEVMPrepareForLiveIntervals();
@@ -44,6 +50,8 @@ FunctionPass  *createEVMExpandPseudos();
 FunctionPass  *createEVMExpandFramePointer();
 FunctionPass  *createEVMFinalization();
 FunctionPass  *createEVMStackAllocPass();
+FunctionPass  *createEVMGasEstimation();
+FunctionPass  *createEVMMemoryPlan();
 
 void initializeEVMPrepareStackificationPass(PassRegistry &);
 void initializeEVMVRegToMemPass(PassRegistry &);
@@ -56,6 +64,14 @@ void initializeEVMCallTransformationPass(PassRegistry &);
 void initializeEVMFinalizationPass(PassRegistry &);
 void initializeEVMExpandFramePointerPass(PassRegistry &);
 void initializeEVMStackAllocPass(PassRegistry &);
+void initializeEVMPackGlobalsPass(PassRegistry &);
+void initializeEVMGasEstimationPass(PassRegistry &);
+void initializeEVMMergeRevertsPass(PassRegistry &);
+void initializeEVMCodeGenPartitionPass(PassRegistry &);
+void initializeEVMDeployCodePass(PassRegistry &);
+void initializeEVMMemoryPlanPass(PassRegistry &);
+void initializeEVMInstrProfilingPass(PassRegistry &);
+void initializeEVMArgumentOrderPass(PassRegistry &);
 
 }
 
@@ -233,6 +233,10 @@ void EVMArgumentMove::sortStackArgs(MachineFunction &MF) const {
     EntryMBB.insert(InsertPt, index2mi[index]->removeFromParent());
   }
 
+  // a function that halts in its entry block leaves them on the stack.
+  if (EVM::endsInHalt(EntryMBB))
+    unusedArgs.clear();
+
   // TODO: this is buggy
   // insert pops afterwards
   for (std::vector<unsigned>::iterator rit = unusedArgs.begin();
@@ -0,0 +1,242 @@
+//===-- EVMArgumentOrder.cpp - Order the stack arguments of callees -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// A callee finds its arguments on the stack, the first one on top and the
+/// return address at the bottom. The stack allocator goes through them from
+/// the top: an argument used outside the entry block is stored to a slot,
+/// after a SWAP if it is not on top, and an argument only used in the entry
+/// block stays on the stack. For a function whose every use is a direct
+/// call, which is true of internal functions that do not escape, this pass
+/// picks the parameter order that needs the fewest of these SWAPs:
+///
+/// 1. The arguments that are stored go on top, so each is stored without a
+///    SWAP.
+/// 2. The arguments that stay follow in the order the entry block uses them,
+///    by instruction and then by operand. Unused arguments come first, as
+///    they are popped right away.
+/// 3. If the return address is stored too, the SWAP bringing it up sends the
+///    top argument to the bottom, so the argument used last goes on top.
+///
+/// The return address stays at the bottom, where the call sequence puts it,
+/// and the callers copy each argument with a DUP whatever the order.
+///
+//===----------------------------------------------------------------------===//
+
+#include "EVM.h"
+#include "EVMSubtarget.h"
+#include "EVMTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/TargetPassConfig.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "evm-argument-order"
+
+STATISTIC(NumReorderedFunctions, "Number of functions with reordered arguments");
+
+static cl::opt<bool>
+DisableArgumentOrder("evm-disable-argument-order", cl::init(false),
+                     cl::Hidden,
+                     cl::desc("Keep the parameter order of internal functions"));
+
+namespace {
+
+class EVMArgumentOrder final : public ModulePass {
+public:
+  static char ID; // Pass identification, replacement for typeid
+  EVMArgumentOrder() : ModulePass(ID) {}
+
+  StringRef getPassName() const override { return "EVM argument order"; }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<TargetPassConfig>();
+  }
+
+  bool runOnModule(Module &M) override;
+
+private:
+  bool getOrder(Function &F, bool HasSubroutine,
+                SmallVectorImpl<unsigned> &Order) const;
+  void reorder(Function &F, ArrayRef<unsigned> Order);
+};
+} // end anonymous namespace
+
+char EVMArgumentOrder::ID = 0;
+INITIALIZE_PASS(EVMArgumentOrder, DEBUG_TYPE,
+                "Order the stack arguments of EVM callees", false, false)
+
+ModulePass *llvm::createEVMArgumentOrder() { return new EVMArgumentOrder(); }
+
+static bool isOnlyCalledDirectly(const Function &F) {
+  if (!F.hasLocalLinkage() || F.isDeclaration() || F.isVarArg() ||
+      EVMSubtarget::isMainFunction(F))
+    return false;
+  for (const Use &U : F.uses()) {
+    const auto *CI = dyn_cast<CallInst>(U.getUser());
+    if (!CI || !CI->isCallee(&U) || CI->getFunctionType() != F.getFunctionType())
+      return false;
+  }
+  return true;
+}
+
+// Fills Order with the old index of each new parameter. Returns false if
+// the current order is as good.
+bool EVMArgumentOrder::getOrder(Function &F, bool HasSubroutine,
+                                SmallVectorImpl<unsigned> &Order) const {
+  BasicBlock &Entry = F.getEntryBlock();
+  DenseMap<const Instruction *, unsigned> Position;
+  unsigned N = 0;
+  for (const Instruction &I : Entry)
+    Position[&I] = N++;
+
+  // The arguments that are stored, and the others with their first use in
+  // the entry block. The first operand of an instruction is wanted on top.
+  using UsePosition = std::pair<unsigned, unsigned>;
+  SmallVector<unsigned, 8> Stored;
+  SmallVector<std::pair<UsePosition, unsigned>, 8> Kept;
+  for (Argument &A : F.args()) {
+    if (A.use_empty()) {
+      Kept.emplace_back(UsePosition(0, 0), A.getArgNo());
+      continue;
+    }
+    UsePosition First(N + 1, 0);
+    bool IsLocal = true;
+    for (const Use &U : A.uses()) {
+      const auto *I = cast<Instruction>(U.getUser());
+      if (I->getParent() != &Entry) {
+        IsLocal = false;
+        break;
+      }
+      First = std::min(First, UsePosition(Position[I] + 1, U.getOperandNo()));
+    }
+    if (IsLocal)
+      Kept.emplace_back(First, A.getArgNo());
+    else
+      Stored.push_back(A.getArgNo());
+  }
+  llvm::stable_sort(Kept, less_first());
+
+  // The return address is stored if some block other than the entry block
+  // returns.
+  bool RetAddrStored = false;
+  if (!HasSubroutine)
+    for (const BasicBlock &BB : F)
+      if (&BB != &Entry && isa<ReturnInst>(BB.getTerminator()))
+        RetAddrStored = true;
+
+  Order.append(Stored.begin(), Stored.end());
+  if (RetAddrStored && Kept.size() > 1)
+    std::rotate(Kept.begin(), Kept.end() - 1, Kept.end());
+  for (const auto &K : Kept)
+    Order.push_back(K.second);
+
+  for (unsigned I = 0, E = Order.size(); I != E; ++I)
+    if (Order[I] != I)
+      return true;
+  return false;
+}
+
+void EVMArgumentOrder::reorder(Function &F, ArrayRef<unsigned> Order) {
+  FunctionType *FTy = F.getFunctionType();
+  SmallVector<Type *, 8> Params;
+  for (unsigned Old : Order)
+    Params.push_back(FTy->getParamType(Old));
+  auto *NFTy = FunctionType::get(FTy->getReturnType(), Params, false);
+
+  AttributeList Attrs = F.getAttributes();
+  SmallVector<AttributeSet, 8> ParamAttrs;
+  for (unsigned Old : Order)
+    ParamAttrs.push_back(Attrs.getParamAttributes(Old));
+  LLVMContext &Ctx = F.getContext();
+  auto NewAttrs = AttributeList::get(Ctx, Attrs.getFnAttributes(),
+                                     Attrs.getRetAttributes(), ParamAttrs);
+
+  Function *NF = Function::Create(NFTy, F.getLinkage(), F.getAddressSpace());
+  NF->copyAttributesFrom(&F);
+  NF->setAttributes(NewAttrs);
+  NF->setComdat(F.getComdat());
+  F.getParent()->getFunctionList().insert(F.getIterator(), NF);
+  NF->takeName(&F);
+  NF->getBasicBlockList().splice(NF->begin(), F.getBasicBlockList());
+
+  for (unsigned New = 0, E = Order.size(); New != E; ++New) {
+    Argument *OldArg = F.getArg(Order[New]);
+    Argument *NewArg = NF->getArg(New);
+    NewArg->takeName(OldArg);
+    OldArg->replaceAllUsesWith(NewArg);
+  }
+
+  SmallVector<std::pair<unsigned, MDNode *>, 1> MDs;
+  F.getAllMetadata(MDs);
+  for (const auto &MD : MDs)
+    NF->addMetadata(MD.first, *MD.second);
+
+  while (!F.use_empty()) {
+    auto *CI = cast<CallInst>(F.user_back());
+    AttributeList CallAttrs = CI->getAttributes();
+    SmallVector<Value *, 8> Args;
+    SmallVector<AttributeSet, 8> ArgAttrs;
+    for (unsigned Old : Order) {
+      Args.push_back(CI->getArgOperand(Old));
+      ArgAttrs.push_back(CallAttrs.getParamAttributes(Old));
+    }
+    SmallVector<OperandBundleDef, 1> Bundles;
+    CI->getOperandBundlesAsDefs(Bundles);
+    auto *NCI = CallInst::Create(NFTy, NF, Args, Bundles, "", CI);
+    NCI->setCallingConv(CI->getCallingConv());
+    NCI->setTailCallKind(CI->getTailCallKind());
+    NCI->setAttributes(AttributeList::get(Ctx, CallAttrs.getFnAttributes(),
+                                          CallAttrs.getRetAttributes(),
+                                          ArgAttrs));
+    NCI->setDebugLoc(CI->getDebugLoc());
+    NCI->copyMetadata(*CI);
+    NCI->takeName(CI);
+    CI->replaceAllUsesWith(NCI);
+    CI->eraseFromParent();
+  }
+
+  F.eraseFromParent();
+}
+
+bool EVMArgumentOrder::runOnModule(Module &M) {
+  if (DisableArgumentOrder)
+    return false;
+
+  const auto &TM = getAnalysis<TargetPassConfig>().getTM<EVMTargetMachine>();
+
+  SmallVector<Function *, 8> Candidates;
+  for (Function &F : M)
+    if (F.arg_size() > 1 && isOnlyCalledDirectly(F))
+      Candidates.push_back(&F);
+
+  bool Changed = false;
+  for (Function *F : Candidates) {
+    bool HasSubroutine = TM.getSubtargetImpl(*F)->hasSubroutine();
+    SmallVector<unsigned, 8> Order;
+    if (!getOrder(*F, HasSubroutine, Order))
+      continue;
+
+    LLVM_DEBUG({
+      dbgs() << "Reordering the arguments of " << F->getName() << ":";
+      for (unsigned Old : Order)
+        dbgs() << ' ' << Old;
+      dbgs() << '\n';
+    });
+    reorder(*F, Order);
+    ++NumReorderedFunctions;
+    Changed = true;
+  }
+  return Changed;
+}
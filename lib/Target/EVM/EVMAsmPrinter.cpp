@@ -16,12 +16,17 @@
 #include "MCTargetDesc/EVMInstPrinter.h"
 #include "EVMTargetMachine.h"
 #include "EVMUtils.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/BinaryFormat/EVM.h"
 #include "llvm/CodeGen/AsmPrinter.h"
 #include "llvm/CodeGen/MachineConstantPool.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/CodeGen/MachineInstr.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Module.h"
 #include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCExpr.h"
 #include "llvm/MC/MCInst.h"
 #include "llvm/MC/MCStreamer.h"
 #include "llvm/MC/MCSymbol.h"
@@ -47,6 +52,7 @@ public:
   StringRef getPassName() const override { return "EVM Assembly Printer"; }
 
   void EmitInstruction(const MachineInstr *MI) override;
+  void EmitEndOfAsmFile(Module &M) override;
 
   void printOperand(const MachineInstr *MI, unsigned OpNo, raw_ostream &OS);
 
@@ -67,6 +73,7 @@ public:
 
 private:
   MCSymbol* createSymbol(std::string name) const;
+  void emitPushImmutable(const MachineInstr *MI);
 
   std::unique_ptr<MCSubtargetInfo> STI;
   MCContext* ctx;
@@ -108,7 +115,33 @@ static bool emitEVMComments(const MachineInstr* MI, raw_ostream &OS) {
   return true;
 }
 
+// A PUSH32 of zeros, which the init code overwrites with the value of the
+// immutable. The symbol of the read points at the value.
+void EVMAsmPrinter::emitPushImmutable(const MachineInstr *MI) {
+  const MachineOperand &MO = MI->getOperand(0);
+  uint64_t Read = MO.isImm() ? MO.getImm() : MO.getCImm()->getZExtValue();
+  MCSymbol *Label = OutContext.createTempSymbol();
+  OutStreamer->EmitLabel(Label);
+  OutStreamer->EmitAssignment(
+      GetExternalSymbolSymbol(EVM::ImmutableSymbolPrefix + utostr(Read)),
+      MCBinaryExpr::createAdd(MCSymbolRefExpr::create(Label, OutContext),
+                              MCConstantExpr::create(1, OutContext),
+                              OutContext));
+
+  LLVMContext &Ctx = MF->getFunction().getContext();
+  MCInst Push;
+  Push.setOpcode(EVM::PUSH32);
+  Push.addOperand(MCOperand::createCImm(
+      ConstantInt::get(Type::getIntNTy(Ctx, 256), 0)));
+  EmitToStreamer(*OutStreamer, Push);
+}
+
 void EVMAsmPrinter::EmitInstruction(const MachineInstr *MI) {
+  if (MI->getOpcode() == EVM::pPUSHIMMUTABLE) {
+    emitPushImmutable(MI);
+    return;
+  }
+
   EVMMCInstLower MCInstLowering(OutContext, *this);
   MCInst TmpInst;
   MCInstLowering.Lower(MI, TmpInst);
@@ -120,6 +153,26 @@ void EVMAsmPrinter::EmitInstruction(const MachineInstr *MI) {
   }
 }
 
+// With init code, the runtime code is the text section, which is written
+// after the init section. Their sizes are the offset and size of the runtime
+// code that the init code copies out.
+void EVMAsmPrinter::EmitEndOfAsmFile(Module &M) {
+  const Function *Init = nullptr;
+  for (const Function &F : M)
+    if (!F.isDeclaration() && F.getSection() == EVM::InitSectionName) {
+      Init = &F;
+      break;
+    }
+  if (!Init)
+    return;
+
+  const TargetLoweringObjectFile &TLOF = getObjFileLowering();
+  OutStreamer->SwitchSection(TLOF.getTextSection());
+  OutStreamer->EmitLabel(GetExternalSymbolSymbol(EVM::RuntimeSizeSymbol));
+  OutStreamer->SwitchSection(TLOF.SectionForGlobal(Init, TM));
+  OutStreamer->EmitLabel(GetExternalSymbolSymbol(EVM::RuntimeOffsetSymbol));
+}
+
 void EVMAsmPrinter::printOperand(const MachineInstr *MI, unsigned OpNo,
                                  raw_ostream &OS) {
   const MachineOperand &MO = MI->getOperand(OpNo);
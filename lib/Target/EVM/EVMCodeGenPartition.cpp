@@ -0,0 +1,103 @@
+//===-- EVMCodeGenPartition.cpp - Keep one partition of a module ----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Parallel code generation (llc -codegen-threads) gives every code generator
+/// a copy of the whole module, with each function definition tagged by the
+/// "evm-codegen-partition" attribute and the module tagged by a flag of the
+/// same name. This pass runs after the module-wide IR passes, so that every
+/// copy agrees on global slots, packed globals and revert stubs, and turns
+/// the definitions of other partitions into declarations.
+///
+/// Functions without the attribute, such as the revert stubs, belong to
+/// partition 0, as do the global initializers. Private functions become
+/// internal: the assembler-local names of private symbols cannot be
+/// referenced from another partition.
+///
+//===----------------------------------------------------------------------===//
+
+#include "EVM.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "evm-codegen-partition"
+
+STATISTIC(NumDroppedBodies, "Number of functions left to other partitions");
+
+namespace {
+
+class EVMCodeGenPartition final : public ModulePass {
+public:
+  static char ID; // Pass identification, replacement for typeid
+  EVMCodeGenPartition() : ModulePass(ID) {}
+
+  StringRef getPassName() const override {
+    return "EVM select code generation partition";
+  }
+
+  bool runOnModule(Module &M) override;
+};
+} // end anonymous namespace
+
+char EVMCodeGenPartition::ID = 0;
+INITIALIZE_PASS(EVMCodeGenPartition, DEBUG_TYPE,
+                "Keep the functions of one code generation partition", false,
+                false)
+
+ModulePass *llvm::createEVMCodeGenPartition() {
+  return new EVMCodeGenPartition();
+}
+
+static unsigned getPartition(const Function &F) {
+  unsigned Partition = 0;
+  Attribute A = F.getFnAttribute(DEBUG_TYPE);
+  if (A.isStringAttribute())
+    A.getValueAsString().getAsInteger(10, Partition);
+  return Partition;
+}
+
+bool EVMCodeGenPartition::runOnModule(Module &M) {
+  auto *Flag =
+      mdconst::extract_or_null<ConstantInt>(M.getModuleFlag(DEBUG_TYPE));
+  if (!Flag)
+    return false;
+  unsigned Partition = Flag->getZExtValue();
+
+  LLVM_DEBUG(dbgs() << "********** Code generation partition " << Partition
+                    << " **********\n");
+
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    if (F.hasPrivateLinkage())
+      F.setLinkage(GlobalValue::InternalLinkage);
+    if (getPartition(F) == Partition)
+      continue;
+    LLVM_DEBUG(dbgs() << "Dropping " << F.getName() << '\n');
+    F.deleteBody();
+    F.setComdat(nullptr);
+    ++NumDroppedBodies;
+  }
+
+  // Global variables keep their slots, which are numbered over all of them,
+  // but only partition 0 emits their contents.
+  if (Partition != 0)
+    for (GlobalVariable &GV : M.globals())
+      if (!GV.isDeclaration()) {
+        GV.setInitializer(nullptr);
+        GV.setLinkage(GlobalValue::ExternalLinkage);
+        GV.setComdat(nullptr);
+      }
+  return true;
+}
@@ -169,6 +169,12 @@ bool EVMConvertRegToStack::runOnMachineFunction(MachineFunction &MF) {
         continue;
       }
 
+      if (opc == EVM::pPUSHIMMUTABLE_r) {
+        MI.RemoveOperand(0);
+        MI.setDesc(TII->get(EVM::pPUSHIMMUTABLE));
+        continue;
+      }
+
       // expand SWAP
       if (opc == EVM::SWAP_r) {
         convertSWAP(&MI);
@@ -205,20 +211,24 @@ bool EVMConvertRegToStack::runOnMachineFunction(MachineFunction &MF) {
           // it at the finalization pass.
           if (RegOpcode == EVM::pRETURNSUB_r ||
               RegOpcode == EVM::pRETURNSUBVOID_r) {
+            // With subroutine support the return address is on the return
+            // stack instead of below the return value.
             if (MF.getSubtarget<EVMSubtarget>().hasSubroutine()) {
-              StackOpcode = EVM::JUMPSUB;
+              StackOpcode = EVM::RETURNSUB;
             } else {
               StackOpcode = EVM::JUMP;
             }
           }
 
-          else if (RegOpcode == EVM::pJUMPSUB_r || EVM::pJUMPSUBVOID_r) {
+          else if (RegOpcode == EVM::pJUMPSUB_r ||
+                   RegOpcode == EVM::pJUMPSUBVOID_r) {
             // store FreeMemory Pointer to latest location:
 
             EVMMachineFunctionInfo *MFI = MF.getInfo<EVMMachineFunctionInfo>();
 
-            // we implicitly allocate a slot at FP[lastIndex+1]:
-            unsigned index = MFI->getNumAllocatedIndexInFunction() + 1;
+            // we implicitly allocate a slot above the slots that are still
+            // needed after the call:
+            unsigned index = MFI->getCallFrameIndex(MI);
 
             // store current FP to fp[index]:
             // TODO can optimize this sequence
@@ -243,26 +253,40 @@ bool EVMConvertRegToStack::runOnMachineFunction(MachineFunction &MF) {
             // MSTORE
 
             unsigned fpaddr = MF.getSubtarget<EVMSubtarget>().getFramePointer();
-            BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
-                    TII->get(EVM::PUSH32))
-                .addImm(fpaddr);
-            BuildMI(*MI.getParent(), MI, MI.getDebugLoc(), TII->get(EVM::MLOAD));
-            BuildMI(*MI.getParent(), MI, MI.getDebugLoc(), TII->get(EVM::DUP1));
-            BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
-                    TII->get(EVM::PUSH32))
-                .addImm(index * 32);
-            BuildMI(*MI.getParent(), MI, MI.getDebugLoc(), TII->get(EVM::ADD));
-            BuildMI(*MI.getParent(), MI, MI.getDebugLoc(), TII->get(EVM::MSTORE));
-
+            if (EVMSubtarget::isMainFunction(MF.getFunction())) {
+              // The frame of a main function is always at the frame base,
+              // so its frame pointer is neither loaded nor saved.
+              unsigned base = MF.getSubtarget<EVMSubtarget>().getFrameBase();
+              BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+                      TII->get(EVM::PUSH32))
+                  .addImm(base + (index + 1) * 32);
+            } else {
+              BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+                      TII->get(EVM::PUSH32))
+                  .addImm(fpaddr);
+              BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+                      TII->get(EVM::MLOAD));
+              BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+                      TII->get(EVM::DUP1));
+              BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+                      TII->get(EVM::PUSH32))
+                  .addImm(index * 32);
+              BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+                      TII->get(EVM::ADD));
+              BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+                      TII->get(EVM::MSTORE));
 
-            BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
-                    TII->get(EVM::PUSH32))
-                .addImm(fpaddr);
-            BuildMI(*MI.getParent(), MI, MI.getDebugLoc(), TII->get(EVM::MLOAD));
-            BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
-                    TII->get(EVM::PUSH32))
-                .addImm((index + 1) * 32);
-            BuildMI(*MI.getParent(), MI, MI.getDebugLoc(), TII->get(EVM::ADD));
+              BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+                      TII->get(EVM::PUSH32))
+                  .addImm(fpaddr);
+              BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+                      TII->get(EVM::MLOAD));
+              BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+                      TII->get(EVM::PUSH32))
+                  .addImm((index + 1) * 32);
+              BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+                      TII->get(EVM::ADD));
+            }
 
             // Duplicate the new fp to initialize SP
             BuildMI(*MI.getParent(), MI, MI.getDebugLoc(), TII->get(EVM::DUP1));
@@ -279,9 +303,14 @@ bool EVMConvertRegToStack::runOnMachineFunction(MachineFunction &MF) {
                 .addImm(spaddr);
             BuildMI(*MI.getParent(), MI, MI.getDebugLoc(), TII->get(EVM::MSTORE));
             
-            if (MF.getSubtarget<EVMSubtarget>().hasSubroutine()) {
-              // With subroutine support we do not push return address on to stack
+            bool HasSubroutine =
+                MF.getSubtarget<EVMSubtarget>().hasSubroutine();
+            if (HasSubroutine) {
+              // With subroutine support we do not push return address on to
+              // stack. The callee address is already on top, see SelectCall.
               StackOpcode = EVM::JUMPSUB;
+              MI.setAsmPrinterFlag(
+                  EVM::BuildCommentFlags(EVM::SUBROUTINE_BEGIN, 0));
             } else {
               // here we build the return address, and insert it as the first
               // argument of the function.
@@ -304,9 +333,13 @@ bool EVMConvertRegToStack::runOnMachineFunction(MachineFunction &MF) {
 
             MachineBasicBlock::iterator MIT(MI);
 
-            // insert JUMPDEST after MI
+            // insert JUMPDEST after MI. RETURNSUB returns right after the
+            // JUMPSUB, which needs no JUMPDEST.
             const DebugLoc &DL = MI.getDebugLoc();
-            MIT = MBB.insertAfter(MIT, BuildMI(MF, DL, TII->get(EVM::JUMPDEST)));
+            if (!HasSubroutine) {
+              MIT = MBB.insertAfter(MIT,
+                                    BuildMI(MF, DL, TII->get(EVM::JUMPDEST)));
+            }
 
             // restore free pointer from index
             // PUSH FPAddr  (fpaddr)
@@ -0,0 +1,254 @@
+//===-- EVMDeployCode.cpp - Generate the init code of a contract ----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// A module that defines a "constructor" function besides "main" is a
+/// contract with init code. The init code runs once, at deployment, and
+/// returns the runtime code to be stored. This pass splits the module into
+/// the two programs:
+///
+/// 1. The constructor and every function it calls go into the init section,
+///    which the object writer puts before the runtime code. A function that
+///    the runtime code calls as well is cloned, as code in one of them cannot
+///    jump into the other.
+/// 2. Globals with the "evm-immutable" attribute are written by the
+///    constructor and only read by the runtime code. A read in the runtime
+///    code becomes a PUSH32 placeholder, and the init code writes the value
+///    into the placeholder.
+/// 3. Returning from the constructor deploys the runtime code: it is copied
+///    from the code to the end of memory, the placeholders are filled, and
+///    the copy is returned.
+///
+//===----------------------------------------------------------------------===//
+
+#include "EVM.h"
+#include "EVMSubtarget.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/BinaryFormat/EVM.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicsEVM.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "evm-deploy-code"
+
+STATISTIC(NumInitFunctions, "Number of functions placed in the init code");
+STATISTIC(NumClonedFunctions, "Number of functions cloned for the init code");
+STATISTIC(NumImmutableReads, "Number of immutable reads patched at deployment");
+
+namespace {
+
+class EVMDeployCode final : public ModulePass {
+public:
+  static char ID; // Pass identification, replacement for typeid
+  EVMDeployCode() : ModulePass(ID) {}
+
+  StringRef getPassName() const override { return "EVM deploy code"; }
+
+  bool runOnModule(Module &M) override;
+
+private:
+  // An immutable read in the runtime code, in order of the read numbers.
+  using ImmutableReads = SmallVector<GlobalVariable *, 8>;
+
+  void moveToInitCode(Function &Ctor, SmallPtrSetImpl<Function *> &Init);
+  bool replaceImmutableReads(Module &M, const SmallPtrSetImpl<Function *> &Init,
+                             ImmutableReads &Reads);
+  void emitDeploy(ReturnInst *RI, const ImmutableReads &Reads);
+};
+} // end anonymous namespace
+
+char EVMDeployCode::ID = 0;
+INITIALIZE_PASS(EVMDeployCode, DEBUG_TYPE,
+                "Split a contract into init and runtime code", false, false)
+
+ModulePass *llvm::createEVMDeployCode() { return new EVMDeployCode(); }
+
+static bool isImmutable(const GlobalVariable &GV) {
+  return GV.hasAttribute("evm-immutable");
+}
+
+void EVMDeployCode::moveToInitCode(Function &Ctor,
+                                   SmallPtrSetImpl<Function *> &Init) {
+  // The original callees, in the order they are found, and their copies.
+  MapVector<Function *, Function *> InitCopies;
+  SmallVector<Function *, 8> Worklist{&Ctor};
+  Init.insert(&Ctor);
+
+  while (!Worklist.empty()) {
+    Function *F = Worklist.pop_back_val();
+    F->setSection(EVM::InitSectionName);
+    ++NumInitFunctions;
+
+    for (BasicBlock &BB : *F)
+      for (Instruction &I : BB) {
+        auto *CB = dyn_cast<CallBase>(&I);
+        if (!CB)
+          continue;
+        Function *Callee = CB->getCalledFunction();
+        if (!Callee || Callee->isDeclaration() || Init.count(Callee))
+          continue;
+
+        Function *&Copy = InitCopies[Callee];
+        if (!Copy) {
+          ValueToValueMapTy VMap;
+          Copy = CloneFunction(Callee, VMap);
+          Copy->setName(Callee->getName() + ".deploy");
+          Copy->setLinkage(GlobalValue::InternalLinkage);
+          Init.insert(Copy);
+          Worklist.push_back(Copy);
+          ++NumClonedFunctions;
+        }
+        CB->setCalledFunction(Copy);
+      }
+  }
+
+  // The originals that only the init code called are dead now, and so are
+  // the ones only they called.
+  SmallVector<Function *, 8> Originals;
+  for (auto &Entry : InitCopies)
+    if (!EVMSubtarget::isMainFunction(*Entry.first))
+      Originals.push_back(Entry.first);
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (Function *&Original : Originals)
+      if (Original && Original->use_empty()) {
+        LLVM_DEBUG(dbgs() << "Moved " << Original->getName()
+                          << " into the init code\n");
+        Original->eraseFromParent();
+        Original = nullptr;
+        Changed = true;
+      }
+  }
+}
+
+bool EVMDeployCode::replaceImmutableReads(
+    Module &M, const SmallPtrSetImpl<Function *> &Init,
+    ImmutableReads &Reads) {
+  Function *LoadImmutable =
+      Intrinsic::getDeclaration(&M, Intrinsic::evm_loadimmutable);
+  Type *I256 = LoadImmutable->getReturnType();
+
+  for (Function &F : M) {
+    if (F.isDeclaration() || Init.count(&F))
+      continue;
+    for (BasicBlock &BB : F)
+      for (auto I = BB.begin(), E = BB.end(); I != E;) {
+        Instruction &Inst = *I++;
+        for (Value *Op : Inst.operands()) {
+          auto *GV = dyn_cast<GlobalVariable>(Op->stripPointerCasts());
+          if (!GV || !isImmutable(*GV))
+            continue;
+          auto *LI = dyn_cast<LoadInst>(&Inst);
+          if (!LI || LI->getType() != I256) {
+            M.getContext().diagnose(DiagnosticInfoUnsupported(
+                F, "immutable " + GV->getName() +
+                       " may only be loaded as i256 outside of the "
+                       "constructor",
+                Inst.getDebugLoc()));
+            return false;
+          }
+
+          IRBuilder<> Builder(LI);
+          Value *Read = Builder.CreateCall(
+              LoadImmutable, ConstantInt::get(I256, Reads.size()));
+          LI->replaceAllUsesWith(Read);
+          LI->eraseFromParent();
+          Reads.push_back(GV);
+          ++NumImmutableReads;
+          break;
+        }
+      }
+  }
+  return true;
+}
+
+void EVMDeployCode::emitDeploy(ReturnInst *RI, const ImmutableReads &Reads) {
+  Module &M = *RI->getModule();
+  auto getIntrinsic = [&M](Intrinsic::ID ID) {
+    return Intrinsic::getDeclaration(&M, ID);
+  };
+  IRBuilder<> Builder(RI);
+  Type *I256 = Builder.getIntNTy(256);
+
+  // The immutables are read before MSIZE, so that the copy of the runtime
+  // code starts above their slots.
+  MapVector<GlobalVariable *, Value *> Values;
+  for (GlobalVariable *GV : Reads)
+    if (!Values.count(GV))
+      Values[GV] = Builder.CreateLoad(I256, GV, GV->getName());
+
+  Value *Dst = Builder.CreateCall(getIntrinsic(Intrinsic::evm_msize), {},
+                                  "runtime");
+  Value *Offset =
+      Builder.CreateCall(getIntrinsic(Intrinsic::evm_runtimeoffset));
+  Value *Size = Builder.CreateCall(getIntrinsic(Intrinsic::evm_runtimesize));
+  Builder.CreateCall(getIntrinsic(Intrinsic::evm_codecopy),
+                     {Dst, Offset, Size});
+
+  Function *ImmutableOffset = getIntrinsic(Intrinsic::evm_immutableoffset);
+  Function *MStore = getIntrinsic(Intrinsic::evm_mstore);
+  for (unsigned Read = 0, E = Reads.size(); Read != E; ++Read) {
+    Value *Placeholder = Builder.CreateCall(ImmutableOffset,
+                                            ConstantInt::get(I256, Read));
+    Builder.CreateCall(MStore, {Builder.CreateAdd(Dst, Placeholder),
+                                Values[Reads[Read]]});
+  }
+
+  Builder.CreateCall(getIntrinsic(Intrinsic::evm_return), {Dst, Size});
+  Builder.CreateUnreachable();
+  RI->eraseFromParent();
+}
+
+bool EVMDeployCode::runOnModule(Module &M) {
+  Function *Ctor = M.getFunction("constructor");
+  if (!Ctor)
+    Ctor = M.getFunction("solidity.constructor");
+  if (!Ctor || Ctor->isDeclaration())
+    return false;
+
+  LLVM_DEBUG(dbgs() << "********** Deploy code **********\n");
+
+  if (M.getModuleFlag("evm-codegen-partition")) {
+    M.getContext().diagnose(DiagnosticInfoUnsupported(
+        *Ctor, "a contract with a constructor cannot be split into code "
+               "generation partitions"));
+    return false;
+  }
+  if (!Ctor->getReturnType()->isVoidTy()) {
+    M.getContext().diagnose(DiagnosticInfoUnsupported(
+        *Ctor, "the constructor must return void"));
+    return false;
+  }
+
+  SmallPtrSet<Function *, 8> Init;
+  moveToInitCode(*Ctor, Init);
+
+  ImmutableReads Reads;
+  if (!replaceImmutableReads(M, Init, Reads))
+    return true;
+
+  SmallVector<ReturnInst *, 4> Returns;
+  for (BasicBlock &BB : *Ctor)
+    if (auto *RI = dyn_cast<ReturnInst>(BB.getTerminator()))
+      Returns.push_back(RI);
+  for (ReturnInst *RI : Returns)
+    emitDeploy(RI, Reads);
+  return true;
+}
@@ -69,12 +69,18 @@ bool EVMExpandFramePointer::handleFramePointer(MachineInstr *MI) {
 
       // $reg = PUSH32_r $fp addr
       // $fp = MLOAD $reg
+      // The frame of a main function is always at the frame base.
       unsigned fpReg = this->getNewRegister(MI);
-      unsigned reg = this->getNewRegister(MI);
-      BuildMI(*MBB, MI, DL, TII->get(EVM::PUSH32_r), reg)
-          .addImm(ST->getFramePointer());
-      BuildMI(*MBB, MI, DL, TII->get(EVM::MLOAD_r), fpReg)
-          .addReg(reg);
+      if (EVMSubtarget::isMainFunction(MBB->getParent()->getFunction())) {
+        BuildMI(*MBB, MI, DL, TII->get(EVM::PUSH32_r), fpReg)
+            .addImm(ST->getFrameBase());
+      } else {
+        unsigned reg = this->getNewRegister(MI);
+        BuildMI(*MBB, MI, DL, TII->get(EVM::PUSH32_r), reg)
+            .addImm(ST->getFramePointer());
+        BuildMI(*MBB, MI, DL, TII->get(EVM::MLOAD_r), fpReg)
+            .addReg(reg);
+      }
       LLVM_DEBUG({
         dbgs() << "Expanding $fp to %"
                <<Register::virtReg2Index(fpReg) << " in instruction: ";
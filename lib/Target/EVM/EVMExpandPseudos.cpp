@@ -114,7 +114,6 @@ void EVMExpandPseudos::expandLOCAL(MachineInstr* MI) const {
   // MSTORE addr
   unsigned opc = MI->getOpcode();
 
-  unsigned reg    = this->getNewRegister(MI);
   unsigned fpReg    = this->getNewRegister(MI);
   unsigned immReg   = this->getNewRegister(MI);
   unsigned addrReg  = this->getNewRegister(MI);
@@ -122,10 +121,17 @@ void EVMExpandPseudos::expandLOCAL(MachineInstr* MI) const {
   //# TODO: improve this
   unsigned fiSize = this->MF->getFrameInfo().getStackSize();
 
-  BuildMI(*MBB, MI, DL, TII->get(EVM::PUSH32_r), reg)
-      .addImm(ST->getFramePointer());
-  BuildMI(*MBB, MI, DL, TII->get(EVM::MLOAD_r), fpReg)
-    .addReg(reg);
+  // The frame of a main function is always at the frame base.
+  if (EVMSubtarget::isMainFunction(this->MF->getFunction())) {
+    BuildMI(*MBB, MI, DL, TII->get(EVM::PUSH32_r), fpReg)
+        .addImm(ST->getFrameBase());
+  } else {
+    unsigned reg = this->getNewRegister(MI);
+    BuildMI(*MBB, MI, DL, TII->get(EVM::PUSH32_r), reg)
+        .addImm(ST->getFramePointer());
+    BuildMI(*MBB, MI, DL, TII->get(EVM::MLOAD_r), fpReg)
+      .addReg(reg);
+  }
   unsigned slot_index = MI->getOperand(1).getImm() + (fiSize/32);
   BuildMI(*MBB, MI, DL, TII->get(EVM::PUSH32_r), immReg)
       .addImm(slot_index * 32);
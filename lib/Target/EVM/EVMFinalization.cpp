@@ -58,29 +58,30 @@ FunctionPass *llvm::createEVMFinalization() {
 }
 
 bool EVMFinalization::shouldInsertJUMPDEST(MachineBasicBlock &MBB) const {
-  if (ST->hasSubroutine()) {
-    return false;
-  }
-
   if (MBB.empty()) {
     return false;
   }
 
-  // Entry MBB needs a basic block.
+  // Entry MBB needs a basic block, unless it is a subroutine entry.
   if (&MBB == &MBB.getParent()->front()) {
-    return true;
+    return !shouldInsertBEGINSUB(MBB);
   }
 
-  // for now we will add a JUMPDEST anyway.
+  // for now we will add a JUMPDEST anyway. Branches inside a function are
+  // plain JUMPs even with subroutine support.
   return true;
 }
 
+// With subroutine support, functions are entered through JUMPSUB, which
+// only lands on BEGINSUB. The main function is entered from the top.
 bool EVMFinalization::shouldInsertBEGINSUB(MachineBasicBlock &MBB) const {
   if (!ST->hasSubroutine()) {
     return false;
   }
 
-  return true;
+  const MachineFunction &MF = *MBB.getParent();
+  return &MBB == &MF.front() &&
+         !EVMSubtarget::isMainFunction(MF.getFunction());
 }
 
 void EVMFinalization::expandADJFP(MachineInstr* MI) const {
@@ -0,0 +1,355 @@
+//===-- EVMGasEstimation.cpp - Static gas estimation ------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file computes static gas bounds for each basic block and function
+/// after the code has been converted to stack form. Block costs are the sum
+/// of the static costs in the instruction table. Function bounds are taken
+/// over the acyclic paths of the CFG; every loop contributes a per-iteration
+/// cost so the total is parametric in the trip counts. Memory expansion is
+/// estimated from constant addresses used by MLOAD and MSTORE.
+///
+/// The results are emitted as optimization remarks, and written to a JSON or
+/// YAML report when -evm-gas-report is given.
+///
+//===----------------------------------------------------------------------===//
+
+#include "EVMGasEstimation.h"
+#include "MCTargetDesc/EVMMCTargetDesc.h"
+#include "EVMSubtarget.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/MachineOptimizationRemarkEmitter.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "evm-gas-estimation"
+
+namespace {
+enum GasReportFormat { GRF_JSON, GRF_YAML };
+}
+
+static cl::opt<std::string>
+    GasReportFile("evm-gas-report",
+                  cl::desc("Write static gas estimates of every function "
+                           "to the given file"),
+                  cl::value_desc("filename"), cl::init(""), cl::Hidden);
+
+static cl::opt<GasReportFormat> GasReportFormatOpt(
+    "evm-gas-report-format", cl::desc("Format of the gas report"),
+    cl::values(clEnumValN(GRF_JSON, "json", "JSON (default)"),
+               clEnumValN(GRF_YAML, "yaml", "YAML")),
+    cl::init(GRF_JSON), cl::Hidden);
+
+char EVMGasEstimation::ID = 0;
+INITIALIZE_PASS_BEGIN(EVMGasEstimation, DEBUG_TYPE,
+                      "Static gas estimation for EVM", false, true)
+INITIALIZE_PASS_DEPENDENCY(MachineLoopInfo)
+INITIALIZE_PASS_DEPENDENCY(MachineOptimizationRemarkEmitterPass)
+INITIALIZE_PASS_END(EVMGasEstimation, DEBUG_TYPE,
+                    "Static gas estimation for EVM", false, true)
+
+FunctionPass *llvm::createEVMGasEstimation() {
+  return new EVMGasEstimation();
+}
+
+EVMGasEstimation::EVMGasEstimation() : MachineFunctionPass(ID) {}
+
+void EVMGasEstimation::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.setPreservesAll();
+  AU.addRequired<MachineLoopInfo>();
+  AU.addRequired<MachineOptimizationRemarkEmitterPass>();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+unsigned EVMGasEstimation::getInstrGas(const MachineInstr &MI) {
+  return EVM::getGasCost(MI.getDesc());
+}
+
+bool EVMGasEstimation::hasDynamicGas(const MachineInstr &MI) {
+  return EVM::hasDynamicGas(MI.getOpcode());
+}
+
+uint64_t EVMGasEstimation::getMemoryExpansionGas(uint64_t Words) {
+  return EVM::getMemoryExpansionGas(Words);
+}
+
+static bool isPush(unsigned Opcode) {
+  for (unsigned Size = 1; Size <= 32; ++Size)
+    if (Opcode == EVMSubtarget::get_push_opcode(Size))
+      return true;
+  return false;
+}
+
+// After stackification a call is a JUMP in the middle of a block, followed
+// by the JUMPDEST of the return address.
+static bool isSubroutineCall(const MachineInstr &MI) {
+  if (MI.getOpcode() == EVM::JUMPSUB)
+    return true;
+  return MI.getOpcode() == EVM::JUMP &&
+         std::next(MI.getIterator()) != MI.getParent()->end();
+}
+
+static std::string getBlockName(const MachineBasicBlock &MBB) {
+  return "bb." + std::to_string(MBB.getNumber());
+}
+
+uint64_t EVMGasEstimation::analyzeBlock(const MachineBasicBlock &MBB,
+                                        FunctionGas &FG) {
+  uint64_t Gas = 0;
+  const MachineInstr *Prev = nullptr;
+  for (const MachineInstr &MI : MBB) {
+    Gas += getInstrGas(MI);
+
+    if (hasDynamicGas(MI))
+      FG.HasDynamicCost = true;
+    if (isSubroutineCall(MI))
+      ++FG.Calls;
+
+    // PUSH imm; MLOAD/MSTORE accesses a known word.
+    unsigned Opc = MI.getOpcode();
+    if ((Opc == EVM::MLOAD || Opc == EVM::MSTORE) && Prev &&
+        isPush(Prev->getOpcode()) && Prev->getOperand(0).isImm()) {
+      uint64_t Addr = Prev->getOperand(0).getImm();
+      FG.MemoryWords = std::max(FG.MemoryWords, Addr / 32 + 1);
+    }
+
+    if (!MI.isDebugInstr())
+      Prev = &MI;
+  }
+  return Gas;
+}
+
+uint64_t EVMGasEstimation::getLoopIterationGas(
+    const MachineLoop &L,
+    const DenseMap<const MachineBasicBlock *, unsigned> &RPOIndex) const {
+  // Longest path from the header to a latch, without following back edges.
+  std::vector<MachineBasicBlock *> Blocks(L.block_begin(), L.block_end());
+  llvm::sort(Blocks, [&](MachineBasicBlock *A, MachineBasicBlock *B) {
+    return RPOIndex.lookup(A) < RPOIndex.lookup(B);
+  });
+
+  DenseMap<const MachineBasicBlock *, uint64_t> Dist;
+  Dist[L.getHeader()] = BlockGas.lookup(L.getHeader());
+
+  uint64_t Result = 0;
+  for (MachineBasicBlock *MBB : Blocks) {
+    auto It = Dist.find(MBB);
+    if (It == Dist.end())
+      continue;
+    uint64_t D = It->second;
+    for (MachineBasicBlock *Succ : MBB->successors()) {
+      if (Succ == L.getHeader())
+        Result = std::max(Result, D);
+      if (!L.contains(Succ) ||
+          RPOIndex.lookup(Succ) <= RPOIndex.lookup(MBB))
+        continue;
+      uint64_t &SD = Dist[Succ];
+      SD = std::max(SD, D + BlockGas.lookup(Succ));
+    }
+  }
+  return Result;
+}
+
+bool EVMGasEstimation::runOnMachineFunction(MachineFunction &MF) {
+  LLVM_DEBUG({
+    dbgs() << "********** Gas Estimation **********\n"
+           << "********** Function: " << MF.getName() << '\n';
+  });
+
+  const MachineLoopInfo &MLI = getAnalysis<MachineLoopInfo>();
+
+  BlockGas.clear();
+  Current = FunctionGas();
+  Current.Name = MF.getName();
+
+  DenseMap<const MachineBasicBlock *, unsigned> RPOIndex;
+  ReversePostOrderTraversal<MachineFunction *> RPOT(&MF);
+  unsigned Index = 0;
+  for (MachineBasicBlock *MBB : RPOT) {
+    RPOIndex[MBB] = Index++;
+    uint64_t Gas = analyzeBlock(*MBB, Current);
+    BlockGas[MBB] = Gas;
+    Current.Blocks.emplace_back(getBlockName(*MBB), Gas);
+    LLVM_DEBUG(dbgs() << getBlockName(*MBB) << ": " << Gas << " gas\n");
+  }
+
+  // Cheapest and most expensive path through the acyclic part of the CFG.
+  DenseMap<const MachineBasicBlock *, std::pair<uint64_t, uint64_t>> Path;
+  bool HasExit = false;
+  uint64_t MinGas = UINT64_MAX, MaxGas = 0, MaxAny = 0;
+  for (MachineBasicBlock *MBB : RPOT) {
+    auto It = Path.find(MBB);
+    std::pair<uint64_t, uint64_t> P =
+        It == Path.end() ? std::make_pair(BlockGas[MBB], BlockGas[MBB])
+                         : It->second;
+    MaxAny = std::max(MaxAny, P.second);
+
+    if (MBB->succ_empty()) {
+      HasExit = true;
+      MinGas = std::min(MinGas, P.first);
+      MaxGas = std::max(MaxGas, P.second);
+      continue;
+    }
+
+    for (MachineBasicBlock *Succ : MBB->successors()) {
+      if (RPOIndex.lookup(Succ) <= RPOIndex[MBB])
+        continue;
+      uint64_t SG = BlockGas[Succ];
+      auto Ins = Path.try_emplace(Succ, P.first + SG, P.second + SG);
+      if (!Ins.second) {
+        Ins.first->second.first =
+            std::min(Ins.first->second.first, P.first + SG);
+        Ins.first->second.second =
+            std::max(Ins.first->second.second, P.second + SG);
+      }
+    }
+  }
+  Current.MinGas = HasExit ? MinGas : MaxAny;
+  Current.MaxGas = HasExit ? MaxGas : MaxAny;
+
+  SmallVector<MachineLoop *, 8> Worklist(MLI.begin(), MLI.end());
+  while (!Worklist.empty()) {
+    MachineLoop *L = Worklist.pop_back_val();
+    Worklist.append(L->begin(), L->end());
+    Current.Loops.push_back({getBlockName(*L->getHeader()),
+                             L->getLoopDepth(),
+                             getLoopIterationGas(*L, RPOIndex)});
+  }
+  llvm::sort(Current.Loops, [](const LoopGas &A, const LoopGas &B) {
+    return A.Header < B.Header;
+  });
+
+  Current.MemoryGas = getMemoryExpansionGas(Current.MemoryWords);
+
+  emitRemarks(MF, MLI);
+  if (!GasReportFile.empty())
+    Report.push_back(Current);
+  return false;
+}
+
+void EVMGasEstimation::emitRemarks(MachineFunction &MF,
+                                   const MachineLoopInfo &MLI) {
+  auto &ORE = getAnalysis<MachineOptimizationRemarkEmitterPass>().getORE();
+
+  ORE.emit([&]() {
+    MachineOptimizationRemarkAnalysis R(DEBUG_TYPE, "FunctionGas",
+                                        MF.getFunction().getSubprogram(),
+                                        &MF.front());
+    R << "static gas " << ore::NV("MinGas", Current.MinGas) << " to "
+      << ore::NV("MaxGas", Current.MaxGas) << ", memory expansion "
+      << ore::NV("MemoryGas", Current.MemoryGas);
+    if (Current.Calls)
+      R << ", excluding " << ore::NV("Calls", Current.Calls) << " calls";
+    if (Current.HasDynamicCost)
+      R << ", excluding operand-dependent costs";
+    return R;
+  });
+
+  // Loops in preorder, outer loops first. Top-level loops are kept in
+  // reverse program order and subloops in program order.
+  SmallVector<const MachineLoop *, 8> Worklist(MLI.begin(), MLI.end());
+  while (!Worklist.empty()) {
+    const MachineLoop *L = Worklist.pop_back_val();
+    Worklist.append(L->getSubLoops().rbegin(), L->getSubLoops().rend());
+    ORE.emit([&]() {
+      uint64_t Gas = 0;
+      for (const LoopGas &LG : Current.Loops)
+        if (LG.Header == getBlockName(*L->getHeader()))
+          Gas = LG.GasPerIteration;
+      MachineOptimizationRemarkAnalysis R(DEBUG_TYPE, "LoopGas",
+                                          L->getStartLoc(), L->getHeader());
+      R << "loop costs " << ore::NV("GasPerIteration", Gas)
+        << " gas per iteration";
+      return R;
+    });
+  }
+}
+
+void EVMGasEstimation::writeJSON(raw_ostream &OS) const {
+  json::OStream J(OS, 2);
+  J.array([&] {
+    for (const FunctionGas &FG : Report) {
+      J.object([&] {
+        J.attribute("function", FG.Name);
+        J.attribute("min", static_cast<int64_t>(FG.MinGas));
+        J.attribute("max", static_cast<int64_t>(FG.MaxGas));
+        J.attribute("exact", FG.isExact());
+        J.attribute("memory_words", static_cast<int64_t>(FG.MemoryWords));
+        J.attribute("memory_gas", static_cast<int64_t>(FG.MemoryGas));
+        J.attribute("calls", static_cast<int64_t>(FG.Calls));
+        J.attribute("dynamic", FG.HasDynamicCost);
+        J.attributeArray("blocks", [&] {
+          for (const auto &B : FG.Blocks)
+            J.object([&] {
+              J.attribute("name", B.first);
+              J.attribute("gas", static_cast<int64_t>(B.second));
+            });
+        });
+        J.attributeArray("loops", [&] {
+          for (const LoopGas &LG : FG.Loops)
+            J.object([&] {
+              J.attribute("header", LG.Header);
+              J.attribute("depth", static_cast<int64_t>(LG.Depth));
+              J.attribute("gas_per_iteration",
+                          static_cast<int64_t>(LG.GasPerIteration));
+            });
+        });
+      });
+    }
+  });
+  OS << '\n';
+}
+
+void EVMGasEstimation::writeYAML(raw_ostream &OS) const {
+  OS << "---\n";
+  for (const FunctionGas &FG : Report) {
+    OS << "- function: " << FG.Name << '\n'
+       << "  min: " << FG.MinGas << '\n'
+       << "  max: " << FG.MaxGas << '\n'
+       << "  exact: " << (FG.isExact() ? "true" : "false") << '\n'
+       << "  memory_words: " << FG.MemoryWords << '\n'
+       << "  memory_gas: " << FG.MemoryGas << '\n'
+       << "  calls: " << FG.Calls << '\n'
+       << "  dynamic: " << (FG.HasDynamicCost ? "true" : "false") << '\n';
+    OS << "  blocks:\n";
+    for (const auto &B : FG.Blocks)
+      OS << "    - { name: " << B.first << ", gas: " << B.second << " }\n";
+    OS << "  loops:" << (FG.Loops.empty() ? " []\n" : "\n");
+    for (const LoopGas &LG : FG.Loops)
+      OS << "    - { header: " << LG.Header << ", depth: " << LG.Depth
+         << ", gas_per_iteration: " << LG.GasPerIteration << " }\n";
+  }
+  OS << "...\n";
+}
+
+bool EVMGasEstimation::doFinalization(Module &M) {
+  if (GasReportFile.empty())
+    return false;
+
+  std::error_code EC;
+  raw_fd_ostream OS(GasReportFile, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "error: cannot open gas report file '" << GasReportFile
+           << "': " << EC.message() << '\n';
+    return false;
+  }
+
+  if (GasReportFormatOpt == GRF_YAML)
+    writeYAML(OS);
+  else
+    writeJSON(OS);
+  Report.clear();
+  return false;
+}
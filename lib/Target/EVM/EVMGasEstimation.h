@@ -0,0 +1,106 @@
+//===- EVMGasEstimation.h - Static gas estimation ---------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+/// \file
+/// Static gas bounds for EVM machine functions, computed from the gas cost
+/// recorded for each instruction in the target description.
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_EVM_EVMGASESTIMATION_H
+#define LLVM_LIB_TARGET_EVM_EVMGASESTIMATION_H
+
+#include "EVM.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+class MachineBasicBlock;
+class MachineInstr;
+class MachineLoop;
+class MachineLoopInfo;
+
+class EVMGasEstimation : public MachineFunctionPass {
+public:
+  static char ID;
+
+  // Per-iteration cost of a loop. The function bound is parametric in the
+  // trip count N of each loop: MaxGas + GasPerIteration * (N - 1).
+  struct LoopGas {
+    std::string Header;
+    unsigned Depth;
+    uint64_t GasPerIteration;
+  };
+
+  struct FunctionGas {
+    std::string Name;
+    // Bounds over all acyclic paths through the function, with every loop
+    // body executed once.
+    uint64_t MinGas = 0;
+    uint64_t MaxGas = 0;
+    // Highest constant memory address touched, in 32-byte words, and the
+    // expansion cost to reach it.
+    uint64_t MemoryWords = 0;
+    uint64_t MemoryGas = 0;
+    // Number of internal calls, whose cost is not included.
+    unsigned Calls = 0;
+    // Instructions whose cost depends on operands are present.
+    bool HasDynamicCost = false;
+    std::vector<std::pair<std::string, uint64_t>> Blocks;
+    std::vector<LoopGas> Loops;
+
+    // The bounds are exact when there are no loops, no calls and no
+    // operand-dependent costs, and all paths cost the same.
+    bool isExact() const {
+      return Loops.empty() && Calls == 0 && !HasDynamicCost &&
+             MinGas == MaxGas;
+    }
+  };
+
+  EVMGasEstimation();
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  bool doFinalization(Module &M) override;
+
+  // Fixed gas cost of a single instruction.
+  static unsigned getInstrGas(const MachineInstr &MI);
+  // Whether the cost of the instruction depends on its operands.
+  static bool hasDynamicGas(const MachineInstr &MI);
+  // Gas needed to expand memory to the given number of words.
+  static uint64_t getMemoryExpansionGas(uint64_t Words);
+
+  uint64_t getBlockGas(const MachineBasicBlock *MBB) const {
+    return BlockGas.lookup(MBB);
+  }
+
+  const FunctionGas &getFunctionGas() const { return Current; }
+
+private:
+  DenseMap<const MachineBasicBlock *, uint64_t> BlockGas;
+  FunctionGas Current;
+
+  // Results of all functions in the module, written out by doFinalization.
+  std::vector<FunctionGas> Report;
+
+  uint64_t analyzeBlock(const MachineBasicBlock &MBB, FunctionGas &FG);
+  uint64_t getLoopIterationGas(const MachineLoop &L,
+                               const DenseMap<const MachineBasicBlock *,
+                                              unsigned> &RPOIndex) const;
+  void emitRemarks(MachineFunction &MF, const MachineLoopInfo &MLI);
+
+  void writeJSON(raw_ostream &OS) const;
+  void writeYAML(raw_ostream &OS) const;
+};
+
+} // end namespace llvm
+
+#endif // LLVM_LIB_TARGET_EVM_EVMGASESTIMATION_H
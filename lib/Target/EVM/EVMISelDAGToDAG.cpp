@@ -13,8 +13,12 @@
 #include "MCTargetDesc/EVMMCTargetDesc.h"
 #include "EVM.h"
 #include "EVMTargetMachine.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/BinaryFormat/EVM.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/SelectionDAGISel.h"
+#include "llvm/IR/IntrinsicsEVM.h"
+#include "llvm/IR/Module.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
@@ -39,6 +43,7 @@ public:
 
   bool runOnMachineFunction(MachineFunction &MF) override {
     Subtarget = const_cast<EVMSubtarget*>(&MF.getSubtarget<EVMSubtarget>());
+    allocateGlobalSlots(*MF.getFunction().getParent());
     return SelectionDAGISel::runOnMachineFunction(MF);
   }
 
@@ -55,16 +60,42 @@ public:
   bool SelectBlockAddress(SDNode *Node);
   bool SelectSIGNEXTEND(SDNode *Node);
   bool SelectCall(SDNode *Node);
+  bool SelectIntrinsicWOChain(SDNode *Node);
 
 // Include the pieces autogenerated from the target description.
 #include "EVMGenDAGISel.inc"
 
 private:
   void MutateReturnChain();
-  DenseMap<SDNode *, uint64_t> GlobalSlots;
+  void allocateGlobalSlots(const Module &M);
+  uint64_t allocateGlobalSlot(const GlobalValue *GV);
+  DenseMap<const GlobalValue *, uint64_t> GlobalSlots;
+  uint64_t NumGlobalSlots = 0;
 };
 }
 
+// Every global variable gets a fixed memory slot for the whole module, so
+// that all functions agree on its address and on the frame pointer location
+// that follows the global area. A global wider than a word, such as an
+// array, gets as many consecutive slots as it needs.
+void EVMDAGToDAGISel::allocateGlobalSlots(const Module &M) {
+  if (!GlobalSlots.empty())
+    return;
+
+  for (const GlobalVariable &GV : M.globals())
+    allocateGlobalSlot(&GV);
+}
+
+uint64_t EVMDAGToDAGISel::allocateGlobalSlot(const GlobalValue *GV) {
+  uint64_t offset = NumGlobalSlots * 32;
+  GlobalSlots[GV] = offset;
+  uint64_t Size =
+      GV->getParent()->getDataLayout().getTypeAllocSize(GV->getValueType());
+  NumGlobalSlots += std::max<uint64_t>(1, divideCeil(Size, 32));
+  Subtarget->updateAllocatedGlobalSlots(NumGlobalSlots);
+  return offset;
+}
+
 void EVMDAGToDAGISel::MutateReturnChain() {
   DenseMap<const Function*, SDNode*> Fn2RetAddr;
 
@@ -128,31 +159,60 @@ void EVMDAGToDAGISel::PreprocessISelDAG() {
 void EVMDAGToDAGISel::PostprocessISelDAG() {
 
 }
+// The wrapper is replaced as a whole, so the slot is pushed only once.
 bool EVMDAGToDAGISel::SelectTargetGlobalAddress(SDNode *Node) {
-  const auto *GA = cast<GlobalAddressSDNode>(Node);
+  const auto *GA = dyn_cast<GlobalAddressSDNode>(Node->getOperand(0));
+  if (!GA)
+    return false;
   if (GA->getGlobal()->getValueType()->isFunctionTy()) {
     return false;
   }
 
-  DenseMap<SDNode *, uint64_t>::iterator GSIter = GlobalSlots.find(Node);
+  const GlobalValue *GV = GA->getGlobal();
+  DenseMap<const GlobalValue *, uint64_t>::iterator GSIter =
+      GlobalSlots.find(GV);
   uint64_t offset;
   if (GSIter == GlobalSlots.end()) {
     // the first time we have encountered: allocate a new slot
-    offset = GlobalSlots.size() * 32;
-    GlobalSlots[Node] = offset;
-    Subtarget->updateAllocatedGlobalSlots(GlobalSlots.size());
+    offset = allocateGlobalSlot(GV);
   } else {
-    offset = GSIter->second; 
+    offset = GSIter->second;
   }
+  offset += GA->getOffset();
   // change GlobalAddress to the memory location offset
   SDValue mem_offset =
-      CurDAG->getConstant(offset, SDLoc(Node), MVT::i256);
+      CurDAG->getTargetConstant(offset, SDLoc(Node), MVT::i256);
   SDNode *push =
       CurDAG->getMachineNode(EVM::PUSH32_r, SDLoc(Node), MVT::i256, mem_offset);
   ReplaceNode(Node, push);
   return true;
 }
 
+// The layout of the deploy code is only known to the assembler, so these are
+// pushes of the symbols that the asm printer defines.
+bool EVMDAGToDAGISel::SelectIntrinsicWOChain(SDNode *Node) {
+  std::string Name;
+  switch (Node->getConstantOperandVal(0)) {
+  default:
+    return false;
+  case Intrinsic::evm_runtimeoffset:
+    Name = EVM::RuntimeOffsetSymbol;
+    break;
+  case Intrinsic::evm_runtimesize:
+    Name = EVM::RuntimeSizeSymbol;
+    break;
+  case Intrinsic::evm_immutableoffset:
+    Name = EVM::ImmutableSymbolPrefix + utostr(Node->getConstantOperandVal(1));
+    break;
+  }
+
+  SDValue Sym = CurDAG->getTargetExternalSymbol(
+      MF->createExternalSymbolName(Name), MVT::i256);
+  ReplaceNode(Node, CurDAG->getMachineNode(EVM::PUSH32_r, SDLoc(Node),
+                                           MVT::i256, Sym));
+  return true;
+}
+
 bool EVMDAGToDAGISel::SelectLOAD(SDNode *Node) {
   const LoadSDNode *LD = cast<LoadSDNode>(Node);
 
@@ -246,23 +306,33 @@ bool EVMDAGToDAGISel::SelectCall(SDNode *Node) {
   // construct return 
   std::vector<SDValue> opsVec;
 
+  MachineSDNode *push =
+      CurDAG->getMachineNode(EVM::PUSH32_r, SDLoc(Node), MVT::i256, target);
+  SDValue pushVal = SDValue(push, 0);
+
+  // With subroutine support JUMPSUB takes the target from the top of the
+  // stack and keeps the return address on the return stack, so the target
+  // goes first:
+  // pJUMPSUB targetAddr, arg1, arg2, ...
+  // (top) targetAddr, arg1, arg2, ...
+  if (Subtarget->hasSubroutine()) {
+    opsVec.push_back(pushVal);
+  }
 
   for (unsigned i = 2; i < Node->getNumOperands(); ++i) {
     opsVec.push_back(Node->getOperand(i));
   }
 
-  // we put the target at the back of the operands, it becomes:
+  // Otherwise we put the target at the back of the operands, it becomes:
   // pJUMPSUB arg1, arg2, arg3, ..., targetAddr
   // stack status is:
   // (top) arg1, arg2, arg3, ..., targetAddr
   // we need to have return address, which is best to be fixed in position:
   // 1. PUSH retAddr (PC + offset)
   // 2. swap retAddr and targetAddr
-  
-  MachineSDNode *push =
-      CurDAG->getMachineNode(EVM::PUSH32_r, SDLoc(Node), MVT::i256, target);
-  SDValue pushVal = SDValue(push, 0);
-  opsVec.push_back(pushVal);
+  if (!Subtarget->hasSubroutine()) {
+    opsVec.push_back(pushVal);
+  }
 
   opsVec.push_back(chain);
 
@@ -338,7 +408,7 @@ void EVMDAGToDAGISel::Select(SDNode *Node) {
       if (SelectLOAD(Node)) return;
       break;
     }
-    case ISD::TargetGlobalAddress: {
+    case EVMISD::WRAPPER: {
       if (SelectTargetGlobalAddress(Node)) return;
       break;
     }
@@ -355,6 +425,9 @@ void EVMDAGToDAGISel::Select(SDNode *Node) {
     case EVMISD::SIGNEXTEND:
       if (SelectSIGNEXTEND(Node)) return;
       break;
+    case ISD::INTRINSIC_WO_CHAIN:
+      if (SelectIntrinsicWOChain(Node)) return;
+      break;
   }
 
   SelectCode(Node);
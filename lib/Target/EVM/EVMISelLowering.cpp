@@ -157,12 +157,14 @@ bool EVMTargetLowering::isLegalAddImmediate(int64_t Imm) const {
   return true;
 }
 
+// Every integer lives in a 256-bit stack word, so narrowing is free. Loop
+// strength reduction relies on this being false for types of the same width.
 bool EVMTargetLowering::isTruncateFree(Type *SrcTy, Type *DstTy) const {
-  return true;
+  return SrcTy->getPrimitiveSizeInBits() > DstTy->getPrimitiveSizeInBits();
 }
 
 bool EVMTargetLowering::isTruncateFree(EVT SrcVT, EVT DstVT) const {
-  return true;
+  return SrcVT.getSizeInBits() > DstVT.getSizeInBits();
 }
 
 bool EVMTargetLowering::isZExtFree(SDValue Val, EVT VT2) const {
@@ -14,12 +14,15 @@
 #include "EVM.h"
 #include "EVMSubtarget.h"
 #include "EVMTargetMachine.h"
+#include "EVMUtils.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineModuleInfo.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/RegisterScavenging.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/TargetRegistry.h"
 
@@ -28,6 +31,14 @@
 
 using namespace llvm;
 
+// EIP-170 limits deployed code to 24576 bytes. Outlining makes every call of
+// an outlined sequence more expensive, so by default only modules that would
+// not fit otherwise are outlined.
+static cl::opt<unsigned> OutlineSizeThreshold(
+    "evm-outline-size-threshold", cl::Hidden, cl::init(24576),
+    cl::desc("Estimated code size in bytes above which the machine outliner "
+             "runs on EVM modules by default"));
+
 EVMInstrInfo::EVMInstrInfo()
     : EVMGenInstrInfo(EVM::ADJCALLSTACKDOWN, EVM::ADJCALLSTACKUP), RI() {
 }
@@ -189,3 +200,281 @@ unsigned EVMInstrInfo::removeBranch(MachineBasicBlock &MBB,
 
   return Count;
 }
+
+static unsigned getPushSize(unsigned Opcode) {
+  for (unsigned Size = 1; Size <= 32; ++Size)
+    if (Opcode == EVMSubtarget::get_push_opcode(Size))
+      return Size;
+  return 0;
+}
+
+static unsigned getSWAPOpcode(unsigned Depth) {
+  static const unsigned Opcodes[] = {
+      EVM::SWAP1,  EVM::SWAP2,  EVM::SWAP3,  EVM::SWAP4,
+      EVM::SWAP5,  EVM::SWAP6,  EVM::SWAP7,  EVM::SWAP8,
+      EVM::SWAP9,  EVM::SWAP10, EVM::SWAP11, EVM::SWAP12,
+      EVM::SWAP13, EVM::SWAP14, EVM::SWAP15, EVM::SWAP16};
+  assert(Depth >= 1 && Depth <= 16 && "invalid SWAP depth");
+  return Opcodes[Depth - 1];
+}
+
+// Returns the depth n of DUPn (IsSwap = false) or SWAPn (IsSwap = true), or 0
+// for any other opcode.
+static unsigned getDUPSWAPDepth(unsigned Opcode, bool IsSwap) {
+  static const unsigned DUPs[] = {
+      EVM::DUP1,  EVM::DUP2,  EVM::DUP3,  EVM::DUP4,
+      EVM::DUP5,  EVM::DUP6,  EVM::DUP7,  EVM::DUP8,
+      EVM::DUP9,  EVM::DUP10, EVM::DUP11, EVM::DUP12,
+      EVM::DUP13, EVM::DUP14, EVM::DUP15, EVM::DUP16};
+  for (unsigned N = 1; N <= 16; ++N)
+    if (Opcode == (IsSwap ? getSWAPOpcode(N) : DUPs[N - 1]))
+      return N;
+  return 0;
+}
+
+unsigned EVMInstrInfo::getInstSizeInBytes(const MachineInstr &MI) const {
+  // Emitted as a PUSH32 of a placeholder.
+  if (MI.getOpcode() == EVM::pPUSHIMMUTABLE ||
+      MI.getOpcode() == EVM::pPUSHIMMUTABLE_r)
+    return 33;
+  if (MI.isMetaInstruction() || MI.getDesc().isPseudo())
+    return 0;
+  unsigned Size = getPushSize(MI.getOpcode());
+  if (!Size)
+    return 1;
+  // Code offsets are emitted as PUSH1 and relaxed by the assembler; code
+  // under the EIP-170 limit needs at most PUSH2.
+  if (MI.getNumOperands() && !MI.getOperand(0).isImm() &&
+      !MI.getOperand(0).isCImm())
+    return 3;
+  return 1 + Size;
+}
+
+// Computes how a sequence of stackified instructions uses the stack: Depth is
+// the number of items below the sequence's own pushes that it reads or
+// swaps, and Results the number of items it leaves in their place. Returns
+// false if some instruction has an unknown stack effect.
+static bool getStackEffect(const TargetInstrInfo &TII,
+                           MachineBasicBlock::const_iterator Begin,
+                           MachineBasicBlock::const_iterator End,
+                           unsigned &Depth, unsigned &Results) {
+  int Height = 0, MaxDepth = 0;
+  for (const MachineInstr &MI : make_range(Begin, End)) {
+    if (MI.isMetaInstruction())
+      continue;
+    unsigned Opcode = MI.getOpcode();
+    int Pops = 0, Pushes = 0, Reads = 0;
+    if (getPushSize(Opcode)) {
+      Pushes = 1;
+    } else if (unsigned N = getDUPSWAPDepth(Opcode, /*IsSwap=*/false)) {
+      Reads = N;
+      Pushes = 1;
+    } else if (unsigned N = getDUPSWAPDepth(Opcode, /*IsSwap=*/true)) {
+      Reads = N + 1;
+    } else {
+      // The register form describes the operands a stack instruction pops
+      // and the results it pushes.
+      int RegOpcode = EVM::getRegisterOpcode(Opcode);
+      if (RegOpcode == -1)
+        return false;
+      const MCInstrDesc &Desc = TII.get(RegOpcode);
+      if (Desc.isVariadic())
+        return false;
+      for (unsigned I = Desc.getNumDefs(), E = Desc.getNumOperands(); I != E;
+           ++I)
+        if (Desc.OpInfo[I].RegClass != -1)
+          ++Pops;
+      Pushes = Desc.getNumDefs();
+      Reads = Pops;
+    }
+    MaxDepth = std::max(MaxDepth, Reads - Height);
+    Height += Pushes - Pops;
+  }
+  Depth = MaxDepth;
+  Results = MaxDepth + Height;
+  return true;
+}
+
+// Without subroutines an outlined sequence is entered like a function: the
+// return address is passed below the sequence's stack operands and the stub
+// swaps it back to the top to JUMP there. With subroutines the return
+// address lives on the return stack.
+enum MachineOutlinerClass { MachineOutlinerJump, MachineOutlinerSubroutine };
+
+// Each SWAP of the return address handles one more stack item.
+static const unsigned MaxOutlinedStackItems = 16;
+
+bool EVMInstrInfo::isFunctionSafeToOutlineFrom(
+    MachineFunction &MF, bool OutlineFromLinkOnceODRs) const {
+  const Function &F = MF.getFunction();
+  if (!OutlineFromLinkOnceODRs && F.hasLinkOnceODRLinkage())
+    return false;
+  // Sections are placed by the user; outlined code lives in .text.
+  return !F.hasSection();
+}
+
+bool EVMInstrInfo::shouldOutlineFromFunctionByDefault(
+    MachineFunction &MF) const {
+  // Estimate the size of the whole contract; every function is compiled by
+  // the time the outliner runs.
+  MachineModuleInfo &MMI = MF.getMMI();
+  uint64_t Size = 0;
+  for (const Function &F : *MMI.getModule())
+    if (const MachineFunction *FMF = MMI.getMachineFunction(F))
+      for (const MachineBasicBlock &MBB : *FMF)
+        for (const MachineInstr &MI : MBB)
+          Size += getInstSizeInBytes(MI);
+  return Size > OutlineSizeThreshold;
+}
+
+outliner::OutlinedFunction EVMInstrInfo::getOutliningCandidateInfo(
+    std::vector<outliner::Candidate> &RepeatedSequenceLocs) const {
+  outliner::Candidate &FirstCand = RepeatedSequenceLocs[0];
+  unsigned SequenceSize = 0;
+  for (const MachineInstr &MI :
+       make_range(FirstCand.front(), std::next(FirstCand.back())))
+    SequenceSize += getInstSizeInBytes(MI);
+
+  unsigned Depth, Results;
+  if (!getStackEffect(*this, FirstCand.front(), std::next(FirstCand.back()),
+                      Depth, Results))
+    return outliner::OutlinedFunction();
+
+  if (FirstCand.getMF()->getSubtarget<EVMSubtarget>().hasSubroutine()) {
+    // PUSH stub; JUMPSUB  /  BEGINSUB ... RETURNSUB
+    for (outliner::Candidate &C : RepeatedSequenceLocs)
+      C.setCallInfo(MachineOutlinerSubroutine, 3 + 1);
+    return outliner::OutlinedFunction(RepeatedSequenceLocs, SequenceSize, 2,
+                                      MachineOutlinerSubroutine);
+  }
+
+  if (Depth > MaxOutlinedStackItems || Results > MaxOutlinedStackItems)
+    return outliner::OutlinedFunction();
+  // PUSH ret; SWAP x Depth; PUSH stub; JUMP; JUMPDEST  /
+  // JUMPDEST ... SWAP x Results; JUMP
+  for (outliner::Candidate &C : RepeatedSequenceLocs)
+    C.setCallInfo(MachineOutlinerJump, 3 + Depth + 3 + 1 + 1);
+  return outliner::OutlinedFunction(RepeatedSequenceLocs, SequenceSize,
+                                    1 + Results + 1, MachineOutlinerJump);
+}
+
+outliner::InstrType
+EVMInstrInfo::getOutliningType(MachineBasicBlock::iterator &MIT,
+                               unsigned Flags) const {
+  MachineInstr &MI = *MIT;
+  if (MI.isDebugInstr() || MI.isKill() || MI.isCFIInstruction())
+    return outliner::InstrType::Invisible;
+
+  // Control flow, and anything that knows where it is in the code.
+  if (MI.isTerminator() || MI.isCall() || MI.isReturn() ||
+      MI.getDesc().isPseudo() || MI.getPreInstrSymbol() ||
+      MI.getPostInstrSymbol())
+    return outliner::InstrType::Illegal;
+  switch (MI.getOpcode()) {
+  case EVM::JUMPDEST:
+  case EVM::BEGINSUB:
+  case EVM::RETURNSUB:
+  case EVM::GETPC:
+  case EVM::STOP:
+  case EVM::RETURN:
+  case EVM::REVERT:
+  case EVM::INVALID:
+  case EVM::SELFDESTRUCT:
+    return outliner::InstrType::Illegal;
+  default:
+    break;
+  }
+
+  // Only stackified code is outlined.
+  for (const MachineOperand &MO : MI.operands())
+    if (MO.isReg() || MO.isFI())
+      return outliner::InstrType::Illegal;
+
+  unsigned Depth, Results;
+  if (!getStackEffect(*this, MIT, std::next(MIT), Depth, Results))
+    return outliner::InstrType::Illegal;
+  return outliner::InstrType::Legal;
+}
+
+void EVMInstrInfo::buildOutlinedFrame(
+    MachineBasicBlock &MBB, MachineFunction &MF,
+    const outliner::OutlinedFunction &OF) const {
+  // None of the EVM pre-emit passes run on outlined functions, so the stub
+  // gets its entry and return here.
+  if (OF.FrameConstructionID == MachineOutlinerSubroutine) {
+    BuildMI(MBB, MBB.begin(), DebugLoc(), get(EVM::BEGINSUB));
+    BuildMI(MBB, MBB.end(), DebugLoc(), get(EVM::RETURNSUB));
+    return;
+  }
+
+  unsigned Depth, Results;
+  bool Known = getStackEffect(*this, MBB.begin(), MBB.end(), Depth, Results);
+  assert(Known && "outlined an instruction with unknown stack effect");
+  (void)Known;
+
+  BuildMI(MBB, MBB.begin(), DebugLoc(), get(EVM::JUMPDEST));
+  // Bring the return address up through the results, keeping their order.
+  for (unsigned N = 1; N <= Results; ++N)
+    BuildMI(MBB, MBB.end(), DebugLoc(), get(getSWAPOpcode(N)));
+  BuildMI(MBB, MBB.end(), DebugLoc(), get(EVM::JUMP));
+}
+
+MachineBasicBlock::iterator EVMInstrInfo::insertOutlinedCall(
+    Module &M, MachineBasicBlock &MBB, MachineBasicBlock::iterator &It,
+    MachineFunction &MF, const outliner::Candidate &C) const {
+  const DebugLoc DL;
+  const Function &Stub = MF.getFunction();
+
+  if (C.CallConstructionID == MachineOutlinerSubroutine) {
+    BuildMI(MBB, It, DL, get(EVM::PUSH1)).addGlobalAddress(&Stub);
+    It = BuildMI(MBB, It, DL, get(EVM::JUMPSUB)).getInstr();
+    return It;
+  }
+
+  // The candidate's range is still in place; it is erased after the call.
+  auto &Cand = const_cast<outliner::Candidate &>(C);
+  unsigned Depth, Results;
+  bool Known = getStackEffect(*this, Cand.front(), std::next(Cand.back()),
+                              Depth, Results);
+  assert(Known && "outlined an instruction with unknown stack effect");
+  (void)Known;
+
+  // Push the return address and sink it below the stub's operands.
+  MachineFunction &CallerMF = *MBB.getParent();
+  MCSymbol *RetSym = CallerMF.getContext().createTempSymbol();
+  BuildMI(MBB, It, DL, get(EVM::PUSH1)).addSym(RetSym);
+  for (unsigned N = Depth; N >= 1; --N)
+    BuildMI(MBB, It, DL, get(getSWAPOpcode(N)));
+  BuildMI(MBB, It, DL, get(EVM::PUSH1)).addGlobalAddress(&Stub);
+  MachineInstr *Call = BuildMI(MBB, It, DL, get(EVM::JUMP));
+  Call->setAsmPrinterFlag(EVM::BuildCommentFlags(EVM::SUBROUTINE_BEGIN, 0));
+
+  // The outliner erases the sequence after It, so It ends on the last
+  // instruction of the call.
+  It = BuildMI(MBB, It, DL, get(EVM::JUMPDEST)).getInstr();
+  It->setPreInstrSymbol(CallerMF, RetSym);
+  return Call;
+}
+
+bool EVM::isHalt(const MachineInstr &MI) {
+  switch (MI.getOpcode()) {
+  case EVM::STOP:
+  case EVM::STOP_r:
+  case EVM::RETURN:
+  case EVM::RETURN_r:
+  case EVM::REVERT:
+  case EVM::REVERT_r:
+  case EVM::INVALID:
+  case EVM::INVALID_r:
+  case EVM::SELFDESTRUCT:
+  case EVM::SELFDESTRUCT_r:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool EVM::endsInHalt(const MachineBasicBlock &MBB) {
+  auto Last = MBB.getLastNonDebugInstr();
+  return MBB.succ_empty() && Last != MBB.end() && isHalt(*Last);
+}
@@ -78,6 +78,24 @@ public:
                    const DebugLoc &DL, MCRegister DestReg, MCRegister SrcReg,
                    bool KillSrc) const override;
 
+  unsigned getInstSizeInBytes(const MachineInstr &MI) const override;
+
+  // Machine outliner. It runs on stackified code, so a sequence is outlined
+  // into a stub that is entered with JUMP, or JUMPSUB with subroutines.
+  bool isFunctionSafeToOutlineFrom(MachineFunction &MF,
+                                   bool OutlineFromLinkOnceODRs) const override;
+  bool shouldOutlineFromFunctionByDefault(MachineFunction &MF) const override;
+  outliner::OutlinedFunction getOutliningCandidateInfo(
+      std::vector<outliner::Candidate> &RepeatedSequenceLocs) const override;
+  outliner::InstrType getOutliningType(MachineBasicBlock::iterator &MIT,
+                                       unsigned Flags) const override;
+  void buildOutlinedFrame(MachineBasicBlock &MBB, MachineFunction &MF,
+                          const outliner::OutlinedFunction &OF) const override;
+  MachineBasicBlock::iterator
+  insertOutlinedCall(Module &M, MachineBasicBlock &MBB,
+                     MachineBasicBlock::iterator &It, MachineFunction &MF,
+                     const outliner::Candidate &C) const override;
+
 private:
   void expandJUMPSUB(MachineInstr &MI) const;
   void expandRETURNSUB(MachineInstr &MI) const;
@@ -92,6 +110,13 @@ private:
 namespace EVM {
   LLVM_READONLY
   int getStackOpcode(uint16_t Opcode);
+
+  LLVM_READONLY
+  int getRegisterOpcode(uint16_t Opcode);
+
+  // Whether MI ends the execution, which discards the stack.
+  bool isHalt(const MachineInstr &MI);
+  bool endsInHalt(const MachineBasicBlock &MBB);
 };
 
 }
@@ -0,0 +1,219 @@
+//===-- EVMInstrProfiling.cpp - Keep PGO counters in memory ----*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Lowers the counters placed by the IR PGO instrumentation for a contract,
+/// which has no runtime library and no file system to write a profile to:
+///
+/// 1. The counters of all functions share one global array, which gets its
+///    own memory slots after the other globals. Each increment is a load, an
+///    add and a store of its slot.
+/// 2. Before the contract halts through RETURN, STOP or SELFDESTRUCT, or
+///    returns from an entry function, the array is logged with the topic
+///    EVM::ProfileLogTopic. A reverted call discards its log and counts.
+/// 3. The name, hash and offset of the counters of each function are
+///    written to a JSON map, which llvm-evm-run reads to turn the logged
+///    counters into a .profdata file for -evm-profile-use.
+///
+/// Value profiling is dropped.
+///
+//===----------------------------------------------------------------------===//
+
+#include "EVM.h"
+#include "EVMSubtarget.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/BinaryFormat/EVM.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/IntrinsicsEVM.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "evm-instr-profiling"
+
+STATISTIC(NumCounters, "Number of profile counters kept in memory");
+STATISTIC(NumFlushes, "Number of places that log the profile counters");
+
+namespace {
+
+class EVMInstrProfiling final : public ModulePass {
+public:
+  static char ID; // Pass identification, replacement for typeid
+  EVMInstrProfiling(StringRef MapFile = "")
+      : ModulePass(ID), MapFile(MapFile) {}
+
+  StringRef getPassName() const override { return "EVM instr profiling"; }
+
+  bool runOnModule(Module &M) override;
+
+private:
+  struct FunctionCounters {
+    std::string Name;
+    uint64_t Hash;
+    unsigned Offset;
+    unsigned Num;
+  };
+
+  void emitFlush(Instruction *Before, GlobalVariable *Counters, unsigned Num);
+  void writeMap(raw_ostream &OS, unsigned Num) const;
+
+  std::string MapFile;
+  std::vector<FunctionCounters> Functions;
+};
+} // end anonymous namespace
+
+char EVMInstrProfiling::ID = 0;
+INITIALIZE_PASS(EVMInstrProfiling, DEBUG_TYPE,
+                "Keep EVM profile counters in memory", false, false)
+
+ModulePass *llvm::createEVMInstrProfiling(StringRef MapFile) {
+  return new EVMInstrProfiling(MapFile);
+}
+
+static bool isHalt(const Instruction &I) {
+  if (isa<ReturnInst>(I))
+    return EVMSubtarget::isMainFunction(*I.getFunction());
+  const auto *II = dyn_cast<IntrinsicInst>(&I);
+  if (!II)
+    return false;
+  switch (II->getIntrinsicID()) {
+  case Intrinsic::evm_return:
+  case Intrinsic::evm_stop:
+  case Intrinsic::evm_selfdestruct:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void EVMInstrProfiling::emitFlush(Instruction *Before,
+                                  GlobalVariable *Counters, unsigned Num) {
+  IRBuilder<> Builder(Before);
+  Type *WordTy = Builder.getIntNTy(256);
+  StringRef Topic(EVM::ProfileLogTopic);
+  APInt TopicValue(256, 0);
+  for (char C : Topic)
+    TopicValue = TopicValue.shl(8) | static_cast<uint8_t>(C);
+
+  Module *M = Before->getModule();
+  Builder.CreateCall(
+      Intrinsic::getDeclaration(M, Intrinsic::evm_log1),
+      {Builder.CreatePtrToInt(Counters, WordTy),
+       ConstantInt::get(WordTy, Num * 32), ConstantInt::get(WordTy, TopicValue)});
+  ++NumFlushes;
+}
+
+bool EVMInstrProfiling::runOnModule(Module &M) {
+  Functions.clear();
+
+  // Give the counters of each function, named by its name variable, a
+  // range of the array.
+  DenseMap<GlobalVariable *, unsigned> Offsets;
+  SmallVector<InstrProfIncrementInst *, 32> Increments;
+  SmallVector<Instruction *, 8> ValueProfiles;
+  unsigned Num = 0;
+  for (Function &F : M)
+    for (BasicBlock &BB : F)
+      for (Instruction &I : BB) {
+        if (isa<InstrProfValueProfileInst>(I)) {
+          ValueProfiles.push_back(&I);
+          continue;
+        }
+        auto *Inc = dyn_cast<InstrProfIncrementInst>(&I);
+        if (!Inc)
+          continue;
+        Increments.push_back(Inc);
+        GlobalVariable *NameVar = Inc->getName();
+        if (Offsets.count(NameVar))
+          continue;
+        unsigned N = Inc->getNumCounters()->getZExtValue();
+        Offsets[NameVar] = Num;
+        Functions.push_back({getPGOFuncNameVarInitializer(NameVar).str(),
+                             Inc->getHash()->getZExtValue(), Num, N});
+        Num += N;
+      }
+
+  for (Instruction *I : ValueProfiles)
+    I->eraseFromParent();
+  if (Increments.empty())
+    return !ValueProfiles.empty();
+  NumCounters += Num;
+
+  Type *WordTy = Type::getIntNTy(M.getContext(), 256);
+  ArrayType *ArrayTy = ArrayType::get(WordTy, Num);
+  auto *Counters = new GlobalVariable(M, ArrayTy, false,
+                                      GlobalValue::InternalLinkage,
+                                      ConstantAggregateZero::get(ArrayTy),
+                                      "evm.profile.counters");
+
+  for (InstrProfIncrementInst *Inc : Increments) {
+    unsigned Index = Offsets[Inc->getName()] + Inc->getIndex()->getZExtValue();
+    IRBuilder<> Builder(Inc);
+    Value *Slot = Builder.CreateConstInBoundsGEP2_64(Counters, 0, Index);
+    Value *Count = Builder.CreateLoad(WordTy, Slot);
+    Value *Step = ConstantInt::get(WordTy, 1);
+    if (auto *IncStep = dyn_cast<InstrProfIncrementInstStep>(Inc))
+      Step = Builder.CreateZExt(IncStep->getStep(), WordTy);
+    Builder.CreateStore(Builder.CreateAdd(Count, Step), Slot);
+    Inc->eraseFromParent();
+  }
+
+  // The name variables were only used by the increments.
+  for (GlobalVariable &GV : make_early_inc_range(M.globals()))
+    if ((GV.getName().startswith(getInstrProfNameVarPrefix()) ||
+         GV.getName() == INSTR_PROF_QUOTE(INSTR_PROF_RAW_VERSION_VAR)) &&
+        GV.use_empty())
+      GV.eraseFromParent();
+
+  SmallVector<Instruction *, 8> Halts;
+  for (Function &F : M)
+    for (BasicBlock &BB : F)
+      for (Instruction &I : BB)
+        if (isHalt(I))
+          Halts.push_back(&I);
+  for (Instruction *I : Halts)
+    emitFlush(I, Counters, Num);
+
+  if (!MapFile.empty()) {
+    std::error_code EC;
+    raw_fd_ostream OS(MapFile, EC, sys::fs::OF_Text);
+    if (EC)
+      errs() << "error: cannot open profile map file '" << MapFile
+             << "': " << EC.message() << '\n';
+    else
+      writeMap(OS, Num);
+  }
+  return true;
+}
+
+void EVMInstrProfiling::writeMap(raw_ostream &OS, unsigned Num) const {
+  json::OStream J(OS, 2);
+  J.object([&] {
+    J.attribute("counters", static_cast<int64_t>(Num));
+    J.attributeArray("functions", [&] {
+      for (const FunctionCounters &F : Functions)
+        J.object([&] {
+          J.attribute("name", F.Name);
+          // JSON numbers do not hold every 64-bit hash.
+          J.attribute("hash", utohexstr(F.Hash));
+          J.attribute("offset", static_cast<int64_t>(F.Offset));
+          J.attribute("counters", static_cast<int64_t>(F.Num));
+        });
+    });
+  });
+  OS << '\n';
+}
@@ -66,6 +66,12 @@ void EVMMCInstLower::Lower(const MachineInstr *MI, MCInst &OutMI) const {
               MCSymbolRefExpr::create(MO.getMBB()->getSymbol(), Ctx));
           break;
         }
+      case MachineOperand::MO_MCSymbol:
+        {
+          MCOp = MCOperand::createExpr(
+              MCSymbolRefExpr::create(MO.getMCSymbol(), Ctx));
+          break;
+        }
       case MachineOperand::MO_Register:
         {
           MCOp = MCOperand::createReg(MO.getReg());
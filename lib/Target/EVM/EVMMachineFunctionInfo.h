@@ -44,6 +44,10 @@ private:
 
   unsigned FrameIndexSize;
 
+  /// Slot index at which the frame pointer is saved on each call; the frame
+  /// of the callee starts at the next slot. See EVMMemoryPlan.
+  DenseMap<const MachineInstr *, unsigned> CallFrameIndex;
+
 public:
   EVMMachineFunctionInfo(MachineFunction &MF)
     : MF(MF), memoryFrameSize(0), FrameIndexSize(0)
@@ -111,6 +115,18 @@ public:
     return memoryFrameSize + reservedSize / 32;
   }
 
+  void setCallFrameIndex(const MachineInstr &Call, unsigned Index) {
+    CallFrameIndex[&Call] = Index;
+  }
+
+  /// Without a plan for the call, the callee frame goes above all the slots
+  /// of this function.
+  unsigned getCallFrameIndex(const MachineInstr &Call) const {
+    auto I = CallFrameIndex.find(&Call);
+    if (I != CallFrameIndex.end())
+      return I->second;
+    return getNumAllocatedIndexInFunction() + 1;
+  }
 
 };
 
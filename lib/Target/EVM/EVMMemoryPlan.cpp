@@ -0,0 +1,300 @@
+//===-- EVMMemoryPlan.cpp - Plan the memory used by frames ------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Memory expansion costs gas quadratically in the highest address touched,
+/// so this pass keeps the frames as low as it can:
+///
+/// 1. The frame of a main function is at the frame base, above the globals
+///    and the frame and stack pointers. It never moves, so the expansions of
+///    frame accesses in main use the constant address.
+/// 2. The frame of a callee starts right above the slots of the caller that
+///    are read after the call, instead of above all of them. A slot is live
+///    from a PUTLOCAL to the last GETLOCAL reading the value. Frame objects
+///    may be reached through pointers and are always kept.
+/// 3. The frame sizes and call offsets of all functions give the peak memory
+///    use of each entry point, which is written to a JSON report when
+///    -evm-memory-report is given.
+///
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/EVMMCTargetDesc.h"
+#include "EVM.h"
+#include "EVMMachineFunctionInfo.h"
+#include "EVMSubtarget.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "evm-memory-plan"
+
+STATISTIC(NumLoweredFrames, "Number of calls whose callee frame was lowered");
+
+static cl::opt<std::string>
+    MemoryReportFile("evm-memory-report",
+                     cl::desc("Write the frame sizes and the peak memory use "
+                              "of every entry point to the given file"),
+                     cl::value_desc("filename"), cl::init(""), cl::Hidden);
+
+namespace {
+class EVMMemoryPlan final : public MachineFunctionPass {
+public:
+  static char ID; // Pass identification, replacement for typeid
+  EVMMemoryPlan() : MachineFunctionPass(ID) {}
+
+  StringRef getPassName() const override { return "EVM memory plan"; }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesCFG();
+    MachineFunctionPass::getAnalysisUsage(AU);
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  bool doFinalization(Module &M) override;
+
+private:
+  struct FunctionFrame {
+    // Words of the frame, not counting the frames of callees.
+    unsigned Words = 0;
+    bool IsEntry = false;
+    // Each call, with the word at which the callee frame starts. An empty
+    // callee name stands for an unknown callee.
+    std::vector<std::pair<std::string, unsigned>> Calls;
+  };
+
+  void planCallFrames(MachineFunction &MF, FunctionFrame &Frame);
+  // Returns false if the peak is unbounded, through recursion or an unknown
+  // callee.
+  bool getPeakWords(StringRef Name, StringMap<unsigned> &Peaks,
+                    StringMap<bool> &Visiting, unsigned &Peak) const;
+  void writeJSON(raw_ostream &OS) const;
+
+  StringMap<FunctionFrame> Frames;
+  std::vector<std::string> Order;
+  unsigned FrameBase = 0;
+};
+} // end anonymous namespace
+
+char EVMMemoryPlan::ID = 0;
+INITIALIZE_PASS(EVMMemoryPlan, DEBUG_TYPE,
+                "Plan the memory used by EVM frames", false, false)
+
+FunctionPass *llvm::createEVMMemoryPlan() { return new EVMMemoryPlan(); }
+
+static bool isLocalAccess(const MachineInstr &MI) {
+  return MI.getOpcode() == EVM::pGETLOCAL_r ||
+         MI.getOpcode() == EVM::pPUTLOCAL_r;
+}
+
+static bool isCall(const MachineInstr &MI) {
+  return MI.getOpcode() == EVM::pJUMPSUB_r ||
+         MI.getOpcode() == EVM::pJUMPSUBVOID_r;
+}
+
+static const Function *getPushedFunction(const MachineInstr *Def) {
+  if (!Def || Def->getOpcode() != EVM::PUSH32_r ||
+      !Def->getOperand(1).isGlobal())
+    return nullptr;
+  return dyn_cast<Function>(Def->getOperand(1).getGlobal());
+}
+
+// The callee is pushed last by a PUSH32_r of the function, see SelectCall.
+// The push may have been moved through a slot, which is then only written
+// with that function.
+static const Function *getCallee(const MachineInstr &MI,
+                                 const MachineRegisterInfo &MRI) {
+  const MachineOperand &MO = MI.getOperand(MI.getNumOperands() - 1);
+  if (!MO.isReg() || !Register::isVirtualRegister(MO.getReg()))
+    return nullptr;
+  const MachineInstr *Def = MRI.getUniqueVRegDef(MO.getReg());
+  if (!Def || Def->getOpcode() != EVM::pGETLOCAL_r)
+    return getPushedFunction(Def);
+
+  const Function *Callee = nullptr;
+  for (const MachineBasicBlock &MBB : *MI.getMF())
+    for (const MachineInstr &Put : MBB) {
+      if (Put.getOpcode() != EVM::pPUTLOCAL_r ||
+          Put.getOperand(1).getImm() != Def->getOperand(1).getImm())
+        continue;
+      const Function *F =
+          getPushedFunction(MRI.getUniqueVRegDef(Put.getOperand(0).getReg()));
+      if (!F || (Callee && Callee != F))
+        return nullptr;
+      Callee = F;
+    }
+  return Callee;
+}
+
+void EVMMemoryPlan::planCallFrames(MachineFunction &MF, FunctionFrame &Frame) {
+  EVMMachineFunctionInfo *MFI = MF.getInfo<EVMMachineFunctionInfo>();
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+
+  // Slots are numbered above the frame objects, as in expandLOCAL.
+  unsigned ObjectWords = MF.getFrameInfo().getStackSize() / 32;
+  unsigned NumSlots = 0;
+  for (const MachineBasicBlock &MBB : MF)
+    for (const MachineInstr &MI : MBB)
+      if (isLocalAccess(MI))
+        NumSlots = std::max<unsigned>(NumSlots, MI.getOperand(1).getImm() + 1);
+  Frame.Words = ObjectWords + NumSlots;
+
+  // Backward liveness of the slots, by block.
+  DenseMap<const MachineBasicBlock *, BitVector> LiveIn;
+  auto transfer = [](const MachineInstr &MI, BitVector &Live) {
+    if (MI.getOpcode() == EVM::pPUTLOCAL_r)
+      Live.reset(MI.getOperand(1).getImm());
+    else if (MI.getOpcode() == EVM::pGETLOCAL_r)
+      Live.set(MI.getOperand(1).getImm());
+  };
+  auto getLiveOut = [&](const MachineBasicBlock &MBB) {
+    BitVector Live(NumSlots);
+    for (const MachineBasicBlock *Succ : MBB.successors()) {
+      auto I = LiveIn.find(Succ);
+      if (I != LiveIn.end())
+        Live |= I->second;
+    }
+    return Live;
+  };
+
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (const MachineBasicBlock *MBB : post_order(&MF)) {
+      BitVector Live = getLiveOut(*MBB);
+      for (const MachineInstr &MI : llvm::reverse(*MBB))
+        transfer(MI, Live);
+      BitVector &In = LiveIn[MBB];
+      if (In.size() != NumSlots || In != Live) {
+        In = Live;
+        Changed = true;
+      }
+    }
+  }
+
+  for (MachineBasicBlock &MBB : MF) {
+    BitVector Live = getLiveOut(MBB);
+    for (MachineInstr &MI : llvm::reverse(MBB)) {
+      if (isCall(MI)) {
+        int Last = Live.find_last();
+        unsigned Index = ObjectWords + (Last < 0 ? 0 : Last + 1);
+        if (Index < MFI->getNumAllocatedIndexInFunction() + 1)
+          ++NumLoweredFrames;
+        MFI->setCallFrameIndex(MI, Index);
+
+        const Function *Callee = getCallee(MI, MRI);
+        Frame.Calls.emplace_back(Callee ? Callee->getName().str() : "",
+                                 Index + 1);
+        LLVM_DEBUG(dbgs() << "Call to "
+                          << (Callee ? Callee->getName() : "<unknown>")
+                          << " saves the frame pointer at slot " << Index
+                          << "\n");
+      }
+      transfer(MI, Live);
+    }
+  }
+}
+
+bool EVMMemoryPlan::runOnMachineFunction(MachineFunction &MF) {
+  LLVM_DEBUG({
+    dbgs() << "********** Memory plan **********\n"
+           << "********** Function: " << MF.getName() << '\n';
+  });
+
+  FrameBase = MF.getSubtarget<EVMSubtarget>().getFrameBase();
+
+  FunctionFrame Frame;
+  Frame.IsEntry = EVMSubtarget::isMainFunction(MF.getFunction());
+  planCallFrames(MF, Frame);
+
+  if (!MemoryReportFile.empty()) {
+    Order.push_back(MF.getName().str());
+    Frames[MF.getName()] = std::move(Frame);
+  }
+  return false;
+}
+
+bool EVMMemoryPlan::getPeakWords(StringRef Name, StringMap<unsigned> &Peaks,
+                                 StringMap<bool> &Visiting,
+                                 unsigned &Peak) const {
+  auto Known = Peaks.find(Name);
+  if (Known != Peaks.end()) {
+    Peak = Known->second;
+    return true;
+  }
+  auto F = Frames.find(Name);
+  if (F == Frames.end() || Visiting[Name])
+    return false;
+
+  Visiting[Name] = true;
+  Peak = F->second.Words;
+  for (const auto &Call : F->second.Calls) {
+    unsigned CalleePeak;
+    if (Call.first.empty() ||
+        !getPeakWords(Call.first, Peaks, Visiting, CalleePeak))
+      return false;
+    Peak = std::max(Peak, Call.second + CalleePeak);
+  }
+  Visiting[Name] = false;
+  Peaks[Name] = Peak;
+  return true;
+}
+
+void EVMMemoryPlan::writeJSON(raw_ostream &OS) const {
+  StringMap<unsigned> Peaks;
+  json::OStream J(OS, 2);
+  J.array([&] {
+    for (const std::string &Name : Order) {
+      const FunctionFrame &Frame = Frames.lookup(Name);
+      StringMap<bool> Visiting;
+      unsigned Peak;
+      bool Bounded = getPeakWords(Name, Peaks, Visiting, Peak);
+      J.object([&] {
+        J.attribute("function", Name);
+        J.attribute("entry", Frame.IsEntry);
+        J.attribute("frame_words", static_cast<int64_t>(Frame.Words));
+        J.attribute("calls", static_cast<int64_t>(Frame.Calls.size()));
+        // Entry points report the end of the memory their frames use; other
+        // functions the words they need above their frame pointer. An
+        // unbounded peak is null.
+        json::Value Value = nullptr;
+        if (Bounded)
+          Value = static_cast<int64_t>(Frame.IsEntry ? FrameBase + Peak * 32
+                                                     : Peak);
+        J.attribute(Frame.IsEntry ? "peak_bytes" : "peak_words", Value);
+      });
+    }
+  });
+  OS << '\n';
+}
+
+bool EVMMemoryPlan::doFinalization(Module &M) {
+  if (MemoryReportFile.empty())
+    return false;
+
+  std::error_code EC;
+  raw_fd_ostream OS(MemoryReportFile, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "error: cannot open memory report file '" << MemoryReportFile
+           << "': " << EC.message() << '\n';
+    return false;
+  }
+
+  writeJSON(OS);
+  Frames.clear();
+  Order.clear();
+  return false;
+}
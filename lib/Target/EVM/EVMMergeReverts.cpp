@@ -0,0 +1,309 @@
+//===-- EVMMergeReverts.cpp - Share constant revert blocks ----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This pass shares the blocks that end a failed check. Such a block stages
+/// a constant error payload in memory with MSTOREs and REVERTs with it; every
+/// check gets its own copy, so the same payload is repeated all over a
+/// contract.
+///
+/// 1. Revert blocks are hashed by their payload. Within a function, blocks
+///    with the same payload are merged into one.
+/// 2. A payload reverted with from several functions, and large enough to pay
+///    for a call, is moved into a shared noreturn stub that each of them
+///    calls.
+/// 3. Revert blocks are cold: the conditional branches into them get branch
+///    weights that keep the happy path on the JUMPI fall-through, and the
+///    blocks are moved to the end of their function.
+///
+//===----------------------------------------------------------------------===//
+
+#include "EVM.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/IntrinsicsEVM.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "evm-merge-reverts"
+
+STATISTIC(NumMergedReverts, "Number of revert blocks merged");
+STATISTIC(NumRevertStubs, "Number of shared revert stubs created");
+STATISTIC(NumColdBranches, "Number of branches into reverts weighted cold");
+
+static cl::opt<bool>
+DisableRevertMerging("evm-disable-revert-merging", cl::init(false),
+                     cl::Hidden,
+                     cl::desc("Do not merge and outline revert blocks"));
+
+// A call costs about 45 bytes of code, most of it saving and restoring the
+// frame pointer.
+static cl::opt<unsigned> SharedRevertThreshold(
+    "evm-shared-revert-threshold", cl::init(64), cl::Hidden,
+    cl::desc("Estimated payload size in bytes above which a revert used by "
+             "several functions moves into a shared stub"));
+
+namespace {
+
+class EVMMergeReverts final : public ModulePass {
+public:
+  static char ID; // Pass identification, replacement for typeid
+  EVMMergeReverts() : ModulePass(ID) {}
+
+  StringRef getPassName() const override {
+    return "EVM merge revert blocks";
+  }
+
+  bool runOnModule(Module &M) override;
+
+private:
+  // Branch weights of the edge into a revert block and of the other edge.
+  static const uint32_t ColdWeight = 1;
+  static const uint32_t HotWeight = 2000;
+
+  bool mergeInFunction(Function &F);
+  bool shareAcrossFunctions(Module &M);
+  bool markCold(Function &F);
+
+  // Revert blocks of the module, bucketed by payload hash. After merging
+  // there is at most one block per payload and function.
+  MapVector<unsigned, SmallVector<BasicBlock *, 4>> Buckets;
+  SmallPtrSet<const BasicBlock *, 16> RevertBlocks;
+};
+} // end anonymous namespace
+
+char EVMMergeReverts::ID = 0;
+INITIALIZE_PASS(EVMMergeReverts, DEBUG_TYPE,
+                "Share EVM revert blocks with constant payloads", false,
+                false)
+
+ModulePass *llvm::createEVMMergeReverts() {
+  return new EVMMergeReverts();
+}
+
+static bool isPayloadIntrinsic(Intrinsic::ID ID) {
+  return ID == Intrinsic::evm_mstore || ID == Intrinsic::evm_mstore8 ||
+         ID == Intrinsic::evm_revert;
+}
+
+static bool hasConstantOperands(const IntrinsicInst &II) {
+  for (const Use &U : II.arg_operands())
+    if (!isa<ConstantInt>(U))
+      return false;
+  return true;
+}
+
+// A revert block only writes constants to memory, then reverts with a
+// constant range.
+static bool isRevertBlock(const BasicBlock &BB) {
+  if (!isa<UnreachableInst>(BB.getTerminator()) || isa<PHINode>(BB.front()))
+    return false;
+  const Instruction *Last = BB.getTerminator()->getPrevNode();
+  const auto *Revert = dyn_cast_or_null<IntrinsicInst>(Last);
+  if (!Revert || Revert->getIntrinsicID() != Intrinsic::evm_revert)
+    return false;
+
+  for (const Instruction &I : BB) {
+    if (I.isTerminator() || isa<DbgInfoIntrinsic>(I))
+      continue;
+    const auto *II = dyn_cast<IntrinsicInst>(&I);
+    if (!II || !isPayloadIntrinsic(II->getIntrinsicID()) ||
+        !hasConstantOperands(*II))
+      return false;
+  }
+  return true;
+}
+
+static SmallVector<const IntrinsicInst *, 8>
+getPayload(const BasicBlock &BB) {
+  SmallVector<const IntrinsicInst *, 8> Payload;
+  for (const Instruction &I : BB)
+    if (!isa<DbgInfoIntrinsic>(I))
+      if (const auto *II = dyn_cast<IntrinsicInst>(&I))
+        Payload.push_back(II);
+  return Payload;
+}
+
+static unsigned hashPayload(const BasicBlock &BB) {
+  hash_code Hash = 0;
+  for (const IntrinsicInst *II : getPayload(BB)) {
+    Hash = hash_combine(Hash, II->getIntrinsicID());
+    for (const Use &U : II->arg_operands())
+      Hash = hash_combine(Hash, U.get());
+  }
+  return size_t(Hash);
+}
+
+// Constants are uniqued, so equal payloads have identical operands.
+static bool isSamePayload(const BasicBlock &A, const BasicBlock &B) {
+  auto PA = getPayload(A), PB = getPayload(B);
+  if (PA.size() != PB.size())
+    return false;
+  for (unsigned I = 0, E = PA.size(); I != E; ++I)
+    if (!PA[I]->isIdenticalTo(PB[I]))
+      return false;
+  return true;
+}
+
+// Bytes of code for the payload: one PUSH per constant and the opcodes.
+static unsigned estimatePayloadSize(const BasicBlock &BB) {
+  unsigned Size = 0;
+  for (const IntrinsicInst *II : getPayload(BB)) {
+    Size += 1;
+    for (const Use &U : II->arg_operands()) {
+      const APInt &Value = cast<ConstantInt>(U)->getValue();
+      Size += 1 + std::max(1u, (Value.getActiveBits() + 7) / 8);
+    }
+  }
+  return Size;
+}
+
+bool EVMMergeReverts::mergeInFunction(Function &F) {
+  bool Changed = false;
+  for (auto BBI = F.begin(), BBE = F.end(); BBI != BBE;) {
+    BasicBlock &BB = *BBI++;
+    if (!isRevertBlock(BB))
+      continue;
+
+    SmallVectorImpl<BasicBlock *> &Bucket = Buckets[hashPayload(BB)];
+    auto Same = find_if(Bucket, [&](BasicBlock *Other) {
+      return Other->getParent() == &F && isSamePayload(*Other, BB);
+    });
+    if (Same == Bucket.end()) {
+      Bucket.push_back(&BB);
+      RevertBlocks.insert(&BB);
+      continue;
+    }
+
+    // Revert blocks have no successors, so only terminators refer to them.
+    LLVM_DEBUG(dbgs() << "Merging " << BB.getName() << " into "
+                      << (*Same)->getName() << " in " << F.getName() << '\n');
+    BB.replaceAllUsesWith(*Same);
+    BB.eraseFromParent();
+    ++NumMergedReverts;
+    Changed = true;
+  }
+  return Changed;
+}
+
+bool EVMMergeReverts::shareAcrossFunctions(Module &M) {
+  bool Changed = false;
+  LLVMContext &Ctx = M.getContext();
+  unsigned NumStubs = 0;
+  for (auto &Entry : Buckets) {
+    SmallVectorImpl<BasicBlock *> &Bucket = Entry.second;
+    // Split the bucket into payloads that are really equal.
+    SmallVector<bool, 4> Done(Bucket.size(), false);
+    for (unsigned I = 0, E = Bucket.size(); I != E; ++I) {
+      if (Done[I])
+        continue;
+      SmallVector<BasicBlock *, 4> Users = {Bucket[I]};
+      for (unsigned J = I + 1; J != E; ++J)
+        if (!Done[J] && isSamePayload(*Bucket[I], *Bucket[J])) {
+          Users.push_back(Bucket[J]);
+          Done[J] = true;
+        }
+      if (Users.size() < 2 ||
+          estimatePayloadSize(*Users.front()) < SharedRevertThreshold)
+        continue;
+
+      Function *Stub = Function::Create(
+          FunctionType::get(Type::getVoidTy(Ctx), false),
+          GlobalValue::InternalLinkage, "evm.revert." + Twine(NumStubs++),
+          &M);
+      Stub->addFnAttr(Attribute::NoReturn);
+      Stub->addFnAttr(Attribute::NoInline);
+      Stub->addFnAttr(Attribute::NoUnwind);
+      Stub->addFnAttr(Attribute::Cold);
+      BasicBlock *Body = BasicBlock::Create(Ctx, "entry", Stub);
+      for (const IntrinsicInst *II : getPayload(*Users.front()))
+        Body->getInstList().push_back(II->clone());
+      new UnreachableInst(Ctx, Body);
+
+      for (BasicBlock *BB : Users) {
+        while (&BB->front() != BB->getTerminator())
+          BB->front().eraseFromParent();
+        CallInst *Call = CallInst::Create(Stub, "", BB->getTerminator());
+        Call->setDoesNotReturn();
+        Call->setDoesNotThrow();
+      }
+      LLVM_DEBUG(dbgs() << "Sharing a revert between " << Users.size()
+                        << " functions\n");
+      ++NumRevertStubs;
+      Changed = true;
+    }
+  }
+  return Changed;
+}
+
+bool EVMMergeReverts::markCold(Function &F) {
+  bool Changed = false;
+  MDBuilder MDB(F.getContext());
+  SmallVector<BasicBlock *, 8> Cold;
+  for (BasicBlock &BB : F) {
+    if (!RevertBlocks.count(&BB))
+      continue;
+    Cold.push_back(&BB);
+    for (User *U : BB.users()) {
+      auto *Br = dyn_cast<BranchInst>(U);
+      if (!Br || !Br->isConditional() || Br->getMetadata(LLVMContext::MD_prof))
+        continue;
+      if (Br->getSuccessor(0) == Br->getSuccessor(1))
+        continue;
+      bool ColdIsTrue = Br->getSuccessor(0) == &BB;
+      Br->setMetadata(LLVMContext::MD_prof,
+                      ColdIsTrue ? MDB.createBranchWeights(ColdWeight, HotWeight)
+                                 : MDB.createBranchWeights(HotWeight, ColdWeight));
+      ++NumColdBranches;
+      Changed = true;
+    }
+  }
+
+  // Keep the entry block first.
+  for (BasicBlock *BB : Cold)
+    if (BB != &F.getEntryBlock() && BB != &F.back()) {
+      BB->moveAfter(&F.back());
+      Changed = true;
+    }
+  return Changed;
+}
+
+bool EVMMergeReverts::runOnModule(Module &M) {
+  if (DisableRevertMerging || skipModule(M))
+    return false;
+
+  LLVM_DEBUG(dbgs() << "********** Merge revert blocks **********\n");
+
+  Buckets.clear();
+  RevertBlocks.clear();
+
+  bool Changed = false;
+  SmallVector<Function *, 16> Functions;
+  for (Function &F : M)
+    if (!F.isDeclaration())
+      Functions.push_back(&F);
+
+  for (Function *F : Functions)
+    Changed |= mergeInFunction(*F);
+  Changed |= shareAcrossFunctions(M);
+  for (Function *F : Functions)
+    Changed |= markCold(*F);
+  return Changed;
+}
@@ -0,0 +1,399 @@
+//===-- EVMPackGlobals.cpp - Pack narrow globals into 256-bit slots -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This pass packs global variables narrower than 256 bits into shared
+/// 256-bit containers. Every global otherwise occupies a whole 32-byte slot,
+/// so four i64 counters cost four loads and four stores when they are
+/// updated together.
+///
+/// 1. Globals whose only users are simple loads and stores of their own type
+///    are candidates. Their address never escapes, so the only way to reach
+///    them is through the accesses we rewrite.
+/// 2. Candidates are placed into containers with first-fit-decreasing by
+///    access affinity: wider fields are placed first, and each field goes to
+///    the open container whose fields share the most basic blocks with it.
+/// 3. Loads become a container load followed by a shift and a truncate.
+///    Stores become a read-modify-write of the container word. Within a basic
+///    block the container word is kept in a value, so consecutive writes to
+///    fields of the same container are merged into a single store.
+///
+//===----------------------------------------------------------------------===//
+
+#include "EVM.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "evm-pack-globals"
+
+STATISTIC(NumPackedGlobals, "Number of globals packed into shared slots");
+STATISTIC(NumContainers, "Number of 256-bit containers created");
+STATISTIC(NumMergedStores, "Number of stores merged into a single store");
+
+static cl::opt<bool>
+DisableGlobalPacking("evm-disable-global-packing", cl::init(false),
+                     cl::Hidden,
+                     cl::desc("Do not pack narrow globals into 256-bit slots"));
+
+namespace {
+
+// A global placed into a container at bit offset `Offset`.
+struct PackedField {
+  GlobalVariable *Container;
+  unsigned Offset;
+  unsigned Width;
+};
+
+// A 256-bit container under construction.
+struct ContainerBin {
+  SmallVector<GlobalVariable *, 8> Members;
+  unsigned UsedBits = 0;
+};
+
+class EVMPackGlobals final : public ModulePass {
+public:
+  static char ID; // Pass identification, replacement for typeid
+  EVMPackGlobals() : ModulePass(ID) {}
+
+  StringRef getPassName() const override {
+    return "EVM pack narrow globals";
+  }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesCFG();
+    ModulePass::getAnalysisUsage(AU);
+  }
+
+  bool runOnModule(Module &M) override;
+
+private:
+  static const unsigned SlotBits = 256;
+
+  bool isCandidate(const GlobalVariable &GV) const;
+  void collectAccessBlocks(GlobalVariable *GV);
+  unsigned getAffinity(const GlobalVariable *GV,
+                       const ContainerBin &Bin) const;
+  void assignBins(SmallVectorImpl<GlobalVariable *> &Candidates,
+                  std::vector<ContainerBin> &Bins) const;
+  GlobalVariable *createContainer(Module &M, const ContainerBin &Bin,
+                                  unsigned Index);
+  bool rewriteBlock(BasicBlock &BB);
+
+  // Blocks that access each candidate; used to compute affinity.
+  DenseMap<const GlobalVariable *, SmallPtrSet<const BasicBlock *, 8>>
+      AccessBlocks;
+
+  DenseMap<const GlobalVariable *, PackedField> Fields;
+  SmallPtrSet<const GlobalVariable *, 8> Containers;
+};
+} // end anonymous namespace
+
+char EVMPackGlobals::ID = 0;
+INITIALIZE_PASS(EVMPackGlobals, DEBUG_TYPE,
+                "Pack narrow EVM globals into shared slots", false, false)
+
+ModulePass *llvm::createEVMPackGlobals() {
+  return new EVMPackGlobals();
+}
+
+bool EVMPackGlobals::isCandidate(const GlobalVariable &GV) const {
+  if (GV.isDeclaration() || GV.isConstant() || GV.isThreadLocal() ||
+      GV.isExternallyInitialized() || !GV.hasDefinitiveInitializer())
+    return false;
+
+  if (GV.getAddressSpace() != 0)
+    return false;
+
+  IntegerType *Ty = dyn_cast<IntegerType>(GV.getValueType());
+  if (!Ty || Ty->getBitWidth() >= SlotBits)
+    return false;
+
+  if (!isa<ConstantInt>(GV.getInitializer()) &&
+      !GV.getInitializer()->isNullValue())
+    return false;
+
+  // The address must not escape: only direct loads and stores of the global's
+  // own type are allowed.
+  for (const User *U : GV.users()) {
+    if (const LoadInst *LI = dyn_cast<LoadInst>(U)) {
+      if (!LI->isSimple() || LI->getType() != Ty)
+        return false;
+      continue;
+    }
+    if (const StoreInst *SI = dyn_cast<StoreInst>(U)) {
+      if (!SI->isSimple() || SI->getPointerOperand() != &GV ||
+          SI->getValueOperand()->getType() != Ty)
+        return false;
+      continue;
+    }
+    return false;
+  }
+
+  return !GV.use_empty();
+}
+
+void EVMPackGlobals::collectAccessBlocks(GlobalVariable *GV) {
+  auto &Blocks = AccessBlocks[GV];
+  for (const User *U : GV->users())
+    Blocks.insert(cast<Instruction>(U)->getParent());
+}
+
+unsigned EVMPackGlobals::getAffinity(const GlobalVariable *GV,
+                                     const ContainerBin &Bin) const {
+  const auto &MyBlocks = AccessBlocks.find(GV)->second;
+  unsigned Affinity = 0;
+  for (const GlobalVariable *Member : Bin.Members) {
+    for (const BasicBlock *BB : AccessBlocks.find(Member)->second)
+      if (MyBlocks.count(BB))
+        ++Affinity;
+  }
+  return Affinity;
+}
+
+void EVMPackGlobals::assignBins(SmallVectorImpl<GlobalVariable *> &Candidates,
+                                std::vector<ContainerBin> &Bins) const {
+  // Decreasing width; ties keep module order so the layout is deterministic.
+  std::stable_sort(Candidates.begin(), Candidates.end(),
+                   [](const GlobalVariable *A, const GlobalVariable *B) {
+                     return A->getValueType()->getIntegerBitWidth() >
+                            B->getValueType()->getIntegerBitWidth();
+                   });
+
+  for (GlobalVariable *GV : Candidates) {
+    unsigned Width = GV->getValueType()->getIntegerBitWidth();
+
+    // First fit among the bins with the highest affinity.
+    int Best = -1;
+    unsigned BestAffinity = 0;
+    for (unsigned i = 0, e = Bins.size(); i != e; ++i) {
+      if (Bins[i].UsedBits + Width > SlotBits)
+        continue;
+      unsigned Affinity = getAffinity(GV, Bins[i]);
+      if (Best == -1 || Affinity > BestAffinity) {
+        Best = i;
+        BestAffinity = Affinity;
+      }
+    }
+
+    if (Best == -1) {
+      Bins.emplace_back();
+      Best = Bins.size() - 1;
+    }
+
+    Bins[Best].Members.push_back(GV);
+    Bins[Best].UsedBits += Width;
+  }
+}
+
+GlobalVariable *EVMPackGlobals::createContainer(Module &M,
+                                                const ContainerBin &Bin,
+                                                unsigned Index) {
+  IntegerType *SlotTy = IntegerType::get(M.getContext(), SlotBits);
+  APInt Init(SlotBits, 0);
+
+  auto *Container = new GlobalVariable(
+      M, SlotTy, false, GlobalValue::PrivateLinkage, nullptr,
+      "evm.packed." + Twine(Index));
+
+  unsigned Offset = 0;
+  for (GlobalVariable *GV : Bin.Members) {
+    unsigned Width = GV->getValueType()->getIntegerBitWidth();
+    if (const ConstantInt *CI = dyn_cast<ConstantInt>(GV->getInitializer()))
+      Init |= CI->getValue().zext(SlotBits).shl(Offset);
+
+    Fields[GV] = {Container, Offset, Width};
+    LLVM_DEBUG(dbgs() << "  " << GV->getName() << " -> "
+                      << Container->getName() << "[" << Offset << ", "
+                      << Offset + Width << ")\n");
+    Offset += Width;
+  }
+
+  Container->setInitializer(ConstantInt::get(M.getContext(), Init));
+  Containers.insert(Container);
+  ++NumContainers;
+  return Container;
+}
+
+// Rewrite every access to a packed field in BB. The current value of each
+// container word is tracked while walking the block: loads reuse it, and
+// stores only update it. The word is written back before anything that could
+// observe the container, and at the end of the block.
+bool EVMPackGlobals::rewriteBlock(BasicBlock &BB) {
+  struct WordState {
+    Value *Word = nullptr;
+    bool Dirty = false;
+    unsigned PendingStores = 0;
+  };
+  MapVector<GlobalVariable *, WordState> State;
+  SmallVector<Instruction *, 8> ToErase;
+  bool Changed = false;
+
+  auto flush = [&](Instruction *InsertPt, bool Invalidate) {
+    IRBuilder<> Builder(InsertPt);
+    for (auto &Entry : State) {
+      WordState &WS = Entry.second;
+      if (WS.Dirty) {
+        Builder.CreateStore(WS.Word, Entry.first);
+        if (WS.PendingStores > 1)
+          NumMergedStores += WS.PendingStores - 1;
+      }
+      WS.Dirty = false;
+      WS.PendingStores = 0;
+    }
+    if (Invalidate)
+      State.clear();
+  };
+
+  auto getWord = [&](GlobalVariable *Container, IRBuilder<> &Builder) {
+    WordState &WS = State[Container];
+    if (!WS.Word)
+      WS.Word = Builder.CreateLoad(Container->getValueType(), Container,
+                                   Container->getName() + ".word");
+    return WS.Word;
+  };
+
+  for (Instruction &I : BB) {
+    if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+      auto *GV = dyn_cast<GlobalVariable>(LI->getPointerOperand());
+      auto FI = GV ? Fields.find(GV) : Fields.end();
+      if (FI != Fields.end()) {
+        const PackedField &F = FI->second;
+        IRBuilder<> Builder(LI);
+        Value *Word = getWord(F.Container, Builder);
+        Value *V = Word;
+        if (F.Offset != 0)
+          V = Builder.CreateLShr(V, F.Offset);
+        V = Builder.CreateTrunc(V, LI->getType(), LI->getName());
+        LI->replaceAllUsesWith(V);
+        ToErase.push_back(LI);
+        Changed = true;
+        continue;
+      }
+    }
+
+    if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+      auto *GV = dyn_cast<GlobalVariable>(SI->getPointerOperand());
+      auto FI = GV ? Fields.find(GV) : Fields.end();
+      if (FI != Fields.end()) {
+        const PackedField &F = FI->second;
+        IRBuilder<> Builder(SI);
+        Value *Word = getWord(F.Container, Builder);
+        IntegerType *SlotTy = cast<IntegerType>(Word->getType());
+
+        APInt Mask = APInt::getBitsSet(SlotBits, F.Offset, F.Offset + F.Width);
+        Value *Cleared = Builder.CreateAnd(Word, ConstantInt::get(SlotTy, ~Mask));
+        Value *NewField = Builder.CreateZExt(SI->getValueOperand(), SlotTy);
+        if (F.Offset != 0)
+          NewField = Builder.CreateShl(NewField, F.Offset);
+
+        WordState &WS = State[F.Container];
+        WS.Word = Builder.CreateOr(Cleared, NewField);
+        WS.Dirty = true;
+        ++WS.PendingStores;
+        ToErase.push_back(SI);
+        Changed = true;
+        continue;
+      }
+    }
+
+    if (State.empty())
+      continue;
+
+    if (I.isTerminator()) {
+      flush(&I, true);
+      break;
+    }
+
+    // Accesses to memory that cannot be a container do not interfere.
+    if (!isa<CallBase>(I) && I.mayReadOrWriteMemory()) {
+      Value *Ptr = nullptr;
+      if (auto *LI = dyn_cast<LoadInst>(&I))
+        Ptr = LI->getPointerOperand();
+      else if (auto *SI = dyn_cast<StoreInst>(&I))
+        Ptr = SI->getPointerOperand();
+      if (Ptr) {
+        const Value *Obj =
+            GetUnderlyingObject(Ptr, BB.getModule()->getDataLayout());
+        if (isa<AllocaInst>(Obj) ||
+            (isa<GlobalVariable>(Obj) &&
+             !Containers.count(cast<GlobalVariable>(Obj))))
+          continue;
+      }
+    }
+
+    if (I.mayReadOrWriteMemory())
+      flush(&I, I.mayWriteToMemory());
+  }
+
+  for (Instruction *I : ToErase)
+    I->eraseFromParent();
+
+  return Changed;
+}
+
+bool EVMPackGlobals::runOnModule(Module &M) {
+  if (DisableGlobalPacking || skipModule(M))
+    return false;
+
+  LLVM_DEBUG(dbgs() << "********** Pack narrow globals **********\n");
+
+  AccessBlocks.clear();
+  Fields.clear();
+  Containers.clear();
+
+  SmallVector<GlobalVariable *, 16> Candidates;
+  for (GlobalVariable &GV : M.globals()) {
+    if (!isCandidate(GV))
+      continue;
+    Candidates.push_back(&GV);
+    collectAccessBlocks(&GV);
+  }
+
+  // Packing a single global does not save anything.
+  if (Candidates.size() < 2)
+    return false;
+
+  std::vector<ContainerBin> Bins;
+  assignBins(Candidates, Bins);
+
+  unsigned Index = 0;
+  for (const ContainerBin &Bin : Bins) {
+    if (Bin.Members.size() < 2)
+      continue;
+    createContainer(M, Bin, Index++);
+  }
+
+  if (Fields.empty())
+    return false;
+
+  for (Function &F : M)
+    for (BasicBlock &BB : F)
+      rewriteBlock(BB);
+
+  for (auto &Entry : Fields) {
+    GlobalVariable *GV = const_cast<GlobalVariable *>(Entry.first);
+    assert(GV->use_empty() && "packed global still has uses");
+    GV->eraseFromParent();
+    ++NumPackedGlobals;
+  }
+
+  return true;
+}
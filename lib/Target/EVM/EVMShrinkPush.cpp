@@ -15,6 +15,7 @@
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/Passes.h"
+#include "llvm/IR/Constants.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/MathExtras.h"
@@ -140,16 +141,32 @@ bool EVMShrinkpush::runOnMachineFunction(MachineFunction &MF) {
               MI.setDesc(TII.get(EVM::PUSH8));
               replaceCIwithI(MI, ci->getZExtValue());
           } else {
-            // for now, constants with bit width > 64 will all use PUSH32.
-            // This is an optimization opportunity.
-            LLVM_DEBUG(dbgs() << " (Keeping the width due to size)");
+            // A wide constant with a short complement, such as a mask of the
+            // high bits, is cheaper to push complemented and invert.
+            unsigned bytes = (activeBits + 7) / 8;
+            APInt inverted = ~apval;
+            unsigned invertedBytes =
+                std::max(1u, (inverted.getActiveBits() + 7) / 8);
+            if (byteWidth == 256 && invertedBytes + 1 < bytes) {
+              MI.setDesc(TII.get(EVMSubtarget::get_push_opcode(invertedBytes)));
+              MI.RemoveOperand(0);
+              MI.addOperand(MachineOperand::CreateCImm(
+                  ConstantInt::get(ci->getContext(), inverted)));
+              BuildMI(MBB, std::next(MI.getIterator()), MI.getDebugLoc(),
+                      TII.get(EVM::NOT));
+            } else {
+              MI.setDesc(TII.get(EVMSubtarget::get_push_opcode(bytes)));
+            }
           }
+          Changed = true;
 
         }
 
-        // EIP-170
-        if (MO.isMBB() || MO.isGlobal() || MO.isBlockAddress()) {
-          int new_opcode = EVMSubtarget::get_push_opcode(2);
+        // Code offsets start at PUSH1; the assembler relaxes them to PUSH2
+        // or PUSH3 once their value is known.
+        if (MO.isMBB() || MO.isGlobal() || MO.isBlockAddress() ||
+            MO.isSymbol()) {
+          int new_opcode = EVMSubtarget::get_push_opcode(1);
           MI.setDesc(TII.get(new_opcode));
           Changed = true;
         }
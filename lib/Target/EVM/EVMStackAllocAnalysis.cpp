@@ -11,9 +11,12 @@
 
 #include "EVM.h"
 #include "EVMStackAllocAnalysis.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
 #include <cassert>
 #include <queue>
 
@@ -21,6 +24,11 @@ using namespace llvm;
 
 #define DEBUG_TYPE "evm-stackalloc"
 
+STATISTIC(NumHaltingCleanupsDropped,
+          "Number of POPs left out before halting instructions");
+STATISTIC(NumRematerializedConstants,
+          "Number of constants pushed again instead of kept in memory");
+
 // Register this pass...
 char EVMStackAlloc::ID = 0;
 
@@ -49,7 +57,18 @@ void EVMStackStatus::swap(unsigned depth) {
       dbgs() << "    >>> SWAP" << depth << ": (%" << fst_idx << " <-> %" << snd_idx
              << ")\n";
     });
+    unsigned top = stackElements.rbegin()[0];
+    unsigned other = stackElements.rbegin()[depth];
     std::iter_swap(stackElements.rbegin(), stackElements.rbegin() + depth);
+    if (top == other) {
+      return;
+    }
+    positions[other].top = getStackDepth() - 1;
+    if (positions[top].count == 1) {
+      positions[top].top = getStackDepth() - 1 - depth;
+    } else {
+      updateTop(top);
+    }
 }
 
 void EVMStackStatus::dup(unsigned depth) {
@@ -60,7 +79,30 @@ void EVMStackStatus::dup(unsigned depth) {
     dbgs() << "    >>> DUP" << depth << "(%" << idx << ")\n";
   });
 
-  stackElements.push_back(elem);
+  addElement(elem);
+}
+
+void EVMStackStatus::addElement(unsigned reg) {
+  positions.grow(reg);
+  RegPosition &P = positions[reg];
+  P.top = stackElements.size();
+  ++P.count;
+  stackElements.push_back(reg);
+}
+
+void EVMStackStatus::updateTop(unsigned reg) {
+  RegPosition &P = positions[reg];
+  if (P.count == 0) {
+    return;
+  }
+  // Copies are rare and short lived, so this scan is almost never long.
+  for (unsigned i = stackElements.size(); i-- > 0;) {
+    if (stackElements[i] == reg) {
+      P.top = i;
+      return;
+    }
+  }
+  llvm_unreachable("Cannot find register on stack");
 }
 
 unsigned EVMStackStatus::pop() {
@@ -70,6 +112,8 @@ unsigned EVMStackStatus::pop() {
     dbgs() << "    >>> POP (%" << idx << ")\n";
   });
   stackElements.pop_back();
+  --positions[reg].count;
+  updateTop(reg);
   return reg;
 }
 
@@ -78,7 +122,7 @@ void EVMStackStatus::push(unsigned reg) {
     unsigned idx = Register::virtReg2Index(reg);
     dbgs() << "    >>> PUSH %" << idx << "\n";
   });
-  stackElements.push_back(reg);
+  addElement(reg);
 }
 
 
@@ -96,67 +140,37 @@ void EVMStackStatus::dump() const {
 }
 
 unsigned EVMStackStatus::findRegDepth(unsigned reg) const {
-  unsigned curHeight = getStackDepth();
-
-  for (unsigned d = 0; d < curHeight; ++d) {
-    unsigned stackReg = get(d);
-    if (stackReg == reg) {
-      /*
-      LLVM_DEBUG({
-        dbgs() << "    Found %" << Register::virtReg2Index(reg)
-               << " at depth: " << d << "\n";
-      });
-      */
-      return d;
-    }
-  }
-  llvm_unreachable("Cannot find register on stack");
+  assert(Register::virtReg2Index(reg) < positions.size() &&
+         positions[reg].count != 0 && "Cannot find register on stack");
+  return getStackDepth() - 1 - positions[reg].top;
 }
 
 
 unsigned EdgeSets::getEdgeSetIndex(Edge edge) const {
-  // Linear search. Can improve it.
-  for (std::pair<unsigned, Edge> edgePair : edgeIndex) {
-    if (edgePair.second == edge) {
-      auto result = edgeIndex2EdgeSet.find(edgePair.first);
-      assert(result != edgeIndex2EdgeSet.end() && "Cannot find edge set!");
-      return result->second;
-    }
-  }
-  llvm_unreachable("Cannot find edge index.");
+  return edgeSetClasses[getEdgeIndex(edge)];
 }
 
 unsigned EdgeSets::getEdgeIndex(Edge edge) const {
-  // Linear search. Can improve it.
-  for (std::pair<unsigned, Edge> edgePair : edgeIndex) {
-    if (edgePair.second == edge) {
-      return edgePair.first;
-    }
-  }
-  llvm_unreachable("Cannot find edge index.");
+  auto result = edgeIndex.find(edge);
+  assert(result != edgeIndex.end() && "Cannot find edge index.");
+  return result->second;
 }
 
 
 void EdgeSets::collectEdges(MachineFunction *MF) {
-  std::set<MachineBasicBlock*> visited;
+  auto addEdge = [this](Edge edge) {
+    edgeIndex.insert({edge, edges.size()});
+    edges.push_back(edge);
+  };
 
   // Artifically create a {NULL, EntryMBB} Edge,
   // and {ExitMBB, NULL} Edge
-  edgeIndex[0] = Edge(NULL, &MF->front());
-  edgeIndex[1] = Edge(&MF->back(), NULL);
+  addEdge(Edge(NULL, &MF->front()));
+  addEdge(Edge(&MF->back(), NULL));
 
   for (MachineBasicBlock &MBB : *MF) {
-    // Skip if we have visited this MBB:
-    if (visited.find(&MBB) != visited.end()) {
-      continue;
-    }
-
-    visited.insert(&MBB);
     for (auto *NextMBB : MBB.successors()) {
-      unsigned key = edgeIndex.size();
-      assert(edgeIndex.find(key) == edgeIndex.end() &&
-             "Trying to emplace edge indexes.");
-      edgeIndex[edgeIndex.size()] = Edge(&MBB, NextMBB);
+      addEdge(Edge(&MBB, NextMBB));
     }
   }
 }
@@ -166,10 +180,7 @@ void EdgeSets::computeEdgeSets(MachineFunction *MF) {
   collectEdges(MF);
 
   // Then, assign a new edge set for each of the edges
-  for (std::pair<unsigned, Edge> index : edgeIndex) {
-    edgeIndex2EdgeSet.insert({index.first, index.first});
-  }
-
+  edgeSetClasses.grow(edges.size());
 
   // Criteria: Two MBBs share a same edge set if:
   // 1. they have a common child.
@@ -199,30 +210,18 @@ void EdgeSets::computeEdgeSets(MachineFunction *MF) {
       }
     }
   }
+
+  // number the edge sets densely.
+  edgeSetClasses.compress();
 }
 
 void EdgeSets::mergeEdgeSets(Edge edge1, Edge edge2) {
-  unsigned edgeSet1 = getEdgeSetIndex(edge1);
-  unsigned edgeSet2 = getEdgeSetIndex(edge2);
-
-  // return if they are already in the same edge set.
-  if (edgeSet1 == edgeSet2) {
-    return;
-  }
-
-  // change edgeSet2 to edgeSet1
-  for (std::pair<unsigned, unsigned> index2Set : edgeIndex2EdgeSet) {
-    if (index2Set.second == edgeSet2) {
-      edgeIndex2EdgeSet[index2Set.first] = edgeSet1;
-    }
-  }
-  return;
+  edgeSetClasses.join(getEdgeIndex(edge1), getEdgeIndex(edge2));
 }
 
 EdgeSets::Edge EdgeSets::getEdge(unsigned edgeId) const {
-  auto result = edgeIndex.find(edgeId);
-  assert(result != edgeIndex.end());
-  return result->second;
+  assert(edgeId < edges.size());
+  return edges[edgeId];
 }
 
 void EdgeSets::printEdge(Edge edge) const {
@@ -241,14 +240,10 @@ void EdgeSets::printEdge(Edge edge) const {
 
 void EdgeSets::dump() const {
   LLVM_DEBUG({
-    for (std::pair<unsigned, unsigned> it : edgeIndex2EdgeSet) {
-      // edge set Index : edge index
-      unsigned edgeId = it.first;
-      unsigned esIndex = it.second;
-      // find the Edges
-      Edge edge = getEdge(edgeId);
-      dbgs() << "    " << esIndex << " : ";
-      printEdge(edge);
+    for (unsigned edgeId = 0; edgeId < edges.size(); ++edgeId) {
+      // edge set Index : edge
+      dbgs() << "    " << edgeSetClasses[edgeId] << " : ";
+      printEdge(edges[edgeId]);
     }
     dbgs() << "-------------------------------------------------\n";
   });
@@ -261,20 +256,164 @@ void EVMStackAlloc::getAnalysisUsage(AnalysisUsage &AU) const {
 }
 
 void EVMStackAlloc::initialize() {
+  unsigned numVirtRegs = MRI->getNumVirtRegs();
+
   edgeSets.reset();
   regAssignments.clear();
-  currentStackStatus.reset();
+  regAssignments.resize(numVirtRegs);
+  assignedRegs.clear();
+  assignedRegs.resize(numVirtRegs);
+  currentStackStatus.reset(numVirtRegs);
   edgeset2assignment.clear();
+
+  memoryAssignment.clear();
+  memorySlotOf.clear();
+  memorySlotOf.resize(numVirtRegs);
+  freeMemorySlots.clear();
+  numFreeMemorySlots = 0;
+}
+
+// Bytes of a reload from a memory slot, see expandLOCAL: PUSH fp, MLOAD,
+// PUSH offset, ADD, MLOAD.
+static const unsigned SlotReloadBytes = 7;
+
+// Bytes of the push of a constant after EVMShrinkPush. Code offsets start at
+// PUSH1 and are rarely relaxed beyond PUSH2.
+static unsigned getPushBytes(const MachineOperand &MO) {
+  if (MO.isCImm()) {
+    unsigned activeBits = MO.getCImm()->getValue().getActiveBits();
+    return activeBits > 64 ? 33 : 1 + std::max(1u, (activeBits + 7) / 8);
+  }
+  if (MO.isImm()) {
+    // negative immediates are sign extended after the push.
+    int64_t imm = MO.getImm();
+    if (imm < 0) {
+      return 33;
+    }
+    return 1 + std::max(1u, (64 - countLeadingZeros<uint64_t>(imm) + 7) / 8);
+  }
+  return 3;
+}
+
+// A constant used in several blocks would go to a memory slot, which costs a
+// store and a reload of SlotReloadBytes for every use. Pushing it again in
+// each block that uses it is cheaper in gas, and for short constants also in
+// size. Within a block the copy is kept on the stack and DUPed like any other
+// local. Functions optimized for size keep the large constants in memory.
+bool EVMStackAlloc::rematerializeConstants(MachineFunction &F) {
+  bool OptSize = F.getFunction().hasOptSize();
+
+  SmallVector<MachineInstr *, 16> Pushes;
+  for (MachineBasicBlock &MBB : F) {
+    for (MachineInstr &MI : MBB) {
+      if (MI.getOpcode() == EVM::PUSH32_r &&
+          MRI->hasOneDef(MI.getOperand(0).getReg())) {
+        Pushes.push_back(&MI);
+      }
+    }
+  }
+
+  bool Changed = false;
+  for (MachineInstr *Def : Pushes) {
+    unsigned Reg = Def->getOperand(0).getReg();
+    if (OptSize && getPushBytes(Def->getOperand(1)) > SlotReloadBytes) {
+      continue;
+    }
+
+    SmallSetVector<MachineBasicBlock *, 4> UseBlocks;
+    for (MachineInstr &UseMI : MRI->use_nodbg_instructions(Reg)) {
+      if (UseMI.getParent() != Def->getParent()) {
+        UseBlocks.insert(UseMI.getParent());
+      }
+    }
+    if (UseBlocks.empty()) {
+      continue;
+    }
+
+    // Push the constant again right before its first use in each block.
+    for (MachineBasicBlock *MBB : UseBlocks) {
+      unsigned NewReg = MRI->createVirtualRegister(MRI->getRegClass(Reg));
+      bool Pushed = false;
+      for (MachineInstr &MI : *MBB) {
+        if (!MI.readsRegister(Reg)) {
+          continue;
+        }
+        if (!Pushed) {
+          MachineInstr *Clone = F.CloneMachineInstr(Def);
+          Clone->getOperand(0).setReg(NewReg);
+          MBB->insert(MI.getIterator(), Clone);
+          LIS->InsertMachineInstrInMaps(*Clone);
+          Pushed = true;
+        }
+        for (MachineOperand &MO : MI.uses()) {
+          if (MO.isReg() && MO.getReg() == Reg) {
+            MO.setReg(NewReg);
+            MO.setIsKill(false);
+          }
+        }
+      }
+      LIS->createAndComputeVirtRegInterval(NewReg);
+      ++NumRematerializedConstants;
+    }
+
+    LIS->removeInterval(Reg);
+    if (MRI->use_nodbg_empty(Reg)) {
+      LIS->RemoveMachineInstrFromMaps(*Def);
+      Def->eraseFromParent();
+    } else {
+      LIS->createAndComputeVirtRegInterval(Reg);
+    }
+    Changed = true;
+  }
+  return Changed;
+}
+
+// Record the slot index of every register use once, in layout order, which
+// is also the order of slot indexes.
+void EVMStackAlloc::collectUseSlots(MachineFunction &F) {
+  useSlots.clear();
+  useSlots.resize(MRI->getNumVirtRegs());
+
+  for (MachineBasicBlock &MBB : F) {
+    for (MachineInstr &MI : MBB) {
+      if (MI.isDebugInstr()) {
+        continue;
+      }
+      SlotIndex slot = LIS->getInstructionIndex(MI).getRegSlot();
+      for (const MachineOperand &MO : MI.operands()) {
+        if (MO.isReg() && MO.isUse() &&
+            Register::isVirtualRegister(MO.getReg())) {
+          useSlots[MO.getReg()].push_back(slot);
+        }
+      }
+    }
+  }
+}
+
+void EVMStackAlloc::addUseSlot(unsigned reg, SlotIndex slot) {
+  SmallVectorImpl<SlotIndex> &slots = useSlots[reg];
+  slots.insert(std::upper_bound(slots.begin(), slots.end(), slot), slot);
+}
+
+void EVMStackAlloc::recordAssignment(unsigned reg, StackAssignment SA) {
+  unsigned index = Register::virtReg2Index(reg);
+  if (assignedRegs.test(index)) {
+    return;
+  }
+  assignedRegs.set(index);
+  regAssignments[reg] = SA;
 }
 
 void EVMStackAlloc::allocateRegistersToStack(MachineFunction &F) {
   // assert(MRI->isSSA() && "Must be run on SSA.");
   // clean up previous assignments.
   initialize();
+  collectUseSlots(F);
 
   // compute edge sets
   edgeSets.computeEdgeSets(&F);
   edgeSets.dump();
+  edgeset2assignment.resize(edgeSets.getNumEdgeSets());
 
   // analyze each BB
   for (MachineBasicBlock &MBB : F) {
@@ -327,28 +466,22 @@ void EVMStackAlloc::beginOfBlockUpdates(MachineBasicBlock *MBB) {
   EdgeSets::Edge edge = {Pred, MBB};
   unsigned setIndex = edgeSets.getEdgeSetIndex(edge);
 
-  
-  if (edgeset2assignment.find(setIndex) != edgeset2assignment.end()) {
-    // TODO
-  } else {
-
-  }
-  ActiveStack xStack = edgeset2assignment[setIndex].first;
-  MemorySlots memslots = edgeset2assignment[setIndex].second;
+  const ActiveStack &xStack = edgeset2assignment[setIndex].first;
+  const MemorySlots &memslots = edgeset2assignment[setIndex].second;
 
   // initialize the stack using x stack.
   for (unsigned i = 0; i < xStack.size(); ++i) {
     unsigned reg = xStack[i];
     stack.push(reg);
     // also need to update X Stack
-    StackAssignment SA = regAssignments.lookup(reg);
+    StackAssignment SA = regAssignments[reg];
     if (SA.region == X_STACK) {
       stack.pushElementToXRegion();
     }
   }
   
   // also initialize the memory slots;
-  memoryAssignment = memslots;
+  setMemorySlots(memslots);
 
   // Now pop those dead x registers.
   MachineInstr &MI = *MBB->begin();
@@ -415,6 +548,10 @@ void EVMStackAlloc::dumpMemoryStatus() const {
 }
 
 void EVMStackAlloc::endOfBlockUpdates(MachineBasicBlock *MBB) {
+  // the stack is discarded when the block halts.
+  if (inHaltingBlock)
+    return;
+
   // make sure the reg is in X region.
   assert(stack.getStackDepth() == stack.getSizeOfXRegion() &&
          "L Region elements are still on the stack at end of MBB.");
@@ -430,7 +567,6 @@ void EVMStackAlloc::endOfBlockUpdates(MachineBasicBlock *MBB) {
   });
 
 
-  std::vector<unsigned> xStack(stack.getStackElements());
   for (MachineBasicBlock *NextMBB : MBB->successors()) {
     unsigned edgeSetIndex = edgeSets.getEdgeSetIndex({MBB, NextMBB});
 
@@ -521,22 +657,22 @@ MachineInstr& EVMStackAlloc::tryToAnalyzeStackArgs(MachineBasicBlock *MBB) {
 
     // pop up unused stack args
     if (MRI->use_nodbg_empty(reg)) {
-      regAssignments.insert(
-          std::pair<unsigned, StackAssignment>(reg, {NO_ALLOCATION, 0}));
+      recordAssignment(reg, {NO_ALLOCATION, 0});
       LLVM_DEBUG(dbgs() << "    Allocating %" << Register::virtReg2Index(reg)
                         << " to NO_ALLOCATION.\n");
-      insertPopBefore(*stackargMI);
+      if (inHaltingBlock)
+        ++NumHaltingCleanupsDropped;
+      else
+        insertPopBefore(*stackargMI);
     } else if (defIsLocal(*stackargMI)) {
-      regAssignments.insert(
-          std::pair<unsigned, StackAssignment>(reg, {L_STACK, 0}));
+      recordAssignment(reg, {L_STACK, 0});
       LLVM_DEBUG(dbgs() << "    Allocating %"
                         << Register::virtReg2Index(reg)
                         << " to LOCAL STACK.\n");
       // update stack status
       currentStackStatus.L.insert(reg);
     } else if (false && liveIntervalWithinSameEdgeSet(reg)) {
-      regAssignments.insert(
-          std::pair<unsigned, StackAssignment>(reg, {X_STACK, 0}));
+      recordAssignment(reg, {X_STACK, 0});
       LLVM_DEBUG(dbgs() << "    Allocating %"
                         << Register::virtReg2Index(reg)
                         << " to X STACK.\n");
@@ -552,8 +688,7 @@ MachineInstr& EVMStackAlloc::tryToAnalyzeStackArgs(MachineBasicBlock *MBB) {
       // Everything else goes to memory
       currentStackStatus.M.insert(reg);
       unsigned slot = allocateMemorySlot(reg);
-      regAssignments.insert(
-          std::pair<unsigned, StackAssignment>(reg, {NONSTACK, slot}));
+      recordAssignment(reg, {NONSTACK, slot});
 
       unsigned depth = stack.findRegDepth(reg);
       if (depth != 0) {
@@ -589,6 +724,7 @@ void EVMStackAlloc::analyzeBasicBlock(MachineBasicBlock *MBB) {
 
   // this will alter MBB, so we record begin MI instruction
   stack.clear();
+  inHaltingBlock = EVM::endsInHalt(*MBB);
 
   MachineInstr &BeginMI = tryToAnalyzeStackArgs(MBB);
   beginOfBlockUpdates(MBB);
@@ -631,6 +767,10 @@ void EVMStackAlloc::cleanUpDeadRegisters(MachineInstr &MI) {
   MachineBasicBlock *MBB = MI.getParent();
   for (MOPUseType mut : useTypes) {
     if (mut.second.isLastUse) {
+      if (inHaltingBlock) {
+        ++NumHaltingCleanupsDropped;
+        continue;
+      }
       unsigned depth = stack.findRegDepth(mut.second.reg);
 
       if (depth != 0) {
@@ -650,9 +790,8 @@ void EVMStackAlloc::cleanUpDeadRegisters(MachineInstr &MI) {
 } 
 
 StackAssignment EVMStackAlloc::getStackAssignment(unsigned reg) const {
-  assert(regAssignments.find(reg) != regAssignments.end() &&
-         "Cannot find stack assignment for register.");
-  return regAssignments.lookup(reg);
+  assert(hasAssignment(reg) && "Cannot find stack assignment for register.");
+  return regAssignments[reg];
 }
 
 // Test whether Reg, as defined at Def, has exactly one use. This is a
@@ -685,32 +824,34 @@ static bool hasOneUse(unsigned Reg, const MachineInstr *Def, MachineRegisterInfo
   */
 }
 
+// return the first use of reg in an instruction after slot, or nullptr.
+static const SlotIndex *findNextUse(ArrayRef<SlotIndex> slots,
+                                    const SlotIndex &slot) {
+  auto next = std::upper_bound(slots.begin(), slots.end(), slot,
+                               [](const SlotIndex &a, const SlotIndex &b) {
+                                 return SlotIndex::isEarlierInstr(a, b);
+                               });
+  return next == slots.end() ? nullptr : next;
+}
+
 bool EVMStackAlloc::rangeContainsRegUses(unsigned reg,
                                          SlotIndex &beginSlot,
                                          SlotIndex &endSlot) const {
-  for (auto &Use : MRI->use_nodbg_operands(reg)) {
-    MachineInstr * UseMI = Use.getParent();
-    SlotIndex UseSlot = LIS->getInstructionIndex(*UseMI).getRegSlot();
-
-    // check if the same BB has subsequent uses.
-    if (SlotIndex::isEarlierInstr(beginSlot, UseSlot) &&
-        SlotIndex::isEarlierInstr(UseSlot, endSlot)) {
-      return true;
-    }
-  }
-  return false;
+  // check if the range has subsequent uses.
+  const SlotIndex *UseSlot = findNextUse(useSlots[reg], beginSlot);
+  return UseSlot && SlotIndex::isEarlierInstr(*UseSlot, endSlot);
 }
 
 bool EVMStackAlloc::sucessorsContainRegUses(unsigned reg,
                                             const MachineBasicBlock *MBB) const {
-  for (auto &Use : MRI->use_nodbg_operands(reg)) {
-    MachineInstr * UseMI = Use.getParent();
-    SlotIndex UseSlot = LIS->getInstructionIndex(*UseMI).getRegSlot();
-    for (auto SuccMBB : MBB->successors()) {
-      SlotIndex SuccBegin = LIS->getMBBStartIdx(SuccMBB);
-      if (SlotIndex::isEarlierInstr(SuccBegin, UseSlot)) {
-        return true;
-      }
+  const SmallVectorImpl<SlotIndex> &slots = useSlots[reg];
+  if (slots.empty()) {
+    return false;
+  }
+  for (auto SuccMBB : MBB->successors()) {
+    SlotIndex SuccBegin = LIS->getMBBStartIdx(SuccMBB);
+    if (SlotIndex::isEarlierInstr(SuccBegin, slots.back())) {
+      return true;
     }
   }
   return false;
@@ -724,13 +865,10 @@ bool EVMStackAlloc::regIsLastUse(const MachineOperand &MOP) const {
   if (hasOneUse(reg, MOP.getParent(), MRI, LIS))
     return true;
   
-  // iterate over all uses
+  // look for a use after this one
   const MachineInstr *MI = MOP.getParent();
-  const MachineBasicBlock *MBB = MI->getParent();
   SlotIndex MISlot = LIS->getInstructionIndex(*MI).getRegSlot();
-  SlotIndex BBEndSlot = LIS->getMBBEndIdx(&MBB->getParent()->back());
-
-  if (rangeContainsRegUses(reg, MISlot, BBEndSlot)) {
+  if (findNextUse(useSlots[reg], MISlot)) {
     return false;
   }
 
@@ -760,20 +898,23 @@ void EVMStackAlloc::handleDef(MachineInstr &MI) {
   if (MRI->hasOneDef(defReg)) {
     // if the register has no use, then we do not allocate it
     if (MRI->use_nodbg_empty(defReg)) {
-      regAssignments.insert(std::pair<unsigned, StackAssignment>(
-          defReg, {NO_ALLOCATION, 0}));
+      recordAssignment(defReg, {NO_ALLOCATION, 0});
       LLVM_DEBUG(dbgs() << "    Allocating %"
                         << Register::virtReg2Index(defReg)
                         << " to NO_ALLOCATION.\n");
-      insertPopAfter(MI);
+      if (inHaltingBlock) {
+        ++NumHaltingCleanupsDropped;
+        stack.push(defReg);
+      } else {
+        insertPopAfter(MI);
+      }
       return;
     }
 
     // LOCAL case
     if (defIsLocal(MI)) {
       // record assignment
-      regAssignments.insert(
-          std::pair<unsigned, StackAssignment>(defReg, {L_STACK, 0}));
+      recordAssignment(defReg, {L_STACK, 0});
       LLVM_DEBUG(dbgs() << "    Allocating %"
                         << Register::virtReg2Index(defReg)
                         << " to LOCAL STACK.\n");
@@ -787,8 +928,7 @@ void EVMStackAlloc::handleDef(MachineInstr &MI) {
     // This could greatly benefit from a stack machine specific optimization.
     if (false && liveIntervalWithinSameEdgeSet(defReg)) {
       // it is a def register, so we only care about out-going edges.
-      regAssignments.insert(
-          std::pair<unsigned, StackAssignment>(defReg, {X_STACK, 0}));
+      recordAssignment(defReg, {X_STACK, 0});
 
       LLVM_DEBUG(dbgs() << "    Allocating %"
                         << Register::virtReg2Index(defReg)
@@ -809,11 +949,16 @@ void EVMStackAlloc::handleDef(MachineInstr &MI) {
     }
   }
 
-  // Everything else goes to memory
-  currentStackStatus.M.insert(defReg);
-  unsigned slot = allocateMemorySlot(defReg);
-  regAssignments.insert(
-      std::pair<unsigned, StackAssignment>(defReg, {NONSTACK, slot}));
+  // Everything else goes to memory. A register with several definitions
+  // keeps the slot of the first one.
+  unsigned slot;
+  if (hasAssignment(defReg) && reserveMemorySlot(defReg, MI)) {
+    slot = regAssignments[defReg].slot;
+  } else {
+    currentStackStatus.M.insert(defReg);
+    slot = allocateMemorySlot(defReg);
+    recordAssignment(defReg, {NONSTACK, slot});
+  }
 
   insertStoreToMemoryAfter(defReg, MI, slot);
   LLVM_DEBUG({
@@ -877,8 +1022,8 @@ unsigned EVMStackAlloc::calculateUseRegs(MachineInstr &MI, std::vector<MOPUseTyp
 
     unsigned useReg = MOP.getReg();
     // get stack assignment
-    assert(regAssignments.find(useReg) != regAssignments.end());
-    StackAssignment SA = regAssignments.lookup(useReg);
+    assert(hasAssignment(useReg));
+    StackAssignment SA = regAssignments[useReg];
     assert(SA.region != NO_ALLOCATION && "Cannot see unused register use.");
 
     bool isMemUse = false;
@@ -987,7 +1132,7 @@ void EVMStackAlloc::insertStoreToMemoryAfter(unsigned reg, MachineInstr &MI,
           .addReg(reg)
           .addImm(memSlot);
   MBB->insertAfter(MachineBasicBlock::iterator(MI), putlocal);
-  LIS->InsertMachineInstrInMaps(*putlocal);
+  addUseSlot(reg, LIS->InsertMachineInstrInMaps(*putlocal).getRegSlot());
 
   // TODO: insert this new put local to LiveIntervals
   LLVM_DEBUG(dbgs() << "    >>> PUTLOCAL(" << memSlot << ") <= %"
@@ -1004,7 +1149,7 @@ void EVMStackAlloc::insertStoreToMemoryBefore(unsigned reg, MachineInstr &MI,
           .addReg(reg)
           .addImm(memSlot);
   MBB->insert(MachineBasicBlock::iterator(MI), putlocal);
-  LIS->InsertMachineInstrInMaps(*putlocal);
+  addUseSlot(reg, LIS->InsertMachineInstrInMaps(*putlocal).getRegSlot());
 
   // TODO: insert this new put local to LiveIntervals
   LLVM_DEBUG(dbgs() << "    >>> PUTLOCAL(" << memSlot << ") <= %"
@@ -1062,8 +1207,8 @@ bool EVMStackAlloc::handleSingleUse(MachineInstr &MI, const MachineOperand &MOP,
   unsigned useReg = MOP.getReg();
 
   // get stack assignment
-  assert(regAssignments.find(useReg) != regAssignments.end());
-  StackAssignment SA = regAssignments.lookup(useReg);
+  assert(hasAssignment(useReg));
+  StackAssignment SA = regAssignments[useReg];
   // we also do not care if we has determined we do not allocate it.
   if (SA.region == NO_ALLOCATION) {
     return false;
@@ -1124,43 +1269,98 @@ bool EVMStackAlloc::handleSingleUse(MachineInstr &MI, const MachineOperand &MOP,
 // return the allocated slot index of a memory
 unsigned EVMStackAlloc::allocateMemorySlot(unsigned reg) {
   assert(reg != 0 && "Incoming registers cannot be zero.");
-  // first, find if there is an empty slot:
-  unsigned slot = 0;
-  for (unsigned i = 0; i < memoryAssignment.size(); ++i) {
-    // here we let 0 represent an empty slot
-    if (memoryAssignment[i] == 0) {
-      memoryAssignment[i] = reg;
-      slot = i;
-      break;
+  unsigned slot;
+  // first, take the lowest empty slot if there is one. 0 in memoryAssignment
+  // represents an empty slot.
+  if (numFreeMemorySlots != 0) {
+    slot = freeMemorySlots.find_first();
+    freeMemorySlots.reset(slot);
+    --numFreeMemorySlots;
+    memoryAssignment[slot] = reg;
+  } else {
+    slot = memoryAssignment.size();
+    memoryAssignment.push_back(reg);
+    MFI->updateMemoryFrameSize(memoryAssignment.size());
+  }
+  memorySlotOf[reg] = slot;
+  return slot;
+}
+
+void EVMStackAlloc::deallocateMemorySlot(unsigned reg) {
+  unsigned slot = memorySlotOf[reg];
+  if (slot >= memoryAssignment.size() || memoryAssignment[slot] != reg) {
+    LLVM_DEBUG(dbgs() << "    Unfound register %"
+                      << Register::virtReg2Index(reg) << "\n");
+    llvm_unreachable("Cannot find allocated memory slot");
+  }
+
+  memoryAssignment[slot] = 0;
+  LLVM_DEBUG(dbgs() << "    deallocate %" << Register::virtReg2Index(reg)
+                    << " at memslot: " << slot << "\n");
+  if (freeMemorySlots.size() < memoryAssignment.size()) {
+    freeMemorySlots.resize(memoryAssignment.size());
+  }
+  freeMemorySlots.set(slot);
+  ++numFreeMemorySlots;
+
+  while (memoryAssignment.size() > 0 && memoryAssignment.back() == 0) {
+    memoryAssignment.pop_back();
+    freeMemorySlots.reset(memoryAssignment.size());
+    --numFreeMemorySlots;
+  }
+}
+
+// Put reg back into the slot it was given before, when it is defined again
+// by MI on a path that did not carry it. A register without uses after MI is
+// moved out of the way; returns false if the slot is still in use.
+bool EVMStackAlloc::reserveMemorySlot(unsigned reg, const MachineInstr &MI) {
+  StackAssignment SA = regAssignments[reg];
+  assert(SA.region == NONSTACK && "Redefined register is not in memory.");
+  unsigned slot = SA.slot;
+
+  if (slot < memoryAssignment.size() && memoryAssignment[slot] != reg &&
+      memoryAssignment[slot] != 0) {
+    unsigned occupant = memoryAssignment[slot];
+    SlotIndex MISlot = LIS->getInstructionIndex(MI).getRegSlot();
+    if (findNextUse(useSlots[occupant], MISlot)) {
+      return false;
     }
+    deallocateMemorySlot(occupant);
   }
 
-  if (slot == 0) {
-    memoryAssignment.push_back(reg);
+  if (slot >= memoryAssignment.size()) {
+    unsigned size = memoryAssignment.size();
+    memoryAssignment.resize(slot + 1, 0);
+    freeMemorySlots.resize(slot + 1);
+    freeMemorySlots.set(size, slot);
+    numFreeMemorySlots += slot - size;
     MFI->updateMemoryFrameSize(memoryAssignment.size());
-    return (memoryAssignment.size() - 1);
+  } else if (memoryAssignment[slot] == reg) {
+    return true;
   } else {
-    return slot;
+    freeMemorySlots.reset(slot);
+    --numFreeMemorySlots;
   }
-
+  memoryAssignment[slot] = reg;
+  memorySlotOf[reg] = slot;
+  return true;
 }
 
-void EVMStackAlloc::deallocateMemorySlot(unsigned reg) {
+// Replace the memory slots with those recorded for an edge set.
+void EVMStackAlloc::setMemorySlots(const MemorySlots &slots) {
+  memoryAssignment = slots;
+  freeMemorySlots.clear();
+  freeMemorySlots.resize(memoryAssignment.size());
+  numFreeMemorySlots = 0;
   for (unsigned i = 0; i < memoryAssignment.size(); ++i) {
-    if (reg == memoryAssignment[i]) {
-      memoryAssignment[i] = 0;
-      LLVM_DEBUG(dbgs() << "    deallocate %" << Register::virtReg2Index(reg)
-                        << " at memslot: " << i << "\n");
-      while (memoryAssignment.size() > 0 &&
-             memoryAssignment.back() == 0) {
-        memoryAssignment.pop_back();
-      }
-      return;
+    unsigned reg = memoryAssignment[i];
+    if (reg == 0) {
+      freeMemorySlots.set(i);
+      ++numFreeMemorySlots;
+    } else {
+      memorySlotOf[reg] = i;
     }
   }
-  LLVM_DEBUG(dbgs() << "    Unfound register %" << Register::virtReg2Index(reg)
-                    << "\n");
-  llvm_unreachable("Cannot find allocated memory slot");
 }
 
 unsigned EVMStackAlloc::allocateXRegion(unsigned setIndex, unsigned reg) {
@@ -1185,27 +1385,11 @@ bool EVMStackAlloc::hasUsesAfterInSameBB(unsigned reg, const MachineInstr &MI) c
     return false;
   }
 
+  // see if the next use is in the same BB.
   SlotIndex FstUse = LIS->getInstructionIndex(MI);
-
-  // iterate over uses and see if any use exists in the same BB.
-  for (MachineRegisterInfo::use_nodbg_iterator 
-       Use = MRI->use_nodbg_begin(reg),
-       E = MRI->use_nodbg_end();
-       Use != E; ++Use) {
-    
-    SlotIndex SI = LIS->getInstructionIndex(*Use->getParent());
-
-    SlotIndex EndOfMBBSI = LIS->getMBBEndIdx(Use->getParent()->getParent());
-
-    // Check if SI lies in between FstUSE and EndOfMBBSI
-    if (SlotIndex::isEarlierInstr(FstUse, SI) &&
-        SlotIndex::isEarlierInstr(SI, EndOfMBBSI)) {
-      return true;
-    }
-  }
-
-  // we cannot find a use after it in BB
-  return false;
+  SlotIndex EndOfMBBSI = LIS->getMBBEndIdx(MI.getParent());
+  const SlotIndex *SI = findNextUse(useSlots[reg], FstUse);
+  return SI && SlotIndex::isEarlierInstr(*SI, EndOfMBBSI);
 }
 
 unsigned EVMStackAlloc::getCurrentStackDepth() const {
@@ -1222,7 +1406,7 @@ void EVMStackAlloc::pruneStackDepth() {
 
   // First look at transfer stackœ:
   unsigned spillingCandidate = 0;
-  std::set<unsigned> *vecRegs;
+  RegSet *vecRegs;
   if (currentStackStatus.X.size() != 0) {
     vecRegs = &currentStackStatus.X;
   } else {
@@ -1231,18 +1415,17 @@ void EVMStackAlloc::pruneStackDepth() {
   spillingCandidate = findSpillingCandidate(*vecRegs);
   unsigned slot = allocateMemorySlot(spillingCandidate);
 
-  regAssignments.insert(std::pair<unsigned, StackAssignment>(spillingCandidate,
-                                                             {NONSTACK, slot}));
+  recordAssignment(spillingCandidate, {NONSTACK, slot});
 }
 
-unsigned EVMStackAlloc::findSpillingCandidate(std::set<unsigned> &vecRegs) const {
+unsigned EVMStackAlloc::findSpillingCandidate(RegSet &vecRegs) const {
   llvm_unreachable("unimplemented");
 }
 
 void EVMStackAlloc::getXStackRegion(unsigned edgeSetIndex,
                                     std::vector<unsigned> xRegion) const {
   // order is important
-  assert(edgeset2assignment.find(edgeSetIndex) != edgeset2assignment.end() &&
+  assert(edgeSetIndex < edgeset2assignment.size() &&
          "Cannot find edgeset index!");
   llvm_unreachable("not implemented");
   return;
@@ -1253,6 +1436,7 @@ bool EVMStackAlloc::runOnMachineFunction(MachineFunction &MF) {
   LIS = &getAnalysis<LiveIntervals>();
   MRI = &MF.getRegInfo();
   MFI = MF.getInfo<EVMMachineFunctionInfo>();
+  rematerializeConstants(MF);
   allocateRegistersToStack(MF);
   return true;
 }
@@ -1329,14 +1513,28 @@ void EVMStackAlloc::handleBinaryOpcode(EVMStackAlloc::MOPUseType op1, MOPUseType
 
   MachineOperand &MOP1 = MI.getOperand(op1.first + MI.getNumDefs());
   MachineOperand &MOP2 = MI.getOperand(op2.first + MI.getNumDefs());
-  handleOperandLiveness(op1.second, MOP1);
-  handleOperandLiveness(op2.second, MOP2);
-
   unsigned reg1 = op1.second.reg;
   unsigned reg2 = op2.second.reg;
+
+  handleOperandLiveness(op1.second, MOP1);
+  if (reg2 != reg1)
+    handleOperandLiveness(op2.second, MOP2);
+
   StackAssignment SA1 = getStackAssignment(reg1);
   StackAssignment SA2 = getStackAssignment(reg2);
 
+  // The same register in both operands: one copy to the top, and a DUP1.
+  if (reg1 == reg2 && SA1.region != NONSTACK) {
+    assert(SA1.region != NO_ALLOCATION);
+    LLVM_DEBUG({ dbgs() << "    Case 0 (reg1 == reg2 on stack)\n"; });
+    if (regIsLastUse(MOP1))
+      SwapRegToTop(reg1, MI);
+    else
+      DupRegToTop(reg1, MI);
+    insertDupBefore(1, MI);
+    return;
+  }
+
   if (SA1.region == NONSTACK && SA2.region == NONSTACK) {
     LLVM_DEBUG({
       dbgs() << "    Case 1 (reg1, reg2 on memory)\n";
@@ -1397,6 +1595,14 @@ void EVMStackAlloc::handleBinaryOpcode(EVMStackAlloc::MOPUseType op1, MOPUseType
     bool lastUse1 = regIsLastUse(MOP1);
     bool lastUse2 = regIsLastUse(MOP2);
 
+    // Before a halt, dead operands may stay on the stack, so two DUPs do
+    // where bringing the operands into place takes three instructions.
+    if (inHaltingBlock && lastUse1 && depth2 != 1 &&
+        !(lastUse2 && depth1 == 1 && depth2 == 0)) {
+      lastUse1 = lastUse2 = false;
+      ++NumHaltingCleanupsDropped;
+    }
+
     if (lastUse1 && lastUse2) {
       // all last uses
       LLVM_DEBUG({ dbgs() << "(last use: 1, 2), "; });
@@ -14,14 +14,19 @@
 #include "EVM.h"
 #include "EVMTargetMachine.h"
 #include "EVMMachineFunctionInfo.h"
+#include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/IndexedMap.h"
+#include "llvm/ADT/IntEqClasses.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/SparseSet.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/CodeGen/LiveIntervals.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/CodeGen/TargetRegisterInfo.h"
 
 #include <algorithm>
 #include <memory>
@@ -67,20 +72,28 @@ public:
   Edge getEdge(unsigned edgeIndex) const;
   unsigned getEdgeSet(unsigned edgesetIndex) const;
 
+  // Edge sets are numbered from 0 to getNumEdgeSets() - 1.
+  unsigned getNumEdgeSets() const { return edgeSetClasses.getNumClasses(); }
+
   void reset() {
-    edgeIndex2EdgeSet.clear();
+    edges.clear();
     edgeIndex.clear();
+    edgeSetClasses.clear();
   }
 
   void dump() const;
   void printEdge(Edge edge) const;
 
 private:
-  // Index :: EdgeSet
-  std::map<unsigned, unsigned> edgeIndex2EdgeSet;   
-
   // Index : Edge
-  std::map<unsigned, Edge> edgeIndex;
+  std::vector<Edge> edges;
+
+  // Edge : Index
+  DenseMap<Edge, unsigned> edgeIndex;
+
+  // Index :: EdgeSet, merged with union-find and compressed once all edge
+  // sets are known.
+  IntEqClasses edgeSetClasses;
 
   void collectEdges(MachineFunction *MF);
 
@@ -121,6 +134,8 @@ public:
   }
 
   void clear() {
+    for (unsigned reg : stackElements)
+      positions[reg] = {};
     stackElements.clear();
     sizeOfXRegion = 0;
   }
@@ -137,16 +152,28 @@ public:
   void instantiateXRegionStack(std::vector<unsigned> &stack) {
     assert(getStackDepth() == 0);
     for (auto element : stack) {
-      stackElements.push_back(element);
+      push(element);
     }
     sizeOfXRegion = stack.size();
   }
 
 private:
+  // Where a register is on the stack, so that its depth is found without a
+  // scan. A register that was DUPed is on the stack more than once.
+  struct RegPosition {
+    unsigned top = 0;   // position of the topmost copy, from the bottom
+    unsigned count = 0; // number of copies
+  };
+
   // stack arrangements.
   std::vector<unsigned> stackElements;
+  IndexedMap<RegPosition, VirtReg2IndexFunctor> positions;
+
+  unsigned sizeOfXRegion = 0;
 
-  unsigned sizeOfXRegion;
+  void addElement(unsigned reg);
+  // Find the topmost copy of a register again after the old one moved.
+  void updateTop(unsigned reg);
 };
 
 class EVMStackAlloc : public MachineFunctionPass {
@@ -174,14 +201,19 @@ public:
                        std::vector<unsigned> xRegion) const;
   
 private:
+  typedef SparseSet<unsigned, VirtReg2IndexFunctor> RegSet;
+
   typedef struct {
-    std::set<unsigned> X; // Transfer Stack
-    std::set<unsigned> L; // Local Stack
-    std::set<unsigned> M; // Memory
-    void reset() {
+    RegSet X; // Transfer Stack
+    RegSet L; // Local Stack
+    RegSet M; // Memory
+    void reset(unsigned numVirtRegs) {
       X.clear();
       L.clear();
       M.clear();
+      X.setUniverse(numVirtRegs);
+      L.setUniverse(numVirtRegs);
+      M.setUniverse(numVirtRegs);
     }
   } StackStatus;
 
@@ -203,7 +235,12 @@ private:
   EdgeSets edgeSets;
 
   // record assignments of each virtual register 
-  DenseMap<unsigned, StackAssignment> regAssignments;
+  IndexedMap<StackAssignment, VirtReg2IndexFunctor> regAssignments;
+  BitVector assignedRegs;
+
+  // Slot indexes of the instructions using each virtual register, in
+  // program order, so that liveness queries need not walk the use lists.
+  IndexedMap<SmallVector<SlotIndex, 2>, VirtReg2IndexFunctor> useSlots;
 
   // Records register assignment info, used in symbolic execution.
   StackStatus currentStackStatus;
@@ -220,14 +257,32 @@ private:
 
   MemorySlots memoryAssignment;
 
+  // Map: register -> memory slot, and the empty slots of memoryAssignment.
+  IndexedMap<unsigned, VirtReg2IndexFunctor> memorySlotOf;
+  BitVector freeMemorySlots;
+  unsigned numFreeMemorySlots;
+
   // map: edgeset -> Stack Assignment
-  std::map<unsigned, EdgeSetAssignment> edgeset2assignment;
+  std::vector<EdgeSetAssignment> edgeset2assignment;
 
   EVMMachineFunctionInfo *MFI;
 
+  // The block being analyzed ends in a halting instruction, which discards
+  // the stack: dead values are left on it instead of being popped.
+  bool inHaltingBlock = false;
+
   void dumpMemoryStatus() const;
 
   void initialize();
+  bool rematerializeConstants(MachineFunction &F);
+  void collectUseSlots(MachineFunction &F);
+  void addUseSlot(unsigned reg, SlotIndex slot);
+
+  bool hasAssignment(unsigned reg) const {
+    return assignedRegs.test(Register::virtReg2Index(reg));
+  }
+  // Like a map insertion, keeps an existing assignment.
+  void recordAssignment(unsigned reg, StackAssignment SA);
 
   void consolidateXRegionForEdgeSet(unsigned edgeSet);
 
@@ -259,13 +314,11 @@ private:
   void SwapRegToTop(unsigned reg, MachineInstr &MI);
   void DupRegToTop(unsigned reg, MachineInstr &MI);
 
-  // helper function:
-  void assignRegister(unsigned reg, StackRegion region);
-  void removeRegisterAssignment(unsigned reg, StackRegion region);
-
   // for allocating 
   unsigned allocateMemorySlot(unsigned reg);
   void deallocateMemorySlot(unsigned reg);
+  bool reserveMemorySlot(unsigned reg, const MachineInstr &MI);
+  void setMemorySlots(const MemorySlots &slots);
 
   unsigned allocateXRegion(unsigned setIndex, unsigned reg);
 
@@ -278,7 +331,7 @@ private:
   unsigned getCurrentStackDepth() const; 
 
   void pruneStackDepth();
-  unsigned findSpillingCandidate(std::set<unsigned> &vecRegs) const;
+  unsigned findSpillingCandidate(RegSet &vecRegs) const;
 
   bool liveIntervalWithinSameEdgeSet(unsigned def);
 
@@ -28,6 +28,7 @@ void EVMSubtarget::anchor() {}
 EVMSubtarget &EVMSubtarget::initializeSubtargetDependencies(StringRef CPU,
                                                             StringRef FS) {
   // Determine default and user-specified characteristics
+  ParseSubtargetFeatures(CPU, FS);
   return *this;
 }
 
@@ -154,13 +154,18 @@ public:
             isMainFunction(*F)); // skip intrinsics.
   }
 
+  // The constructor is the entry of the init code, see EVMDeployCode.
   static bool isMainFunction(const Function &F) {
     return F.getName() == StringRef("solidity.main") ||
-           F.getName() == StringRef("main"); // skip intrinsics.
+           F.getName() == StringRef("main") ||
+           F.getName() == StringRef("solidity.constructor") ||
+           F.getName() == StringRef("constructor");
   }
 
   unsigned getFramePointer() const { return AllocatedGlobalSlots * 32; }
   unsigned getStackPointer() const { return getFramePointer() + 32; }
+  // The frame of a main function, which never moves.
+  unsigned getFrameBase() const { return getStackPointer() + 32; }
 };
 } // End llvm namespace
 
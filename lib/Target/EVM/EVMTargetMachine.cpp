@@ -18,11 +18,24 @@
 #include "llvm/CodeGen/TargetLoweringObjectFileImpl.h"
 #include "llvm/CodeGen/TargetPassConfig.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Target/TargetOptions.h"
+#include "llvm/Transforms/Instrumentation.h"
 using namespace llvm;
 
+static cl::opt<std::string> ProfileGenerate(
+    "evm-profile-generate",
+    cl::desc("Instrument the contract to log its block counters, and write "
+             "the map llvm-evm-run needs to read them to the given file"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<std::string>
+    ProfileUse("evm-profile-use",
+               cl::desc("Optimize the contract with the given .profdata file"),
+               cl::value_desc("filename"), cl::init(""));
+
 extern "C" void LLVMInitializeEVMTarget() {
   RegisterTargetMachine<EVMTargetMachine> Y(getTheEVMTarget());
   auto PR = PassRegistry::getPassRegistry();
@@ -32,6 +45,14 @@ extern "C" void LLVMInitializeEVMTarget() {
   initializeEVMShrinkpushPass(*PR);
   initializeEVMArgumentMovePass(*PR);
   initializeEVMExpandPseudosPass(*PR);
+  initializeEVMPackGlobalsPass(*PR);
+  initializeEVMGasEstimationPass(*PR);
+  initializeEVMMergeRevertsPass(*PR);
+  initializeEVMCodeGenPartitionPass(*PR);
+  initializeEVMDeployCodePass(*PR);
+  initializeEVMMemoryPlanPass(*PR);
+  initializeEVMInstrProfilingPass(*PR);
+  initializeEVMArgumentOrderPass(*PR);
 }
 
 static std::string computeDataLayout(const Triple &TT) {
@@ -58,6 +79,11 @@ EVMTargetMachine::EVMTargetMachine(const Target &T, const Triple &TT,
       TLOF(std::make_unique<EVMELFTargetObjectFile>()),
       Subtarget(TT, CPU, FS, *this) {
   initAsmInfo();
+
+  // The outliner only runs by default on contracts over the EIP-170 code
+  // size limit, see EVMInstrInfo::shouldOutlineFromFunctionByDefault.
+  setMachineOutliner(true);
+  setSupportsDefaultOutlining(true);
 }
 
 namespace {
@@ -91,8 +117,33 @@ TargetPassConfig *EVMTargetMachine::createPassConfig(PassManagerBase &PM) {
 }
 
 void EVMPassConfig::addIRPasses() {
+  // profile the contract with llvm-evm-run, or use such a profile.
+  if (!ProfileGenerate.empty()) {
+    addPass(createPGOInstrumentationGenLegacyPass());
+    addPass(createEVMInstrProfiling(ProfileGenerate));
+  } else if (!ProfileUse.empty()) {
+    addPass(createPGOInstrumentationUseLegacyPass(ProfileUse));
+  }
+
   TargetPassConfig::addIRPasses();
   //addPass(createEVMCallTransformation());
+
+  // share 256-bit slots between narrow globals.
+  if (getOptLevel() != CodeGenOpt::None) {
+    addPass(createEVMPackGlobals());
+
+    // order the arguments of internal functions for the stack allocator.
+    addPass(createEVMArgumentOrder());
+
+    // share revert blocks and move them out of the happy path.
+    addPass(createEVMMergeReverts());
+  }
+
+  // split a contract into init code and runtime code.
+  addPass(createEVMDeployCode());
+
+  // with llc -codegen-threads, keep only this code generator's functions.
+  addPass(createEVMCodeGenPartition());
 }
 
 bool EVMPassConfig::addInstSelector() {
@@ -123,6 +174,9 @@ void EVMPassConfig::addPreEmitPass() {
     addPass(createEVMVRegToMem());
   }
 
+  // place the frames of callees as low as the live memory slots allow.
+  addPass(createEVMMemoryPlan());
+
 
   // We use a custom pass to expand pseudos at a later pahse
   addPass(createEVMExpandPseudos());
@@ -138,6 +192,9 @@ void EVMPassConfig::addPreEmitPass() {
 
   // some peepohole at the very end.
   addPass(createEVMFinalization());
+
+  // Static gas bounds of the final code, for remarks and -evm-gas-report.
+  addPass(createEVMGasEstimation());
 }
 
 void EVMPassConfig::addPreRegAlloc() {
@@ -6,12 +6,16 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "MCTargetDesc/EVMFixupKinds.h"
 #include "MCTargetDesc/EVMMCTargetDesc.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCAsmLayout.h"
 #include "llvm/MC/MCAssembler.h"
 #include "llvm/MC/MCContext.h"
 #include "llvm/MC/MCFixup.h"
+#include "llvm/MC/MCFixupKindInfo.h"
+#include "llvm/MC/MCInst.h"
 #include "llvm/MC/MCObjectWriter.h"
 #include "llvm/Support/EndianStream.h"
 #include "llvm/Support/CommandLine.h"
@@ -39,7 +43,7 @@ public:
 
   // When generating EVM Metadata for assembly source files this emits the EVM 
   // sections.
-  static void Emit(const MCAssembler &Asm) {
+  static void Emit(const MCAssembler &Asm, const MCAsmLayout &Layout) {
     if (EVMMetadataFile.empty()) {
       // TODO: change it to an appropriate name
       EVMMetadataFile = "EVMMeta.txt";
@@ -62,28 +66,22 @@ public:
     for (MCAssembler::const_symbol_iterator it = Asm.symbol_begin(),
                                             ie = Asm.symbol_end();
          it != ie; ++it) {
+      // Offsets are relative to the section, as relaxation splits sections
+      // into several fragments.
+      uint64_t Offset = 0;
+      Layout.getSymbolOffset(*it, Offset);
       os << "\t{ \"SymbolName\": \"";
       os << it->getName();
-      os << "\", \"Offset\": \"" << it->getOffset() << "\" }\n";
+      os << "\", \"Offset\": \"" << Offset << "\" }\n";
     }
     // Get content size
     {
       os << "\t{ \"Section Info\": \n";
       os << "\t\t[\n";
       for (MCSection &sec : Asm) {
-        size_t sec_size = 0;
         os << "\t\t\t{ \"begin_symbol\": \"" << sec.getBeginSymbol()->getName() << "\",\n";
         os << "\t\t\t  \"size\": ";
-        for (MCFragment &Frag : sec) {
-          if (auto *DataFrag = dyn_cast<MCDataFragment>(&Frag)) {
-            sec_size += DataFrag->getContents().size();
-          } else if (auto *DataFrag = dyn_cast<MCAlignFragment>(&Frag)) {
-            continue;
-          } else {
-            llvm_unreachable("EVM does not generate other fragments.");
-          }
-        }
-        os << "\t\t\t  " << sec_size << "}\n";
+        os << "\t\t\t  " << Layout.getSectionAddressSize(&sec) << "}\n";
       }
       os << "\t\t],\n";
       os << "\t}\n";
@@ -109,22 +107,30 @@ public:
     std::unique_ptr<MCObjectTargetWriter>
     createObjectTargetWriter() const override;
 
-    // No instruction requires relaxation
-    bool fixupNeedsRelaxation(const MCFixup &Fixup, uint64_t Value,
-                              const MCRelaxableFragment *DF,
-                              const MCAsmLayout &Layout) const override {
-      return false;
-    }
+    const MCFixupKindInfo &getFixupKindInfo(MCFixupKind Kind) const override;
 
-    unsigned getNumFixupKinds() const override { return 1; }
+    unsigned getNumFixupKinds() const override {
+      return EVM::NumTargetFixupKinds;
+    }
 
+    // Label pushes start as PUSH1 and grow until the offset fits.
     bool mayNeedRelaxation(const MCInst &Inst,
-                           const MCSubtargetInfo &STI) const override {
-      return false;
-    }
+                           const MCSubtargetInfo &STI) const override;
+
+    bool fixupNeedsRelaxation(const MCFixup &Fixup, uint64_t Value,
+                              const MCRelaxableFragment *DF,
+                              const MCAsmLayout &Layout) const override;
+
+    // Label pushes are absolute, which the generic code never counts as
+    // resolved; their value is known once the label is laid out.
+    bool fixupNeedsRelaxationAdvanced(const MCFixup &Fixup, bool Resolved,
+                                      uint64_t Value,
+                                      const MCRelaxableFragment *DF,
+                                      const MCAsmLayout &Layout,
+                                      const bool WasForced) const override;
 
     void relaxInstruction(const MCInst &Inst, const MCSubtargetInfo &STI,
-                          MCInst &Res) const override {}
+                          MCInst &Res) const override;
 
     bool writeNopData(raw_ostream &OS, uint64_t Count) const override;
 
@@ -132,7 +138,7 @@ public:
 
   private:
     void applyFixupValue(MutableArrayRef<char> &Contents, size_t Offset,
-                         uint16_t Value) const;
+                         uint64_t Value, unsigned Size = 2) const;
 };
 
 } // end anonymous namespace
@@ -141,43 +147,77 @@ bool EVMAsmBackend::writeNopData(raw_ostream &OS, uint64_t Count) const {
   return true;
 }
 
+const MCFixupKindInfo &
+EVMAsmBackend::getFixupKindInfo(MCFixupKind Kind) const {
+  const static MCFixupKindInfo Infos[EVM::NumTargetFixupKinds] = {
+      // This table *must* be in the order that the fixup_* kinds are defined
+      // in EVMFixupKinds.h.
+      //
+      // Name                      Offset (bits) Size (bits)     Flags
+      {"fixup_push1", 0, 8, 0},
+      {"fixup_push2", 0, 16, 0},
+      {"fixup_push3", 0, 24, 0},
+  };
+
+  if (Kind < FirstTargetFixupKind)
+    return MCAsmBackend::getFixupKindInfo(Kind);
+
+  assert(unsigned(Kind - FirstTargetFixupKind) < getNumFixupKinds() &&
+         "Invalid kind!");
+  return Infos[Kind - FirstTargetFixupKind];
+}
+
+bool EVMAsmBackend::mayNeedRelaxation(const MCInst &Inst,
+                                      const MCSubtargetInfo &STI) const {
+  return (Inst.getOpcode() == EVM::PUSH1 || Inst.getOpcode() == EVM::PUSH2) &&
+         Inst.getNumOperands() == 1 && Inst.getOperand(0).isExpr();
+}
+
+bool EVMAsmBackend::fixupNeedsRelaxation(const MCFixup &Fixup, uint64_t Value,
+                                         const MCRelaxableFragment *DF,
+                                         const MCAsmLayout &Layout) const {
+  return Value >> (8 * EVM::getPushFixupSize(Fixup.getKind())) != 0;
+}
+
+bool EVMAsmBackend::fixupNeedsRelaxationAdvanced(
+    const MCFixup &Fixup, bool Resolved, uint64_t Value,
+    const MCRelaxableFragment *DF, const MCAsmLayout &Layout,
+    const bool WasForced) const {
+  if (!Resolved) {
+    // Offsets are relative to the section of the label, such as the runtime
+    // code for pushes in the init code. Layout is repeated until no push
+    // grows, so the value of a defined label is good here.
+    MCValue Target;
+    if (!Fixup.getValue()->evaluateAsRelocatable(Target, &Layout, &Fixup) ||
+        !Target.getSymA() || Target.getSymB())
+      return true;
+    if (!Target.getSymA()->getSymbol().isInSection())
+      return true;
+  }
+  return fixupNeedsRelaxation(Fixup, Value, DF, Layout);
+}
+
+void EVMAsmBackend::relaxInstruction(const MCInst &Inst,
+                                     const MCSubtargetInfo &STI,
+                                     MCInst &Res) const {
+  // Grow by one byte at a time; layout is iterated until nothing changes.
+  Res = Inst;
+  Res.setOpcode(Inst.getOpcode() == EVM::PUSH1 ? EVM::PUSH2 : EVM::PUSH3);
+}
+
 void EVMAsmBackend::applyFixupValue(MutableArrayRef<char> &Contents,
-                                    size_t Offset, uint16_t Value) const {
+                                    size_t Offset, uint64_t Value,
+                                    unsigned Size) const {
   if (DebugOffset != 0) {
     LLVM_DEBUG(dbgs() << "Artifically adding " << DebugOffset
                       << " to all Fixup relocation.\n";);
   }
-  support::endian::write<uint16_t>(&Contents[Offset + DebugOffset],
-                                   static_cast<uint16_t>(Value), Endian);
+  for (unsigned I = 0; I != Size; ++I)
+    Contents[Offset + DebugOffset + I] = uint8_t(Value >> (8 * (Size - 1 - I)));
 }
 
 void EVMAsmBackend::finish(const MCAssembler &Asm, MCAsmLayout &Layout) const {
-  MCGenEVMInfo::Emit(Asm);
-
-  // also fix up hidden variables such as deploy.size
-  for (MCAssembler::const_symbol_iterator it = Asm.symbol_begin(),
-                                          ie = Asm.symbol_end();
-       it != ie; ++it) {
-    if (it->getName() == "deploy.size") {
-      size_t offset = it->getOffset();
-
-      MCFragment* Frag = it->getFragment();
-      if (!Frag) {
-        llvm_unreachable("deploy.size should have a section.");
-      }
-      MCDataFragment *FragWithFixups = dyn_cast<MCDataFragment>(Frag);
-      if (!FragWithFixups) {
-        llvm_unreachable("deploy.size should be in a data frag.");
-      }
-
-      MutableArrayRef<char> Contents = FragWithFixups->getContents();
-      applyFixupValue(Contents, offset, Contents.size());
-
-      LLVM_DEBUG({
-        dbgs() << "deploy.size fixed to: " << Contents.size() << "./n";
-      });
-    }
-  }
+  MCGenEVMInfo::Emit(Asm, Layout);
 }
 
 void EVMAsmBackend::applyFixup(const MCAssembler &Asm, const MCFixup &Fixup,
@@ -185,10 +225,13 @@ void EVMAsmBackend::applyFixup(const MCAssembler &Asm, const MCFixup &Fixup,
                                MutableArrayRef<char> Data, uint64_t Value,
                                bool IsResolved,
                                const MCSubtargetInfo *STI) const {
-  assert(Fixup.getKind() == FK_SecRel_2);
-  assert(Value <= 0xFFFF);
+  unsigned Size = EVM::getPushFixupSize(Fixup.getKind());
+  if (Value >> (8 * Size))
+    Asm.getContext().reportError(Fixup.getLoc(),
+                                 "code offset does not fit in a PUSH" +
+                                     Twine(Size));
 
-  applyFixupValue(Data, Fixup.getOffset(), Value);
+  applyFixupValue(Data, Fixup.getOffset(), Value, Size);
 }
 
 std::unique_ptr<MCObjectTargetWriter>
@@ -6,6 +6,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "MCTargetDesc/EVMFixupKinds.h"
 #include "MCTargetDesc/EVMMCTargetDesc.h"
 #include "llvm/BinaryFormat/ELF.h"
 #include "llvm/MC/MCELFObjectWriter.h"
@@ -42,7 +43,9 @@ unsigned EVMELFObjectWriter::getRelocType(MCContext &Ctx, const MCValue &Target,
   switch ((unsigned)Fixup.getKind()) {
   default:
     llvm_unreachable("invalid fixup kind!");
-  case FK_SecRel_2:
+  case EVM::fixup_push1:
+  case EVM::fixup_push2:
+  case EVM::fixup_push3:
     return ELF::R_EVM_ADDR;
   }
 }
@@ -0,0 +1,42 @@
+//===-- EVMFixupKinds.h - EVM Specific Fixup Entries ------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_EVM_MCTARGETDESC_EVMFIXUPKINDS_H
+#define LLVM_LIB_TARGET_EVM_MCTARGETDESC_EVMFIXUPKINDS_H
+
+#include "llvm/MC/MCFixup.h"
+
+namespace llvm {
+namespace EVM {
+// The big-endian immediate of a PUSH of a code offset. The assembler starts
+// label pushes at PUSH1 and relaxes them to PUSH2 and PUSH3 as needed.
+enum Fixups {
+  fixup_push1 = FirstTargetFixupKind, // 8-bit offset
+  fixup_push2,                        // 16-bit offset
+  fixup_push3,                        // 24-bit offset
+
+  // Marker
+  LastTargetFixupKind,
+  NumTargetFixupKinds = LastTargetFixupKind - FirstTargetFixupKind
+};
+
+// Fixup for a label push with an immediate of Size bytes.
+inline MCFixupKind getPushFixupKind(unsigned Size) {
+  assert(Size >= 1 && Size <= 3 && "label pushes are 1 to 3 bytes");
+  return MCFixupKind(fixup_push1 + Size - 1);
+}
+
+// Immediate size of a label push fixup.
+inline unsigned getPushFixupSize(MCFixupKind Kind) {
+  assert(Kind >= fixup_push1 && Kind <= fixup_push3 && "not a push fixup");
+  return Kind - fixup_push1 + 1;
+}
+} // end namespace EVM
+} // end namespace llvm
+
+#endif
@@ -74,7 +74,8 @@ void EVMInstPrinter::printOperand(const MCInst *MI, unsigned OpNo,
     printExpr(Op.getExpr(), O);
     return;
   } else if (Op.isCImm()) {
-    O << Op.getCImm()->getValue();
+    // Stack words are unsigned.
+    Op.getCImm()->getValue().print(O, /*isSigned=*/false);
     return;
   }
   llvm_unreachable("unimplemented.");
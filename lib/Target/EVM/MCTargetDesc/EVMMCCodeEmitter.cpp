@@ -10,6 +10,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "MCTargetDesc/EVMFixupKinds.h"
 #include "MCTargetDesc/EVMMCTargetDesc.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/Constants.h"
@@ -145,20 +146,16 @@ void EVMMCCodeEmitter::encodeInstruction(const MCInst &MI, raw_ostream &OS,
   if (is_PUSH(Binary)) {
     assert(MI.getNumOperands() == 1);
     unsigned push_size = Binary - 0x60 + 1;
-    if (push_size > 8 && push_size != 32) {
-      // this is a reminder check for implementing proper encoding.
-      llvm_unreachable("unimplemented encoding size for Push.");
-    }
 
     auto &opnd = MI.getOperand(0);
     if (opnd.isImm() || opnd.isCImm()) {
       encodeImmediate(OS, opnd, push_size);
     } else {
-      assert(push_size == 2 && "Static Jump operands are 2 bytes");
       assert(opnd.isExpr() && "PUSH operand should be either Imm or Expr");
-      MCFixupKind Kind = MCFixupKind(FK_SecRel_2);
+      // Label pushes are relaxed by the assembler, from PUSH1 up to PUSH3.
+      MCFixupKind Kind = EVM::getPushFixupKind(push_size);
       // allocate space for fix up.
-      support::endian::write<uint16_t>(OS, 0x0000, support::big);
+      OS.write_zeros(push_size);
       Fixups.push_back(MCFixup::create(1, opnd.getExpr(), Kind, MI.getLoc()));
     }
   }
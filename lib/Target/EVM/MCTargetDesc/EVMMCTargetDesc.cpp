@@ -33,6 +33,28 @@
 
 using namespace llvm;
 
+bool EVM::hasDynamicGas(unsigned Opcode) {
+  switch (Opcode) {
+  default:
+    return false;
+  case EVM::EXP:
+  case EVM::SHA3:
+  case EVM::CALLDATACOPY:
+  case EVM::CODECOPY:
+  case EVM::EXTCODECOPY:
+  case EVM::RETURNDATACOPY:
+  case EVM::SSTORE:
+  case EVM::CALL:
+  case EVM::CALLNODE:
+  case EVM::DELEGATECALL:
+  case EVM::STATICCALL:
+  case EVM::CREATE:
+  case EVM::CREATE2:
+  case EVM::SELFDESTRUCT:
+    return true;
+  }
+}
+
 static MCInstrInfo *createEVMMCInstrInfo() {
   MCInstrInfo *X = new MCInstrInfo();
   InitEVMMCInstrInfo(X);
@@ -15,6 +15,7 @@
 
 #include "llvm/Config/config.h"
 #include "llvm/Support/DataTypes.h"
+#include "llvm/MC/MCInstrDesc.h"
 #include "llvm/MC/MCStreamer.h"
 #include "llvm/MC/MCSubtargetInfo.h"
 #include "llvm/MC/MCObjectWriter.h"
@@ -56,6 +57,41 @@ std::unique_ptr<MCObjectTargetWriter> createEVMObjectWriter();
 
 MCTargetStreamer *
 createEVMObjectTargetStreamer(MCStreamer &S, const MCSubtargetInfo &STI);
+
+namespace EVMII {
+  // Target specific instruction flags, see EVMInstrFormats.td.
+  enum {
+    GasCostMask = 0xffffffff,
+    DeltaShift = 32,
+    AlphaShift = 37,
+    StackCountMask = 0x1f,
+  };
+}
+
+namespace EVM {
+  // The static gas cost of an instruction. For instructions whose cost
+  // depends on their operands this is only the fixed part.
+  inline unsigned getGasCost(const MCInstrDesc &Desc) {
+    return Desc.TSFlags & EVMII::GasCostMask;
+  }
+
+  // The number of stack items the stack form of an instruction removes and
+  // adds. DUPn and SWAPn count the items they reach as removed and added.
+  inline unsigned getStackDelta(const MCInstrDesc &Desc) {
+    return (Desc.TSFlags >> EVMII::DeltaShift) & EVMII::StackCountMask;
+  }
+  inline unsigned getStackAlpha(const MCInstrDesc &Desc) {
+    return (Desc.TSFlags >> EVMII::AlphaShift) & EVMII::StackCountMask;
+  }
+
+  // Whether the cost of an instruction also depends on its operands.
+  bool hasDynamicGas(unsigned Opcode);
+
+  // Gas needed to expand memory to the given number of words.
+  inline uint64_t getMemoryExpansionGas(uint64_t Words) {
+    return Words * 3 + Words * Words / 512;
+  }
+}
 }
 
 // Defines symbolic names for EVM registers.  This defines a mapping from
@@ -0,0 +1,57 @@
+; RUN: llc -mtriple=evm %s -stop-after=evm-argument-order -o - | FileCheck %s
+; RUN: llc -mtriple=evm %s -stop-after=evm-argument-order \
+; RUN:   -evm-disable-argument-order -o - | FileCheck %s --check-prefix=KEEP
+; RUN: llc -mtriple=evm -filetype=obj %s -o %t.o
+; RUN: llvm-evm-run --input=0x000000000000000000000000000000000000000000000000000000000000000500000000000000000000000000000000000000000000000000000000000000110000000000000000000000000000000000000000000000000000000000000028 %t.o \
+; RUN:   | FileCheck %s --check-prefix=EXEC
+
+declare i256 @llvm.evm.calldataload(i256)
+declare void @llvm.evm.mstore(i256, i256)
+declare void @llvm.evm.return(i256, i256)
+
+; The calls pass the arguments in the new order.
+; CHECK-LABEL: define void @main()
+; CHECK:       call i256 @f(i256 %c, i256 %a, i256 %b)
+; CHECK:       call i256 @g(i256 %a, i256 %b, i256 %c)
+; KEEP:        call i256 @f(i256 %a, i256 %b, i256 %c)
+
+; EXEC: 0x0000000000000000000000000000000000000000000000000000000000000287
+define void @main() {
+entry:
+  %a = call i256 @llvm.evm.calldataload(i256 0)
+  %b = call i256 @llvm.evm.calldataload(i256 32)
+  %c = call i256 @llvm.evm.calldataload(i256 64)
+  %r = call i256 @f(i256 %a, i256 %b, i256 %c)
+  %s = call i256 @g(i256 %a, i256 %b, i256 %c)
+  %t = add i256 %r, %s
+  call void @llvm.evm.mstore(i256 0, i256 %t)
+  call void @llvm.evm.return(i256 0, i256 32)
+  unreachable
+}
+
+; %c is used after the entry block and is stored first. %b and %a stay on
+; the stack in the order SUB uses them, %a on top as the SWAP that brings up
+; the return address moves it to the bottom.
+; CHECK-LABEL: define internal i256 @f(i256 %c, i256 %a, i256 %b)
+define internal i256 @f(i256 %a, i256 %b, i256 %c) noinline {
+entry:
+  %x = sub i256 %b, %a
+  %t = icmp ugt i256 %x, 10
+  br i1 %t, label %big, label %small
+
+big:
+  %z = add i256 %x, %c
+  ret i256 %z
+
+small:
+  ret i256 %c
+}
+
+; Other modules may call @g, so it keeps its order.
+; CHECK-LABEL: define i256 @g(i256 %a, i256 %b, i256 %c)
+define i256 @g(i256 %a, i256 %b, i256 %c) noinline {
+entry:
+  %x = sub i256 %c, %a
+  %y = mul i256 %x, %b
+  ret i256 %y
+}
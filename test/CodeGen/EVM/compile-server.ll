@@ -0,0 +1,44 @@
+; One server compiles several modules with one target machine; the second
+; request for the same input comes from the cache.
+; RUN: rm -rf %t.cache
+; RUN: llc -mtriple=evm -filetype=obj %s -o %t.ref
+; RUN: llc -mtriple=evm -filetype=obj %S/parallel-codegen.ll -o %t.other.ref
+; RUN: echo "%s %t.1" > %t.req
+; RUN: echo "%S/parallel-codegen.ll %t.other" >> %t.req
+; RUN: echo "%s %t.2" >> %t.req
+; RUN: llc -mtriple=evm -filetype=obj -compile-server \
+; RUN:   -compile-cache-dir=%t.cache < %t.req | FileCheck %s
+; RUN: cmp %t.ref %t.1
+; RUN: cmp %t.ref %t.2
+; RUN: cmp %t.other.ref %t.other
+
+; CHECK:      ok {{.*}}.1{{$}}
+; CHECK-NEXT: ok {{.*}}.other{{$}}
+; CHECK-NEXT: ok {{.*}}.2 (cached)
+
+; Other options miss the cache.
+; RUN: echo "%s %t.3" > %t.req
+; RUN: llc -mtriple=evm -O0 -filetype=obj -compile-server \
+; RUN:   -compile-cache-dir=%t.cache < %t.req | FileCheck %s --check-prefix=O0
+; O0: ok {{.*}}.3{{$}}
+
+; A failed request is answered and does not stop the server.
+; RUN: echo "%t.missing %t.4" > %t.req
+; RUN: echo "%s %t.5" >> %t.req
+; RUN: not llc -mtriple=evm -filetype=obj -compile-server < %t.req 2>%t.err \
+; RUN:   | FileCheck %s --check-prefix=ERR
+; RUN: FileCheck %s --check-prefix=DIAG < %t.err
+; ERR:      error {{.*}}.missing
+; ERR-NEXT: ok {{.*}}.5{{$}}
+; DIAG: error: {{.*}}.missing:
+
+declare void @llvm.evm.return(i256, i256)
+declare void @llvm.evm.mstore(i256, i256)
+
+define void @main() {
+entry:
+  call void @llvm.evm.mstore(i256 64, i256 128)
+  call void @llvm.evm.mstore(i256 0, i256 42)
+  call void @llvm.evm.return(i256 0, i256 32)
+  unreachable
+}
@@ -0,0 +1,63 @@
+; RUN: llc -mtriple=evm %s -o - | FileCheck %s
+; RUN: llc -mtriple=evm -filetype=obj %s -o %t
+; RUN: llvm-evm-run %t \
+; RUN:   --input 0x00000000000000000000000000000000000000000000000000000000000000000123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef \
+; RUN:   | FileCheck %s --check-prefix=EXEC
+
+; EXEC: 0x0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcd00
+
+declare i256 @llvm.evm.calldataload(i256)
+declare void @llvm.evm.mstore(i256, i256)
+declare void @llvm.evm.return(i256, i256)
+
+; The address mask is pushed again in each block that uses it instead of
+; going through a memory slot, and takes only the 20 bytes it needs. The mask
+; of the high bits is pushed complemented.
+; CHECK-LABEL: main:
+; CHECK:       PUSH20 1461501637330902918203684832716283019655932542975
+; CHECK:       JUMPI
+; CHECK:       LBB0_1:
+; CHECK:       PUSH20 1461501637330902918203684832716283019655932542975
+; CHECK:       LBB0_2:
+; CHECK:       PUSH1 255
+; CHECK-NEXT:  NOT
+; CHECK:       PUSH20 1461501637330902918203684832716283019655932542975
+define void @main() {
+entry:
+  %a = call i256 @llvm.evm.calldataload(i256 0)
+  %b = call i256 @llvm.evm.calldataload(i256 32)
+  %x = and i256 %b, 1461501637330902918203684832716283019655932542975
+  call void @llvm.evm.mstore(i256 1024, i256 %x)
+  %c = icmp eq i256 %a, 0
+  br i1 %c, label %t, label %f
+t:
+  %v = and i256 %a, 1461501637330902918203684832716283019655932542975
+  call void @llvm.evm.mstore(i256 1056, i256 %v)
+  br label %f
+f:
+  %y = and i256 %a, 1461501637330902918203684832716283019655932542975
+  %z = and i256 %b, -256
+  %w = xor i256 %y, %z
+  call void @llvm.evm.mstore(i256 0, i256 %w)
+  call void @llvm.evm.return(i256 0, i256 32)
+  unreachable
+}
+
+; Under optsize a wide constant is kept in a memory slot instead.
+; CHECK-LABEL: small:
+; CHECK:       PUSH20 1461501637330902918203684832716283019655932542975
+; CHECK:       MSTORE{{.*}}putlocal
+; CHECK:       JUMPDEST
+; CHECK-NOT:   PUSH20
+; CHECK:       MLOAD{{.*}}putlocal
+define i256 @small(i256 %a, i256 %b) optsize noinline {
+entry:
+  %x = and i256 %b, 1461501637330902918203684832716283019655932542975
+  %c = icmp eq i256 %a, 0
+  br i1 %c, label %t, label %f
+t:
+  %y = and i256 %a, 1461501637330902918203684832716283019655932542975
+  ret i256 %y
+f:
+  ret i256 %x
+}
@@ -0,0 +1,70 @@
+; RUN: llc -mtriple=evm %s -o - | FileCheck %s
+; RUN: llc -mtriple=evm -filetype=obj %s -o %t
+; RUN: llvm-evm-run --deploy --print-gas %t \
+; RUN:   --input 0x0000000000000000000000000000000000000000000000000000000000000005 \
+; RUN:   | FileCheck %s --check-prefix=EXEC
+
+; The init code runs the constructor and returns the runtime code with the
+; immutable written into it.
+; EXEC:      runtime code: {{[0-9]+}} bytes
+; EXEC:      0x0000000000000000000000000000000000000000000000000000000000000039
+; EXEC-NEXT: status: return
+
+@owner = global i256 0 #0
+
+declare i256 @llvm.evm.calldataload(i256)
+declare void @llvm.evm.mstore(i256, i256)
+declare void @llvm.evm.return(i256, i256)
+
+; The runtime code reads the immutable from a placeholder.
+; CHECK-LABEL: main:
+; CHECK:       [[READ:Ltmp[0-9]+]]:
+; CHECK-NEXT:  .set evm.immutable.0, [[READ]]+1
+; CHECK-NEXT:  PUSH32 0
+; CHECK:       PUSH1 scale{{$}}
+define void @main() {
+entry:
+  %x = call i256 @llvm.evm.calldataload(i256 0)
+  %o = load i256, i256* @owner
+  %s = call i256 @scale(i256 %x)
+  %r = add i256 %o, %s
+  call void @llvm.evm.mstore(i256 0, i256 %r)
+  call void @llvm.evm.return(i256 0, i256 32)
+  unreachable
+}
+
+; Returning from the constructor copies the runtime code out of the code and
+; patches it.
+; CHECK:       .section .evm.init
+; CHECK-LABEL: constructor:
+; CHECK:       PUSH1 scale.deploy
+; CHECK-DAG:   MSIZE
+; CHECK-DAG:   PUSH1 evm.runtime.size
+; CHECK-DAG:   PUSH1 evm.runtime.offset
+; CHECK:       CODECOPY
+; CHECK:       PUSH1 evm.immutable.0
+; CHECK:       MSTORE
+; CHECK:       RETURN
+define void @constructor() {
+entry:
+  %v = call i256 @scale(i256 14)
+  store i256 %v, i256* @owner
+  ret void
+}
+
+; A function of both programs gets a copy in the init code.
+; CHECK:       .text
+; CHECK-LABEL: scale:
+; CHECK:       .section .evm.init
+; CHECK-LABEL: scale.deploy:
+define i256 @scale(i256 %x) noinline {
+  %r = mul i256 %x, 3
+  ret i256 %r
+}
+
+; CHECK:       .text
+; CHECK-NEXT:  evm.runtime.size:
+; CHECK-NEXT:  .section .evm.init
+; CHECK-NEXT:  evm.runtime.offset:
+
+attributes #0 = { "evm-immutable" }
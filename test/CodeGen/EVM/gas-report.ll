@@ -0,0 +1,54 @@
+; RUN: llc -mtriple=evm -evm-gas-report=%t.json -o /dev/null < %s
+; RUN: FileCheck %s --check-prefix=JSON < %t.json
+; RUN: llc -mtriple=evm -evm-gas-report=%t.yaml -evm-gas-report-format=yaml \
+; RUN:   -o /dev/null < %s
+; RUN: FileCheck %s --check-prefix=YAML < %t.yaml
+; RUN: llc -mtriple=evm -pass-remarks-analysis=evm-gas-estimation \
+; RUN:   -o /dev/null < %s 2>&1 | FileCheck %s --check-prefix=REMARK
+
+define i256 @straight(i256 %a, i256 %b) {
+entry:
+  %0 = add i256 %a, %b
+  %1 = mul i256 %0, %b
+  ret i256 %1
+}
+
+define i256 @loop(i256 %n) {
+entry:
+  br label %header
+
+header:
+  %i = phi i256 [ 0, %entry ], [ %i1, %header ]
+  %s = phi i256 [ 0, %entry ], [ %s1, %header ]
+  %s1 = add i256 %s, %i
+  %i1 = add i256 %i, 1
+  %c = icmp ult i256 %i1, %n
+  br i1 %c, label %header, label %exit
+
+exit:
+  ret i256 %s1
+}
+
+; JSON:      "function": "straight{{.*}}",
+; JSON-NEXT: "min": [[STRAIGHT:[0-9]+]],
+; JSON-NEXT: "max": [[STRAIGHT]],
+; JSON-NEXT: "exact": true,
+; JSON:      "loops": []
+; JSON:      "function": "loop{{.*}}",
+; JSON:      "exact": false,
+; JSON:      "loops": [
+; JSON-NEXT:   {
+; JSON-NEXT:     "header": "bb.1",
+; JSON-NEXT:     "depth": 1,
+; JSON-NEXT:     "gas_per_iteration": {{[1-9][0-9]*}}
+
+; YAML:      - function: straight{{.*}}
+; YAML-NEXT:   min: [[STRAIGHT:[0-9]+]]
+; YAML-NEXT:   max: [[STRAIGHT]]
+; YAML-NEXT:   exact: true
+; YAML:      - function: loop{{.*}}
+; YAML:        loops:
+; YAML-NEXT:     - { header: bb.1, depth: 1, gas_per_iteration: {{[1-9][0-9]*}} }
+
+; REMARK: remark: {{.*}}static gas [[MIN:[0-9]+]] to [[MIN]], memory expansion {{[0-9]+}}
+; REMARK: remark: {{.*}}loop costs {{[1-9][0-9]*}} gas per iteration
@@ -0,0 +1,58 @@
+; RUN: llc -mtriple=evm %s -o - | FileCheck %s
+; RUN: llc -mtriple=evm -filetype=obj %s -o %t
+; RUN: llvm-evm-run %t \
+; RUN:   --input 0x00000000000000000000000000000000000000000000000000000000000000050000000000000000000000000000000000000000000000000000000000000007 \
+; RUN:   | FileCheck %s --check-prefix=EXEC
+; RUN: not llvm-evm-run %t \
+; RUN:   --input 0x00000000000000000000000000000000000000000000000000000000000001f40000000000000000000000000000000000000000000000000000000000000007 \
+; RUN:   | FileCheck %s --check-prefix=REVERT
+
+; EXEC: 0x000000000000000000000000000000000000000000000000000000000000000c
+; REVERT: 0x00000000000000000000000000000000000000000000000000000000000001f4
+
+declare i256 @llvm.evm.calldataload(i256)
+declare void @llvm.evm.mstore(i256, i256)
+declare void @llvm.evm.return(i256, i256)
+declare void @llvm.evm.revert(i256, i256)
+
+; The stack is discarded when the code halts, so the dead values left by the
+; call are not popped before RETURN.
+; CHECK-LABEL: main:
+; CHECK:       LBB0_2:
+; CHECK:       GETPC
+; CHECK-NOT:   POP
+; CHECK:       RETURN
+define void @main() {
+entry:
+  %a = call i256 @llvm.evm.calldataload(i256 0)
+  %b = call i256 @llvm.evm.calldataload(i256 32)
+  %c = icmp ugt i256 %a, 100
+  br i1 %c, label %bad, label %good
+
+bad:
+  call void @fail(i256 %a, i256 %b)
+  unreachable
+
+good:
+  %s = call i256 @add(i256 %a, i256 %b)
+  call void @llvm.evm.mstore(i256 0, i256 %s)
+  call void @llvm.evm.return(i256 0, i256 32)
+  unreachable
+}
+
+define i256 @add(i256 %a, i256 %b) noinline {
+entry:
+  %s = add i256 %a, %b
+  ret i256 %s
+}
+
+; Neither the unused argument nor the return address is popped.
+; CHECK-LABEL: fail:
+; CHECK-NOT:   POP
+; CHECK:       REVERT
+define void @fail(i256 %code, i256 %unused) noinline {
+entry:
+  call void @llvm.evm.mstore(i256 0, i256 %code)
+  call void @llvm.evm.revert(i256 0, i256 32)
+  unreachable
+}
@@ -0,0 +1,59 @@
+; RUN: llc -mtriple=evm %s -o - | FileCheck %s
+; RUN: llc -mtriple=evm -O0 %s -o /dev/null -evm-memory-report=%t.json
+; RUN: FileCheck %s --check-prefix=REPORT < %t.json
+; RUN: llc -mtriple=evm -filetype=obj %s -o %t
+; RUN: llvm-evm-run %t \
+; RUN:   --input 0x00000000000000000000000000000000000000000000000000000000000000020000000000000000000000000000000000000000000000000000000000000005 \
+; RUN:   | FileCheck %s --check-prefix=EXEC
+
+; EXEC: 0x0000000000000000000000000000000000000000000000000000000000000021
+
+declare i256 @llvm.evm.calldataload(i256)
+declare void @llvm.evm.mstore(i256, i256)
+declare void @llvm.evm.return(i256, i256)
+
+; The frame of main is at the frame base, 128, so the frame of the callee is
+; pushed without loading the frame pointer.
+; CHECK-LABEL: main:
+; CHECK:       PUSH1 f
+; CHECK-NOT:   MLOAD
+; CHECK:       PUSH1 160
+; CHECK-NEXT:  DUP1
+; CHECK-NEXT:  PUSH1 0
+; CHECK-NEXT:  MSTORE
+define void @main() {
+entry:
+  %a = call i256 @llvm.evm.calldataload(i256 0)
+  %b = call i256 @llvm.evm.calldataload(i256 32)
+  %r = call i256 @f(i256 %a, i256 %b)
+  call void @llvm.evm.mstore(i256 0, i256 %r)
+  call void @llvm.evm.return(i256 0, i256 32)
+  unreachable
+}
+
+; Only the slots still read after a call are kept below the callee frame.
+; REPORT:      "function": "main",
+; REPORT-NEXT: "entry": true,
+; REPORT-NEXT: "frame_words": 8,
+; REPORT-NEXT: "calls": 1,
+; REPORT-NEXT: "peak_bytes": 576
+; REPORT:      "function": "f",
+; REPORT-NEXT: "entry": false,
+; REPORT-NEXT: "frame_words": 8,
+; REPORT-NEXT: "calls": 2,
+; REPORT-NEXT: "peak_words": 10
+define i256 @f(i256 %a, i256 %b) noinline {
+entry:
+  %x = call i256 @g(i256 %a)
+  %y = add i256 %x, %b
+  %z = call i256 @g(i256 %y)
+  ret i256 %z
+}
+
+; REPORT:      "function": "g",
+; REPORT:      "peak_words": 4
+define i256 @g(i256 %v) noinline {
+entry:
+  %r = mul i256 %v, 3
+  ret i256 %r
+}
@@ -0,0 +1,91 @@
+; RUN: opt -mtriple=evm -evm-merge-reverts -S < %s | FileCheck %s
+
+declare void @llvm.evm.mstore(i256, i256)
+declare void @llvm.evm.revert(i256, i256)
+
+; Error(string) with a 32-byte message: large enough to share.
+; CHECK-LABEL: define void @transfer(
+; CHECK:       br i1 %low, label %fail, label %checked, !prof [[COLD_TRUE:![0-9]+]]
+; CHECK:       br i1 %ok, label %done, label %fail, !prof [[COLD_FALSE:![0-9]+]]
+; CHECK:       done:
+; CHECK-NEXT:  ret void
+; CHECK:       fail:
+; CHECK-NEXT:  call void @evm.revert.0()
+; CHECK-NEXT:  unreachable
+; CHECK-NOT:   fail2:
+define void @transfer(i256 %a, i256 %b) {
+entry:
+  %low = icmp ult i256 %a, 10
+  br i1 %low, label %fail, label %checked
+fail:
+  call void @llvm.evm.mstore(i256 0, i256 3963877391197344453575983046348115674221700746820753546331534351508065746944)
+  call void @llvm.evm.mstore(i256 4, i256 32)
+  call void @llvm.evm.mstore(i256 36, i256 13)
+  call void @llvm.evm.mstore(i256 68, i256 31726036069281318419488233318290233098734306616785097587416358744160591953920)
+  call void @llvm.evm.revert(i256 0, i256 100)
+  unreachable
+checked:
+  %ok = icmp ult i256 %b, 10
+  br i1 %ok, label %done, label %fail2
+fail2:
+  call void @llvm.evm.mstore(i256 0, i256 3963877391197344453575983046348115674221700746820753546331534351508065746944)
+  call void @llvm.evm.mstore(i256 4, i256 32)
+  call void @llvm.evm.mstore(i256 36, i256 13)
+  call void @llvm.evm.mstore(i256 68, i256 31726036069281318419488233318290233098734306616785097587416358744160591953920)
+  call void @llvm.evm.revert(i256 0, i256 100)
+  unreachable
+done:
+  ret void
+}
+
+; CHECK-LABEL: define void @approve(
+; CHECK:       fail:
+; CHECK-NEXT:  call void @evm.revert.0()
+define void @approve(i256 %a) {
+entry:
+  %low = icmp ult i256 %a, 10
+  br i1 %low, label %fail, label %done
+fail:
+  call void @llvm.evm.mstore(i256 0, i256 3963877391197344453575983046348115674221700746820753546331534351508065746944)
+  call void @llvm.evm.mstore(i256 4, i256 32)
+  call void @llvm.evm.mstore(i256 36, i256 13)
+  call void @llvm.evm.mstore(i256 68, i256 31726036069281318419488233318290233098734306616785097587416358744160591953920)
+  call void @llvm.evm.revert(i256 0, i256 100)
+  unreachable
+done:
+  ret void
+}
+
+; A plain revert is cheaper than a call and stays in place; the two copies in
+; one function are still merged.
+; CHECK-LABEL: define void @small(
+; CHECK:       br i1 %c1, label %fail, label %next
+; CHECK:       br i1 %c2, label %fail, label %done
+; CHECK:       fail:
+; CHECK-NEXT:  call void @llvm.evm.revert(i256 0, i256 0)
+; CHECK-NOT:   fail2:
+define void @small(i256 %a) {
+entry:
+  %c1 = icmp eq i256 %a, 1
+  br i1 %c1, label %fail, label %next
+fail:
+  call void @llvm.evm.revert(i256 0, i256 0)
+  unreachable
+next:
+  %c2 = icmp eq i256 %a, 2
+  br i1 %c2, label %fail2, label %done
+fail2:
+  call void @llvm.evm.revert(i256 0, i256 0)
+  unreachable
+done:
+  ret void
+}
+
+; CHECK-LABEL: define internal void @evm.revert.0()
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:  call void @llvm.evm.mstore(i256 0,
+; CHECK:       call void @llvm.evm.revert(i256 0, i256 100)
+; CHECK-NEXT:  unreachable
+
+; CHECK: [[COLD_TRUE]] = !{!"branch_weights", i32 1, i32 2000}
+; CHECK: [[COLD_FALSE]] = !{!"branch_weights", i32 2000, i32 1}
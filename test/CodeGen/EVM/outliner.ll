@@ -0,0 +1,52 @@
+; RUN: llc -mtriple=evm -enable-machine-outliner < %s | FileCheck %s
+; RUN: llc -mtriple=evm -mattr=+subroutine -enable-machine-outliner < %s \
+; RUN:   | FileCheck %s --check-prefix=SUB
+; RUN: llc -mtriple=evm < %s | FileCheck %s --check-prefix=DEFAULT
+
+; Small contracts are only outlined on request; by default the outliner waits
+; for the EIP-170 code size limit.
+; DEFAULT-NOT: OUTLINED_FUNCTION
+
+declare void @llvm.evm.sstore(i256, i256)
+
+; The return address is pushed before the stub and the caller continues at
+; the JUMPDEST labelled with it.
+; CHECK-LABEL: first:
+; CHECK:       PUSH1 [[RET:Ltmp[0-9]+]]
+; CHECK-NEXT:  PUSH1 OUTLINED_FUNCTION_0
+; CHECK-NEXT:  JUMP
+; CHECK:       [[RET]]:
+; CHECK-NEXT:  JUMPDEST
+; SUB-LABEL:   first:
+; SUB:         PUSH1 OUTLINED_FUNCTION_0
+; SUB-NEXT:    JUMPSUB
+define void @first(i256 %a) nounwind {
+  call void @llvm.evm.sstore(i256 65536, i256 131072)
+  call void @llvm.evm.sstore(i256 65537, i256 131073)
+  call void @llvm.evm.sstore(i256 65538, i256 131074)
+  call void @llvm.evm.sstore(i256 65539, i256 131075)
+  call void @llvm.evm.sstore(i256 %a, i256 1)
+  ret void
+}
+
+; CHECK-LABEL: second:
+; CHECK:       PUSH1 OUTLINED_FUNCTION_0
+; SUB-LABEL:   second:
+; SUB:         PUSH1 OUTLINED_FUNCTION_0
+define void @second(i256 %a) nounwind {
+  call void @llvm.evm.sstore(i256 65536, i256 131072)
+  call void @llvm.evm.sstore(i256 65537, i256 131073)
+  call void @llvm.evm.sstore(i256 65538, i256 131074)
+  call void @llvm.evm.sstore(i256 65539, i256 131075)
+  call void @llvm.evm.sstore(i256 %a, i256 2)
+  ret void
+}
+
+; CHECK-LABEL: OUTLINED_FUNCTION_0:
+; CHECK:       JUMPDEST
+; CHECK:       SSTORE
+; CHECK:       JUMP
+; SUB-LABEL:   OUTLINED_FUNCTION_0:
+; SUB:         BEGINSUB
+; SUB:         SSTORE
+; SUB:         RETURNSUB
@@ -0,0 +1,67 @@
+; RUN: opt -mtriple=evm -evm-pack-globals -S < %s | FileCheck %s
+
+; Four i64 counters updated together share one slot and one store.
+@a = internal global i64 1
+@b = internal global i64 2
+@c = internal global i64 0
+@d = internal global i64 0
+
+; The address of @e escapes, so it keeps its own slot.
+@e = internal global i64 0
+
+; CHECK-NOT: @a =
+; CHECK: @e = internal global i64 0
+; CHECK: @evm.packed.0 = private global i256 36893488147419103233
+
+define void @bump() {
+; CHECK-LABEL: @bump(
+; CHECK: load i256, i256* @evm.packed.0
+; CHECK-NOT: load
+; CHECK: store i256 {{.*}}, i256* @evm.packed.0
+; CHECK-NOT: store
+; CHECK: ret void
+entry:
+  %a = load i64, i64* @a
+  %a1 = add i64 %a, 1
+  store i64 %a1, i64* @a
+  %b = load i64, i64* @b
+  %b1 = add i64 %b, 1
+  store i64 %b1, i64* @b
+  %c = load i64, i64* @c
+  %c1 = add i64 %c, 1
+  store i64 %c1, i64* @c
+  %d = load i64, i64* @d
+  %d1 = add i64 %d, 1
+  store i64 %d1, i64* @d
+  ret void
+}
+
+define i64 @read_c() {
+; CHECK-LABEL: @read_c(
+; CHECK: [[W:%.*]] = load i256, i256* @evm.packed.0
+; CHECK: [[S:%.*]] = lshr i256 [[W]], 128
+; CHECK: trunc i256 [[S]] to i64
+entry:
+  %c = load i64, i64* @c
+  ret i64 %c
+}
+
+declare void @callee()
+
+; A call may observe the slot, so the pending value is written back first.
+define void @store_around_call(i64 %x) {
+; CHECK-LABEL: @store_around_call(
+; CHECK: store i256 {{.*}}, i256* @evm.packed.0
+; CHECK-NEXT: call void @callee()
+; CHECK: load i256, i256* @evm.packed.0
+; CHECK: store i256 {{.*}}, i256* @evm.packed.0
+entry:
+  store i64 %x, i64* @a
+  call void @callee()
+  store i64 %x, i64* @b
+  ret void
+}
+
+define i64* @escape() {
+  ret i64* @e
+}
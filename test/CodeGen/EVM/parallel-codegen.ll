@@ -0,0 +1,62 @@
+; The output does not depend on the number of threads, only on the number of
+; partitions.
+; RUN: llc -mtriple=evm -filetype=obj -codegen-threads=1 -codegen-partitions=3 %s -o %t.1
+; RUN: llc -mtriple=evm -filetype=obj -codegen-threads=3 -codegen-partitions=3 %s -o %t.3
+; RUN: cmp %t.1 %t.3
+; RUN: llvm-evm-run %t.3 | FileCheck %s --check-prefix=EXEC
+; RUN: llc -mtriple=evm -codegen-threads=2 -codegen-partitions=3 %s -o - \
+; RUN:   | FileCheck %s
+; RUN: not llc -mtriple=evm -codegen-threads=2 -codegen-partitions=0 %s -o /dev/null 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=ERR
+
+; EXEC: 0x0000000000000000000000000000000000000000000000000000000000000019
+
+; ERR: -codegen-threads needs IR input for EVM
+
+declare void @llvm.evm.return(i256, i256)
+declare void @llvm.evm.mstore(i256, i256)
+
+; Calls into other partitions are resolved when the pieces are assembled.
+; CHECK-LABEL: main:
+; CHECK:       PUSH{{[0-9]+}} sum
+; CHECK:       PUSH{{[0-9]+}} twice
+define void @main() {
+entry:
+  call void @llvm.evm.mstore(i256 64, i256 128)
+  %a = call i256 @sum(i256 5)
+  %b = call i256 @twice(i256 5)
+  %r = add i256 %a, %b
+  call void @llvm.evm.mstore(i256 0, i256 %r)
+  call void @llvm.evm.return(i256 0, i256 32)
+  unreachable
+}
+
+; Block labels are numbered per code generator and get a partition suffix.
+; CHECK-LABEL: sum:
+; CHECK:       LBB{{[0-9_]+}}_p{{[0-9]}}:
+define i256 @sum(i256 %n) {
+entry:
+  %zero = icmp eq i256 %n, 0
+  br i1 %zero, label %done, label %calc
+calc:
+  %m = add i256 %n, 1
+  %p = mul i256 %n, %m
+  %h = lshr i256 %p, 1
+  ret i256 %h
+done:
+  ret i256 0
+}
+
+; CHECK-LABEL: twice:
+; CHECK:       LBB{{[0-9_]+}}_p{{[0-9]}}:
+define i256 @twice(i256 %x) {
+entry:
+  %big = icmp ugt i256 %x, 3
+  br i1 %big, label %double, label %done
+double:
+  %d = mul i256 %x, 2
+  br label %done
+done:
+  %r = phi i256 [ %d, %double ], [ %x, %entry ]
+  ret i256 %r
+}
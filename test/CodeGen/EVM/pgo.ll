@@ -0,0 +1,72 @@
+; RUN: llc -mtriple=evm %s -o - -evm-profile-generate=%t.map | FileCheck %s --check-prefix=GEN
+; RUN: llc -mtriple=evm -filetype=obj %s -o %t.o -evm-profile-generate=%t.map
+; RUN: FileCheck %s --check-prefix=MAP < %t.map
+; RUN: echo "a %t.o 0x0000000000000000000000000000000000000000000000000000000000000001" > %t.batch
+; RUN: echo "b %t.o 0x0000000000000000000000000000000000000000000000000000000000000001" >> %t.batch
+; RUN: echo "c %t.o 0x0000000000000000000000000000000000000000000000000000000000000001" >> %t.batch
+; RUN: echo "d %t.o 0x0000000000000000000000000000000000000000000000000000000000000007" >> %t.batch
+; RUN: echo "e %t.o 0x0000000000000000000000000000000000000000000000000000000000000005" >> %t.batch
+; RUN: llvm-evm-run --batch %t.batch --profile-map=%t.map \
+; RUN:   --profile-output=%t.profdata | FileCheck %s --check-prefix=EXEC
+; RUN: llvm-profdata show -all-functions -counts %t.profdata \
+; RUN:   | FileCheck %s --check-prefix=PROF
+; RUN: llc -mtriple=evm %s -o - -evm-profile-use=%t.profdata \
+; RUN:   | FileCheck %s --check-prefix=USE
+
+declare i256 @llvm.evm.calldataload(i256)
+declare void @llvm.evm.mstore(i256, i256)
+declare void @llvm.evm.return(i256, i256)
+
+; The counters are logged with the profile topic before the contract returns.
+; GEN-LABEL: main:
+; GEN:       PUSH16 144119793580054591822264613292158315621
+; GEN:       LOG1
+; GEN:       RETURN
+
+; MAP:      "counters": 4,
+; MAP:      "name": "main",
+; MAP-NEXT: "hash": "{{[0-9A-F]+}}",
+; MAP-NEXT: "offset": 0,
+; MAP-NEXT: "counters": 4
+
+; EXEC: a return {{[0-9]+}} 0x000000000000000000000000000000000000000000000000000000000000000a
+; EXEC: d return {{[0-9]+}} 0x0000000000000000000000000000000000000000000000000000000000000046
+; EXEC: e return {{[0-9]+}} 0x0000000000000000000000000000000000000000000000000000000000000000
+
+; PROF: main:
+; PROF: Counters: 4
+; PROF: Block counts: [0, 1, 3, 1]
+
+; The hot case is compared first.
+; USE-LABEL: main:
+; USE:       CALLDATALOAD
+; USE-NOT:   EQ
+; USE:       PUSH1 1
+; USE:       EQ
+define void @main() {
+entry:
+  %x = call i256 @llvm.evm.calldataload(i256 0)
+  switch i256 %x, label %other [
+    i256 1, label %one
+    i256 2, label %two
+    i256 7, label %seven
+  ]
+
+one:
+  br label %done
+
+two:
+  br label %done
+
+seven:
+  br label %done
+
+other:
+  br label %done
+
+done:
+  %r = phi i256 [ 10, %one ], [ 20, %two ], [ 70, %seven ], [ 0, %other ]
+  call void @llvm.evm.mstore(i256 0, i256 %r)
+  call void @llvm.evm.return(i256 0, i256 32)
+  unreachable
+}
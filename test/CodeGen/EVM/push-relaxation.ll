@@ -0,0 +1,70 @@
+; Label pushes start as PUSH1 and are relaxed by the assembler only when the
+; code offset needs more bytes.
+; RUN: llc -mtriple=evm -filetype=obj %s -o %t
+; RUN: llvm-evm-run --blocks %t | grep -B1 -E 'JUMPI?$' | FileCheck %s
+
+declare void @llvm.evm.sstore(i256, i256)
+
+; CHECK:      PUSH1 0x{{[0-9a-f]+$}}
+; CHECK-NEXT: JUMPI
+define i256 @small(i256 %n) nounwind {
+entry:
+  br label %loop
+loop:
+  %i = phi i256 [ 0, %entry ], [ %inc, %loop ]
+  %inc = add i256 %i, 1
+  %cmp = icmp ult i256 %inc, %n
+  br i1 %cmp, label %loop, label %exit
+exit:
+  ret i256 %inc
+}
+
+; The branches of @big are past the first 256 bytes.
+; CHECK:      PUSH2 0x{{[0-9a-f]{3,4}$}}
+; CHECK-NEXT: JUMPI
+; CHECK-NOT:  PUSH3
+define void @big(i256 %c) nounwind {
+entry:
+  call void @llvm.evm.sstore(i256 65536, i256 131072)
+  call void @llvm.evm.sstore(i256 65537, i256 131073)
+  call void @llvm.evm.sstore(i256 65538, i256 131074)
+  call void @llvm.evm.sstore(i256 65539, i256 131075)
+  call void @llvm.evm.sstore(i256 65540, i256 131076)
+  call void @llvm.evm.sstore(i256 65541, i256 131077)
+  call void @llvm.evm.sstore(i256 65542, i256 131078)
+  call void @llvm.evm.sstore(i256 65543, i256 131079)
+  call void @llvm.evm.sstore(i256 65544, i256 131080)
+  call void @llvm.evm.sstore(i256 65545, i256 131081)
+  call void @llvm.evm.sstore(i256 65546, i256 131082)
+  call void @llvm.evm.sstore(i256 65547, i256 131083)
+  call void @llvm.evm.sstore(i256 65548, i256 131084)
+  call void @llvm.evm.sstore(i256 65549, i256 131085)
+  call void @llvm.evm.sstore(i256 65550, i256 131086)
+  call void @llvm.evm.sstore(i256 65551, i256 131087)
+  call void @llvm.evm.sstore(i256 65552, i256 131088)
+  call void @llvm.evm.sstore(i256 65553, i256 131089)
+  call void @llvm.evm.sstore(i256 65554, i256 131090)
+  call void @llvm.evm.sstore(i256 65555, i256 131091)
+  call void @llvm.evm.sstore(i256 65556, i256 131092)
+  call void @llvm.evm.sstore(i256 65557, i256 131093)
+  call void @llvm.evm.sstore(i256 65558, i256 131094)
+  call void @llvm.evm.sstore(i256 65559, i256 131095)
+  call void @llvm.evm.sstore(i256 65560, i256 131096)
+  call void @llvm.evm.sstore(i256 65561, i256 131097)
+  call void @llvm.evm.sstore(i256 65562, i256 131098)
+  call void @llvm.evm.sstore(i256 65563, i256 131099)
+  call void @llvm.evm.sstore(i256 65564, i256 131100)
+  call void @llvm.evm.sstore(i256 65565, i256 131101)
+  call void @llvm.evm.sstore(i256 65566, i256 131102)
+  call void @llvm.evm.sstore(i256 65567, i256 131103)
+  %cmp = icmp eq i256 %c, 0
+  br i1 %cmp, label %a, label %b
+a:
+  call void @llvm.evm.sstore(i256 1, i256 1)
+  br label %exit
+b:
+  call void @llvm.evm.sstore(i256 2, i256 2)
+  br label %exit
+exit:
+  ret void
+}
@@ -0,0 +1,33 @@
+; RUN: llc -mtriple=evm -mattr=+subroutine -filetype=asm < %s | FileCheck %s
+; RUN: llc -mtriple=evm -filetype=asm < %s | FileCheck %s --check-prefix=NOSUB
+
+; With subroutine support functions are entered through BEGINSUB and return
+; with RETURNSUB; no return address is pushed on the data stack.
+
+define i256 @callee(i256 %a) nounwind noinline {
+; CHECK-LABEL: callee:
+; CHECK-NOT:   JUMPDEST
+; CHECK:       BEGINSUB
+; CHECK-NOT:   JUMP
+; CHECK:       RETURNSUB
+; NOSUB-LABEL: callee:
+; NOSUB:       JUMPDEST
+; NOSUB-NOT:   BEGINSUB
+; NOSUB:       JUMP
+  %r = add i256 %a, 1
+  ret i256 %r
+}
+
+define i256 @caller(i256 %a) nounwind {
+; CHECK-LABEL: caller:
+; CHECK-NOT:   GETPC
+; CHECK:       JUMPSUB
+; CHECK-NOT:   GETPC
+; CHECK:       RETURNSUB
+; NOSUB-LABEL: caller:
+; NOSUB:       GETPC
+; NOSUB:       JUMP
+; NOSUB-NEXT:  JUMPDEST
+  %r = call i256 @callee(i256 %a)
+  ret i256 %r
+}
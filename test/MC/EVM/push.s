@@ -0,0 +1,22 @@
+# RUN: llvm-mc -triple=evm -show-encoding %s | FileCheck %s
+# RUN: not llvm-mc -triple=evm %s --defsym=ERR=1 -o /dev/null 2>&1 \
+# RUN:   | FileCheck %s --check-prefix=ERR
+
+# CHECK: PUSH1 42 {{.*}}encoding: [0x60,0x2a]
+PUSH1 42
+# CHECK: PUSH2 258 {{.*}}encoding: [0x61,0x01,0x02]
+PUSH2 0x102
+# Literals are stack words and may be wider than 64 bits.
+# CHECK: PUSH9 18446744073709551616 {{.*}}encoding: [0x68,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00]
+PUSH9 0x10000000000000000
+# CHECK: ADD {{.*}}encoding: [0x01]
+ADD
+# CHECK: JUMPDEST {{.*}}encoding: [0x5b]
+JUMPDEST
+
+.ifdef ERR
+# ERR: [[@LINE+1]]:1: error: invalid instruction
+FROB
+# ERR: [[@LINE+1]]:1: error: too few operands for instruction
+PUSH1
+.endif
@@ -0,0 +1,6 @@
+define void @main() {
+entry:
+  %p = inttoptr i256 64 to i256*
+  store i256 1, i256* %p
+  ret void
+}
@@ -0,0 +1,7 @@
+declare void @llvm.evm.jump(i256)
+
+define void @main() {
+entry:
+  call void @llvm.evm.jump(i256 0)
+  unreachable
+}
@@ -0,0 +1,45 @@
+; RUN: llvm-evm-jit --print-lowered %s | FileCheck %s
+; RUN: not llvm-evm-jit --print-lowered %S/Inputs/jump.ll 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=JUMP
+; RUN: not llvm-evm-jit --print-lowered %S/Inputs/inttoptr.ll 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=INTTOPTR
+
+; JUMP: error: {{.*}}main: 'llvm.evm.jump' cannot run on the host
+; INTTOPTR: error: {{.*}}main: pointers made from integers cannot run on the host
+
+declare i256 @llvm.evm.calldataload(i256)
+declare void @llvm.evm.mstore(i256, i256)
+declare void @llvm.evm.return(i256, i256)
+
+; The operands go through a buffer of words, the result through another.
+; CHECK-LABEL: define void @main()
+; CHECK:       %evm.args = alloca [2 x i256]
+; CHECK:       %evm.result = alloca i256
+; CHECK:       [[ARGS:%.*]] = getelementptr inbounds [2 x i256], [2 x i256]* %evm.args, i32 0, i32 0
+; CHECK:       store i256 0, i256* [[ARG0:%.*]]
+; CHECK:       call void @__evm_calldataload(i256* %evm.result, i256* [[ARGS]])
+; CHECK:       %a = load i256, i256* %evm.result
+; CHECK:       call void @__evm_sdiv(i256* %evm.result, i256* [[ARGS]])
+; CHECK:       %q = load i256, i256* %evm.result
+; CHECK:       %r = urem i64
+; CHECK:       call void @__evm_mstore(i256* %evm.result, i256* [[ARGS]])
+; CHECK:       call void @__evm_return(i256* %evm.result, i256* [[ARGS]])
+; CHECK-NEXT:  unreachable
+
+; The intrinsics are gone.
+; CHECK-NOT:   declare {{.*}} @llvm.evm
+; CHECK:       declare void @__evm_calldataload(i256*, i256*)
+; CHECK-NOT:   declare {{.*}} @llvm.evm
+define void @main() {
+entry:
+  %a = call i256 @llvm.evm.calldataload(i256 0)
+  %b = call i256 @llvm.evm.calldataload(i256 32)
+  %q = sdiv i256 %a, %b
+  %a64 = trunc i256 %a to i64
+  %r = urem i64 %a64, 7
+  %r256 = zext i64 %r to i256
+  %s = add i256 %q, %r256
+  call void @llvm.evm.mstore(i256 0, i256 %s)
+  call void @llvm.evm.return(i256 0, i256 32)
+  unreachable
+}
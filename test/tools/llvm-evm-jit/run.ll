@@ -0,0 +1,54 @@
+; REQUIRES: host-backend
+; RUN: llc -mtriple=evm -filetype=obj %s -o %t.o
+; RUN: llvm-evm-jit %s --print-logs \
+; RUN:   --input=0x000000000000000000000000000000000000000000000000000000000000000b0000000000000000000000000000000000000000000000000000000000000003 \
+; RUN:   | FileCheck %s
+
+; CHECK:      0x0000000000000000000000000000000000000000000000000000000000000003
+; CHECK-NEXT: log 0x0000000000000000000000000000000000000000000000000000000000000002 data 0x
+
+; RUN: echo "div 0x000000000000000000000000000000000000000000000000000000000000000b0000000000000000000000000000000000000000000000000000000000000003" > %t.batch
+; RUN: echo "zero 0x000000000000000000000000000000000000000000000000000000000000000b" >> %t.batch
+; RUN: echo "empty" >> %t.batch
+; RUN: not llvm-evm-jit %s --batch=%t.batch --compare=%t.o 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=BATCH
+
+; The interpreter agrees on every case, a revert fails the run.
+; BATCH:     div Return 0x0000000000000000000000000000000000000000000000000000000000000003
+; BATCH:     zero Revert 0x
+; BATCH:     empty Revert 0x
+; BATCH-NOT: error
+
+; RUN: llvm-evm-jit %s --repeat=10 | FileCheck %s --check-prefix=REPEAT
+; REPEAT: 10 runs in {{.*}} s
+
+; RUN: echo -n "x" > %t.input
+; RUN: llvm-evm-jit-fuzzer %t.input -ignore_remaining_args=1 -ir=%s \
+; RUN:   -compare=%t.o 2>&1 | FileCheck %s --check-prefix=FUZZ
+; FUZZ: Running: {{.*}}.input
+
+declare i256 @llvm.evm.calldataload(i256)
+declare void @llvm.evm.mstore(i256, i256)
+declare void @llvm.evm.log1(i256, i256, i256)
+declare void @llvm.evm.return(i256, i256)
+declare void @llvm.evm.revert(i256, i256)
+
+define void @main() {
+entry:
+  %a = call i256 @llvm.evm.calldataload(i256 0)
+  %b = call i256 @llvm.evm.calldataload(i256 32)
+  %z = icmp eq i256 %b, 0
+  br i1 %z, label %fail, label %ok
+
+fail:
+  call void @llvm.evm.revert(i256 0, i256 0)
+  unreachable
+
+ok:
+  %r = udiv i256 %a, %b
+  %m = urem i256 %a, %b
+  call void @llvm.evm.log1(i256 0, i256 0, i256 %m)
+  call void @llvm.evm.mstore(i256 0, i256 %r)
+  call void @llvm.evm.return(i256 0, i256 32)
+  unreachable
+}
@@ -0,0 +1,40 @@
+# RUN: llvm-mca -mtriple=evm -iterations=3 -timeline -timeline-max-iterations=1 \
+# RUN:   -hotspots -instruction-info=false < %s | FileCheck %s
+
+# Increment the word at 0x40. Only the first iteration expands memory.
+
+PUSH1 0x40
+MLOAD
+PUSH1 1
+ADD
+PUSH1 0x40
+MSTORE
+
+# CHECK:      Iterations:        3
+# CHECK-NEXT: Instructions:      18
+# CHECK-NEXT: Total Gas:         63
+# CHECK-NEXT: Gas Per Iteration: 21.00
+# CHECK-NEXT: Memory Gas:        9
+# CHECK-EMPTY:
+# CHECK-NEXT: Stack Inputs:      0
+# CHECK-NEXT: Stack Peak:        +2
+# CHECK-NEXT: Stack Growth:      +0 per iteration
+
+# CHECK:      Gas Hotspots:
+# CHECK:      Index       Gas   Share  Instruction
+# CHECK-NEXT: [1]          18   28.6%  MLOAD
+# CHECK-NEXT: [0]           9   14.3%  PUSH1 64
+# CHECK-NEXT: [2]           9   14.3%  PUSH1 1
+# CHECK-NEXT: [3]           9   14.3%  ADD
+# CHECK-NEXT: [4]           9   14.3%  PUSH1 64
+# CHECK-NEXT: [5]           9   14.3%  MSTORE
+
+# CHECK:      Gas Timeline - number of iterations: 1
+# CHECK:      Index     Gas    Total  Stack  Instruction
+# CHECK-NEXT: [0,0]       3        3     +1  PUSH1 64
+# CHECK-NEXT: [0,1]      12       15     +1  MLOAD
+# CHECK-NEXT: [0,2]       3       18     +2  PUSH1 1
+# CHECK-NEXT: [0,3]       3       21     +1  ADD
+# CHECK-NEXT: [0,4]       3       24     +2  PUSH1 64
+# CHECK-NEXT: [0,5]       3       27     +0  MSTORE
+# CHECK-NOT:  [1,0]
@@ -0,0 +1,33 @@
+# RUN: llvm-mca -mtriple=evm -iterations=10 -instruction-info=false \
+# RUN:   -hotspots < %s | FileCheck %s
+# RUN: llvm-mca -mtriple=evm -iterations=250 -instruction-info=false < %s \
+# RUN:   | FileCheck %s --check-prefix=OVERFLOW
+
+# A kernel that reads three items below it, leaves one more on the stack on
+# every iteration, and has an instruction whose gas depends on its operands.
+
+# LLVM-MCA-BEGIN pow
+SWAP2
+DUP3
+EXP
+DUP1
+DUP1
+DUP1
+DUP1
+DUP1
+# LLVM-MCA-END
+
+# CHECK:      [0] Code Region - pow
+# CHECK:      Total Gas:         310
+# CHECK-NEXT: Gas Per Iteration: 31.00
+# CHECK-NEXT: Memory Gas:        0
+# CHECK-NEXT: Dynamic Gas:       1 instructions per iteration, not included
+# CHECK-EMPTY:
+# CHECK-NEXT: Stack Inputs:      3
+# CHECK-NEXT: Stack Peak:        +50
+# CHECK-NEXT: Stack Growth:      +5 per iteration
+# CHECK-NOT:  Stack Overflow
+
+# CHECK:      [2]         100   32.3%  EXP +
+
+# OVERFLOW: Stack Overflow:    the stack grows past 1024 items
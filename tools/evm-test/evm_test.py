@@ -5,13 +5,22 @@ from string import Template
 from random import seed, randint
 import subprocess
 import os
+import sys
 import json
 import argparse
+import tempfile
+from concurrent.futures import ThreadPoolExecutor
 
 import evm_testsuite
 
 parser = argparse.ArgumentParser( description = 'Option parser')
 parser.add_argument('--llc-path', dest='llc_path', action='store', default='llc')
+parser.add_argument('--evm-run-path', dest='evm_run_path', action='store',
+                    default=None,
+                    help='run the tests with llvm-evm-run instead of evm')
+parser.add_argument('-j', '--jobs', dest='jobs', type=int,
+                    default=os.cpu_count(),
+                    help='number of tests to compile in parallel')
 args = parser.parse_args()
 
 def execute_with_input_in_evm(code: str, input: str, expected: str) -> bool:
@@ -61,14 +70,15 @@ def generate_obj_file(infilename: str, outfilename: str) -> None:
     result.check_returncode()
     return
 
+def concat_inputs(inputs: List[str]) -> str:
+    # pad to 32bytes.
+    input_strs = []
+    for input in inputs:
+        input_str = "{:064x}".format(int(input, 16))
+        input_strs.append(input_str)
+    return ''.join(input_strs)
+
 def run_binary(name: str, inputs: List[str], output: str, filename: str) -> bool:
-    def concat_inputs(inputs: List[int]) -> str:
-        # pad to 32bytes.
-        input_strs = [] 
-        for input in inputs:
-            input_str = "{:064x}".format(int(input, 16))
-            input_strs.append(input_str)
-        return ''.join(input_strs)
 
     def get_contract(inputfile: str) -> str:
         import binascii
@@ -109,6 +119,57 @@ def binary_tests() -> List[str]:
         failed_tests += run_testset(tests)
     return failed_tests
 
+def batch_tests(evm_run: str) -> List[str]:
+    # Compile every test in parallel, then run them all in one llvm-evm-run
+    # process.
+    cases = []
+    for testset in evm_testsuite.test_suite:
+        for key, val in testset.items():
+            cases.append((key, val))
+
+    tmpdir = tempfile.mkdtemp(prefix="evm_test_")
+    def compile_case(index: int) -> str:
+        key, val = cases[index]
+        object_filename = os.path.join(tmpdir, "{}.o".format(index))
+        generate_obj_file(evm_testsuite.runtime_file_prefix + val["file"],
+                          object_filename)
+        return object_filename
+
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        objects = list(pool.map(compile_case, range(len(cases))))
+
+    batch_filename = os.path.join(tmpdir, "tests.batch")
+    with open(batch_filename, "w") as batch:
+        # Test names may contain spaces, so cases are named by index.
+        for index, ((key, val), obj) in enumerate(zip(cases, objects)):
+            line = "{} {}".format(index, obj)
+            input = concat_inputs(val["input"])
+            if input:
+                line += " 0x" + input
+            batch.write(line + "\n")
+
+    result = subprocess.run([evm_run, "--batch", batch_filename],
+                            stdout=subprocess.PIPE)
+    results = {}
+    for line in result.stdout.decode("utf-8").splitlines():
+        index, status, gas, output = line.split(" ")
+        results[cases[int(index)][0]] = (status, int(gas), output)
+
+    failed_tests = []
+    total_gas = 0
+    for key, val in cases:
+        print("Executing test: \"" + key + "\": ", end="")
+        status, gas, output = results.get(key, ("missing", 0, "0x"))
+        total_gas += gas
+        if status == "return" and int(output, 16) == int(val["output"], 16):
+            print("Passed. Gas used: {}".format(gas))
+        else:
+            print("Failed. Status: {}, expected: {}, result: {}".format(
+                status, val["output"], output))
+            failed_tests.append(key)
+    print("Total gas used: {}".format(total_gas))
+    return failed_tests
+
 def print_failed(tests: List[str]) -> None:
     print("The following test cases are failing:")
     for t in tests:
@@ -119,7 +180,10 @@ def execute_tests() -> bool:
         inputs = val["input"]
         output = val["output"]
         function = val["func"]
-    failed_tests = binary_tests()
+    if args.evm_run_path:
+        failed_tests = batch_tests(args.evm_run_path)
+    else:
+        failed_tests = binary_tests()
     print_failed(failed_tests)
     if not failed_tests:
         return True
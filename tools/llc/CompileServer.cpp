@@ -0,0 +1,314 @@
+//===-- CompileServer.cpp - Long-lived llc with an output cache -----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The server sets up the targets once, and every worker thread creates its
+// target machine once and keeps it for all the modules it compiles; only the
+// LLVMContext and the pass manager are per module.
+//
+// Finished outputs are kept in a content-addressed cache, the same one ThinLTO
+// uses, keyed by the SHA1 of the input file together with the options of the
+// server. A hit is served without parsing the module. Only outputs of
+// successful compilations are added to the cache.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CompileServer.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/LTO/Caching.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace llvm;
+
+namespace {
+
+struct Request {
+  std::string Input;
+  std::string Output;
+};
+
+// Collects the diagnostics of one request, to be printed at once.
+struct RequestDiagnosticHandler : public DiagnosticHandler {
+  std::string &Diagnostics;
+  bool HasError = false;
+  RequestDiagnosticHandler(std::string &Diagnostics)
+      : Diagnostics(Diagnostics) {}
+
+  bool handleDiagnostics(const DiagnosticInfo &DI) override {
+    if (DI.getSeverity() == DS_Error)
+      HasError = true;
+    if (auto *Remark = dyn_cast<DiagnosticInfoOptimizationBase>(&DI))
+      if (!Remark->isEnabled())
+        return true;
+
+    raw_string_ostream OS(Diagnostics);
+    OS << LLVMContext::getDiagnosticMessagePrefix(DI.getSeverity()) << ": ";
+    DiagnosticPrinterRawOStream DP(OS);
+    DI.print(DP);
+    OS << '\n';
+    return true;
+  }
+};
+
+class CompileServer {
+public:
+  CompileServer(const CompileServerConfig &Config, StringRef ToolName)
+      : Config(Config), ToolName(ToolName) {}
+
+  bool run();
+
+private:
+  void work();
+  // Returns false and fills Diagnostics if the request failed.
+  bool serve(TargetMachine &TM, const Request &R, bool &Cached,
+             std::string &Diagnostics);
+  bool compile(TargetMachine &TM, MemoryBufferRef Input,
+               SmallVectorImpl<char> &Out, std::string &Diagnostics);
+  void respond(const Request &R, bool OK, bool Cached,
+               StringRef Diagnostics);
+
+  const CompileServerConfig &Config;
+  StringRef ToolName;
+
+  std::mutex QueueMutex;
+  std::condition_variable QueueCV;
+  std::deque<Request> Queue;
+  bool Done = false;
+
+  std::mutex OutputMutex;
+  bool HasError = false;
+};
+} // end anonymous namespace
+
+static std::string getCacheKey(StringRef OptionsKey, StringRef Input) {
+  SHA1 Hasher;
+  Hasher.update(LLVM_VERSION_STRING);
+  Hasher.update(ArrayRef<uint8_t>{0});
+  Hasher.update(OptionsKey);
+  Hasher.update(ArrayRef<uint8_t>{0});
+  Hasher.update(Input);
+  return toHex(Hasher.result());
+}
+
+static bool writeOutput(StringRef Path, StringRef Contents,
+                        std::string &Diagnostics) {
+  std::error_code EC;
+  ToolOutputFile Out(Path, EC, sys::fs::OF_None);
+  if (EC) {
+    Diagnostics += "error: " + Path.str() + ": " + EC.message() + '\n';
+    return false;
+  }
+  Out.os() << Contents;
+  Out.keep();
+  return true;
+}
+
+bool CompileServer::compile(TargetMachine &TM, MemoryBufferRef Input,
+                            SmallVectorImpl<char> &Out,
+                            std::string &Diagnostics) {
+  LLVMContext Context;
+  Context.setDiagnosticHandler(
+      std::make_unique<RequestDiagnosticHandler>(Diagnostics));
+
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseIR(Input, Err, Context);
+  if (!M) {
+    raw_string_ostream OS(Diagnostics);
+    Err.print(ToolName.data(), OS);
+    return false;
+  }
+  M->setTargetTriple(Config.TripleStr);
+  M->setDataLayout(TM.createDataLayout());
+  {
+    raw_string_ostream OS(Diagnostics);
+    if (verifyModule(*M, &OS)) {
+      OS << "error: " << Input.getBufferIdentifier()
+         << ": input module is broken!\n";
+      return false;
+    }
+  }
+  if (Config.PrepareModule)
+    Config.PrepareModule(*M);
+
+  legacy::PassManager PM;
+  PM.add(new TargetLibraryInfoWrapperPass(Triple(Config.TripleStr)));
+  raw_svector_ostream OS(Out);
+  if (TM.addPassesToEmitFile(PM, OS, nullptr, Config.FileType,
+                             /*DisableVerify=*/true)) {
+    Diagnostics += "error: target does not support generation of this file "
+                   "type\n";
+    return false;
+  }
+  PM.run(*M);
+  return !static_cast<const RequestDiagnosticHandler *>(
+              Context.getDiagHandlerPtr())
+              ->HasError;
+}
+
+bool CompileServer::serve(TargetMachine &TM, const Request &R, bool &Cached,
+                          std::string &Diagnostics) {
+  Cached = false;
+  ErrorOr<std::unique_ptr<MemoryBuffer>> InputOrErr =
+      MemoryBuffer::getFileOrSTDIN(R.Input);
+  if (std::error_code EC = InputOrErr.getError()) {
+    Diagnostics += "error: " + R.Input + ": " + EC.message() + '\n';
+    return false;
+  }
+  MemoryBufferRef Input = (*InputOrErr)->getMemBufferRef();
+
+  if (Config.CacheDir.empty()) {
+    SmallVector<char, 0> Out;
+    return compile(TM, Input, Out, Diagnostics) &&
+           writeOutput(R.Output, StringRef(Out.data(), Out.size()),
+                       Diagnostics);
+  }
+
+  std::unique_ptr<MemoryBuffer> Hit;
+  Expected<lto::NativeObjectCache> CacheOrErr = lto::localCache(
+      Config.CacheDir, [&](unsigned, std::unique_ptr<MemoryBuffer> MB) {
+        Hit = std::move(MB);
+      });
+  if (!CacheOrErr) {
+    Diagnostics += "error: " + toString(CacheOrErr.takeError()) + '\n';
+    return false;
+  }
+  lto::AddStreamFn AddStream =
+      (*CacheOrErr)(0, getCacheKey(Config.OptionsKey, Input.getBuffer()));
+  if (!AddStream) {
+    Cached = true;
+    return writeOutput(R.Output, Hit->getBuffer(), Diagnostics);
+  }
+
+  // The cache entry is committed when its stream is destroyed, so it is only
+  // opened once the output is known to be good.
+  SmallVector<char, 0> Out;
+  if (!compile(TM, Input, Out, Diagnostics))
+    return false;
+  AddStream(0)->OS->write(Out.data(), Out.size());
+  return writeOutput(R.Output, StringRef(Out.data(), Out.size()),
+                     Diagnostics);
+}
+
+void CompileServer::respond(const Request &R, bool OK, bool Cached,
+                            StringRef Diagnostics) {
+  std::lock_guard<std::mutex> Lock(OutputMutex);
+  errs() << Diagnostics;
+  if (OK)
+    outs() << "ok " << R.Output << (Cached ? " (cached)" : "") << '\n';
+  else
+    outs() << "error " << R.Input << '\n';
+  outs().flush();
+  HasError |= !OK;
+}
+
+void CompileServer::work() {
+  std::unique_ptr<TargetMachine> TM;
+  while (true) {
+    Request R;
+    {
+      std::unique_lock<std::mutex> Lock(QueueMutex);
+      QueueCV.wait(Lock, [&] { return Done || !Queue.empty(); });
+      if (Queue.empty())
+        return;
+      R = std::move(Queue.front());
+      Queue.pop_front();
+    }
+
+    if (!TM)
+      TM.reset(Config.TheTarget->createTargetMachine(
+          Config.TripleStr, Config.CPU, Config.Features, Config.Options,
+          Config.RM, Config.CM, Config.OptLevel));
+    std::string Diagnostics;
+    bool Cached;
+    bool OK = serve(*TM, R, Cached, Diagnostics);
+    respond(R, OK, Cached, Diagnostics);
+  }
+}
+
+bool CompileServer::run() {
+  CachePruningPolicy Policy;
+  if (!Config.CacheDir.empty()) {
+    Expected<CachePruningPolicy> PolicyOrErr =
+        parseCachePruningPolicy(Config.CachePolicy);
+    if (!PolicyOrErr) {
+      WithColor::error(errs(), ToolName)
+          << toString(PolicyOrErr.takeError()) << '\n';
+      return true;
+    }
+    Policy = *PolicyOrErr;
+    pruneCache(Config.CacheDir, Policy);
+  }
+
+  std::vector<std::thread> Workers;
+  for (unsigned I = 0; I != Config.Threads; ++I)
+    Workers.emplace_back([this] { work(); });
+
+  std::string Line;
+  while (std::getline(std::cin, Line)) {
+    StringRef Input, Output;
+    std::tie(Input, Output) = StringRef(Line).trim().split(' ');
+    Input = Input.trim();
+    Output = Output.trim();
+    if (Input.empty())
+      continue;
+    if (Output.empty()) {
+      std::lock_guard<std::mutex> Lock(OutputMutex);
+      WithColor::error(errs(), ToolName)
+          << "expected an input and an output file: '" << Line << "'\n";
+      outs() << "error " << Input << '\n';
+      outs().flush();
+      HasError = true;
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> Lock(QueueMutex);
+      Queue.push_back({Input.str(), Output.str()});
+    }
+    QueueCV.notify_one();
+  }
+
+  {
+    std::lock_guard<std::mutex> Lock(QueueMutex);
+    Done = true;
+  }
+  QueueCV.notify_all();
+  for (std::thread &Worker : Workers)
+    Worker.join();
+
+  if (!Config.CacheDir.empty())
+    pruneCache(Config.CacheDir, Policy);
+  return HasError;
+}
+
+bool llvm::runCompileServer(const CompileServerConfig &Config,
+                            StringRef ToolName) {
+  assert(Config.Threads && "No worker threads");
+  return CompileServer(Config, ToolName).run();
+}
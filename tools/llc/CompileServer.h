@@ -0,0 +1,64 @@
+//===-- CompileServer.h - Long-lived llc with an output cache ---*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A mode of llc that compiles a stream of modules with the same options, for
+// builds of many small contracts that would otherwise pay for starting llc
+// and creating a target machine for every one of them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLC_COMPILESERVER_H
+#define LLVM_TOOLS_LLC_COMPILESERVER_H
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Target/TargetOptions.h"
+#include <functional>
+#include <string>
+
+namespace llvm {
+
+class Module;
+class Target;
+
+struct CompileServerConfig {
+  const Target *TheTarget = nullptr;
+  std::string TripleStr;
+  std::string CPU;
+  std::string Features;
+  TargetOptions Options;
+  Optional<Reloc::Model> RM;
+  Optional<CodeModel::Model> CM;
+  CodeGenOpt::Level OptLevel = CodeGenOpt::Default;
+  CodeGenFileType FileType = CGFT_AssemblyFile;
+  /// Applies the command line options to a module before it is compiled.
+  std::function<void(Module &)> PrepareModule;
+
+  /// Number of worker threads, each with its own target machine.
+  unsigned Threads = 1;
+  /// Directory of the output cache; no caching when empty.
+  std::string CacheDir;
+  /// Pruning policy of the cache, in the syntax of parseCachePruningPolicy.
+  std::string CachePolicy;
+  /// Everything besides the input that decides the output, such as the
+  /// command line, to be hashed into the cache keys.
+  std::string OptionsKey;
+};
+
+/// Reads requests from stdin, one per line, each an input file and an output
+/// file separated by a space, and compiles them until the end of the input.
+/// Every request is answered on stdout with "ok <output>", followed by
+/// " (cached)" when the output came from the cache, or "error <input>".
+/// With several threads, answers may come out of order. Returns true if any
+/// request failed.
+bool runCompileServer(const CompileServerConfig &Config, StringRef ToolName);
+
+} // end namespace llvm
+
+#endif
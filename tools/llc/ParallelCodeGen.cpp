@@ -0,0 +1,297 @@
+//===-- ParallelCodeGen.cpp - Function-level parallel code generation -----===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// llvm::splitCodeGen gives every thread its own module and leaves the pieces
+// to the linker, which the EVM does not have. Here every code generator
+// gets the whole module, so that module-wide decisions such as global slots
+// come out the same in all of them, together with the number of its
+// partition; the target drops the function bodies of the other partitions
+// (see EVMCodeGenPartition.cpp). The assembly of the partitions is then
+// concatenated in order and assembled at once, which resolves the labels one
+// partition refers to in another.
+//
+// Functions are split into a fixed number of partitions, and only the number
+// of threads that work on them varies, so the output does not depend on it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ParallelCodeGen.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCObjectFileInfo.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCParser/MCAsmParser.h"
+#include "llvm/MC/MCParser/MCTargetAsmParser.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+using namespace llvm;
+
+// Function attribute and module flag read by the target.
+static const char PartitionKey[] = "evm-codegen-partition";
+
+namespace {
+
+struct PartitionResult {
+  SmallString<0> Asm;
+  std::string Diagnostics;
+  bool HasError = false;
+};
+
+// Collects the diagnostics of one partition, to be printed in order.
+struct PartitionDiagnosticHandler : public DiagnosticHandler {
+  PartitionResult &Result;
+  PartitionDiagnosticHandler(PartitionResult &Result) : Result(Result) {}
+
+  bool handleDiagnostics(const DiagnosticInfo &DI) override {
+    if (DI.getSeverity() == DS_Error)
+      Result.HasError = true;
+    if (auto *Remark = dyn_cast<DiagnosticInfoOptimizationBase>(&DI))
+      if (!Remark->isEnabled())
+        return true;
+
+    raw_string_ostream OS(Result.Diagnostics);
+    OS << LLVMContext::getDiagnosticMessagePrefix(DI.getSeverity()) << ": ";
+    DiagnosticPrinterRawOStream DP(OS);
+    DI.print(DP);
+    OS << '\n';
+    return true;
+  }
+};
+} // end anonymous namespace
+
+// Contiguous runs of functions of about the same size, so the first function,
+// the entry of the contract, stays in front.
+static void assignPartitions(Module &M, unsigned Partitions) {
+  uint64_t Total = 0;
+  for (const Function &F : M)
+    if (!F.isDeclaration())
+      Total += F.getInstructionCount();
+
+  uint64_t Seen = 0;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    uint64_t Partition =
+        Total ? std::min<uint64_t>(Seen * Partitions / Total, Partitions - 1)
+              : 0;
+    F.addFnAttr(PartitionKey, utostr(Partition));
+    Seen += F.getInstructionCount();
+  }
+}
+
+static void compilePartition(StringRef Bitcode, unsigned Partition,
+                             const ParallelCodeGenConfig &Config,
+                             const TargetLibraryInfoImpl &TLII,
+                             PartitionResult &Result) {
+  LLVMContext Context;
+  Context.setDiagnosticHandler(
+      std::make_unique<PartitionDiagnosticHandler>(Result));
+
+  Expected<std::unique_ptr<Module>> MOrErr =
+      parseBitcodeFile(MemoryBufferRef(Bitcode, "<partition>"), Context);
+  if (!MOrErr) {
+    Result.Diagnostics += "error: " + toString(MOrErr.takeError()) + '\n';
+    Result.HasError = true;
+    return;
+  }
+  Module &M = **MOrErr;
+  M.addModuleFlag(Module::Error, PartitionKey, Partition);
+
+  std::unique_ptr<TargetMachine> TM(Config.TheTarget->createTargetMachine(
+      Config.TripleStr, Config.CPU, Config.Features, Config.Options, Config.RM,
+      Config.CM, Config.OptLevel));
+
+  legacy::PassManager PM;
+  PM.add(new TargetLibraryInfoWrapperPass(TLII));
+  raw_svector_ostream OS(Result.Asm);
+  // The input module was verified before it was split.
+  if (TM->addPassesToEmitFile(PM, OS, nullptr, CGFT_AssemblyFile,
+                              /*DisableVerify=*/true)) {
+    Result.Diagnostics += "error: target does not support generation of "
+                          "assembly\n";
+    Result.HasError = true;
+    return;
+  }
+  PM.run(M);
+}
+
+static bool isIdentifierChar(char C) {
+  return isAlnum(C) || C == '_' || C == '.' || C == '$';
+}
+
+// Labels that a code generator defines on its own, such as basic blocks,
+// temporaries and the functions created by the machine outliner, are
+// numbered per code generator, so the ones a partition defines get its
+// number as a suffix. Symbols of the module keep their names, which is what
+// lets one partition call into another.
+static void appendRenamed(StringRef Asm, unsigned Partition, const Module &M,
+                          std::string &Out) {
+  const std::string Suffix = ("_p" + Twine(Partition)).str();
+
+  StringSet<> Defined;
+  SmallVector<StringRef, 0> Lines;
+  Asm.split(Lines, '\n');
+  for (StringRef Line : Lines) {
+    size_t Len = 0;
+    while (Len != Line.size() && isIdentifierChar(Line[Len]))
+      ++Len;
+    if (Len && Len != Line.size() && Line[Len] == ':' &&
+        !isDigit(Line.front()) && !M.getNamedValue(Line.take_front(Len)))
+      Defined.insert(Line.take_front(Len));
+  }
+
+  Out.reserve(Out.size() + Asm.size());
+  bool InString = false;
+  for (size_t I = 0, E = Asm.size(); I != E; ++I) {
+    char C = Asm[I];
+    if (InString) {
+      if (C == '\\' && I + 1 != E) {
+        Out += C;
+        C = Asm[++I];
+      } else if (C == '"' || C == '\n') {
+        InString = false;
+      }
+      Out += C;
+      continue;
+    }
+    if (C == '"') {
+      InString = true;
+    } else if (isIdentifierChar(C)) {
+      size_t End = I;
+      while (End != E && isIdentifierChar(Asm[End]))
+        ++End;
+      StringRef Name = Asm.slice(I, End);
+      Out += Name;
+      if (Defined.count(Name))
+        Out += Suffix;
+      I = End - 1;
+      continue;
+    }
+    Out += C;
+  }
+}
+
+static bool assemble(StringRef Asm, const ParallelCodeGenConfig &Config,
+                     raw_pwrite_stream &OS, StringRef ToolName) {
+  const Target &T = *Config.TheTarget;
+  Triple TT(Config.TripleStr);
+  const MCTargetOptions &MCOptions = Config.Options.MCOptions;
+
+  SourceMgr SrcMgr;
+  SrcMgr.AddNewSourceBuffer(
+      MemoryBuffer::getMemBuffer(Asm, "<parallel codegen>",
+                                 /*RequiresNullTerminator=*/false),
+      SMLoc());
+
+  std::unique_ptr<MCRegisterInfo> MRI(T.createMCRegInfo(Config.TripleStr));
+  std::unique_ptr<MCAsmInfo> MAI(
+      T.createMCAsmInfo(*MRI, Config.TripleStr, MCOptions));
+  std::unique_ptr<MCSubtargetInfo> STI(
+      T.createMCSubtargetInfo(Config.TripleStr, Config.CPU, Config.Features));
+  std::unique_ptr<MCInstrInfo> MCII(T.createMCInstrInfo());
+  if (!MRI || !MAI || !STI || !MCII) {
+    WithColor::error(errs(), ToolName) << "target does not support MC\n";
+    return true;
+  }
+
+  MCObjectFileInfo MOFI;
+  MCContext Ctx(MAI.get(), MRI.get(), &MOFI, &SrcMgr, &MCOptions);
+  MOFI.InitMCObjectFileInfo(TT, Config.RM == Reloc::PIC_, Ctx);
+
+  MCCodeEmitter *CE = T.createMCCodeEmitter(*MCII, *MRI, Ctx);
+  MCAsmBackend *MAB = T.createMCAsmBackend(*STI, *MRI, MCOptions);
+  if (!CE || !MAB) {
+    WithColor::error(errs(), ToolName)
+        << "target does not support object emission\n";
+    return true;
+  }
+  std::unique_ptr<MCStreamer> Str(T.createMCObjectStreamer(
+      TT, Ctx, std::unique_ptr<MCAsmBackend>(MAB), MAB->createObjectWriter(OS),
+      std::unique_ptr<MCCodeEmitter>(CE), *STI, MCOptions.MCRelaxAll,
+      MCOptions.MCIncrementalLinkerCompatible,
+      /*DWARFMustBeAtTheEnd=*/true));
+
+  std::unique_ptr<MCAsmParser> Parser(
+      createMCAsmParser(SrcMgr, Ctx, *Str, *MAI));
+  std::unique_ptr<MCTargetAsmParser> TAP(
+      T.createMCAsmParser(*STI, *Parser, *MCII, MCOptions));
+  if (!TAP) {
+    WithColor::error(errs(), ToolName)
+        << "target does not support assembly parsing\n";
+    return true;
+  }
+  Parser->setTargetParser(*TAP);
+  return Parser->Run(/*NoInitialTextSection=*/false);
+}
+
+bool llvm::codegenInParallel(Module &M, const ParallelCodeGenConfig &Config,
+                             const TargetLibraryInfoImpl &TLII,
+                             raw_pwrite_stream &OS, StringRef ToolName) {
+  assert(Config.Partitions && Config.Threads && "Nothing to run");
+  assignPartitions(M, Config.Partitions);
+
+  SmallVector<char, 0> Bitcode;
+  {
+    raw_svector_ostream BOS(Bitcode);
+    WriteBitcodeToFile(M, BOS);
+  }
+  StringRef BitcodeRef(Bitcode.data(), Bitcode.size());
+
+  std::vector<PartitionResult> Results(Config.Partitions);
+  {
+    ThreadPool Pool(std::min(Config.Threads, Config.Partitions));
+    for (unsigned P = 0; P != Config.Partitions; ++P)
+      Pool.async([&, P] {
+        compilePartition(BitcodeRef, P, Config, TLII, Results[P]);
+      });
+    Pool.wait();
+  }
+
+  bool HasError = false;
+  std::string Asm;
+  for (unsigned P = 0; P != Config.Partitions; ++P) {
+    errs() << Results[P].Diagnostics;
+    HasError |= Results[P].HasError;
+    appendRenamed(Results[P].Asm, P, M, Asm);
+  }
+  if (HasError)
+    return true;
+
+  switch (Config.FileType) {
+  case CGFT_AssemblyFile:
+    OS << Asm;
+    return false;
+  case CGFT_ObjectFile:
+    return assemble(Asm, Config, OS, ToolName);
+  case CGFT_Null:
+    return false;
+  }
+  llvm_unreachable("Unknown file type");
+}
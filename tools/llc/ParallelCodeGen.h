@@ -0,0 +1,56 @@
+//===-- ParallelCodeGen.h - Function-level parallel code generation -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Code generation split over threads for targets without a link step, where
+// the pieces are put back together by assembling their concatenated output.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLC_PARALLELCODEGEN_H
+#define LLVM_TOOLS_LLC_PARALLELCODEGEN_H
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Target/TargetOptions.h"
+#include <string>
+
+namespace llvm {
+
+class Module;
+class raw_pwrite_stream;
+class Target;
+class TargetLibraryInfoImpl;
+
+struct ParallelCodeGenConfig {
+  const Target *TheTarget = nullptr;
+  std::string TripleStr;
+  std::string CPU;
+  std::string Features;
+  TargetOptions Options;
+  Optional<Reloc::Model> RM;
+  Optional<CodeModel::Model> CM;
+  CodeGenOpt::Level OptLevel = CodeGenOpt::Default;
+  CodeGenFileType FileType = CGFT_AssemblyFile;
+
+  /// Number of worker threads.
+  unsigned Threads = 1;
+  /// Number of pieces the module is split into. This, and not the number of
+  /// threads, decides the output.
+  unsigned Partitions = 1;
+};
+
+/// Compiles \p M in contiguous partitions of its functions, one code generator
+/// per partition, and writes the combined output to \p OS. Diagnostics are
+/// printed in partition order. Returns true on error.
+bool codegenInParallel(Module &M, const ParallelCodeGenConfig &Config,
+                       const TargetLibraryInfoImpl &TLII,
+                       raw_pwrite_stream &OS, StringRef ToolName);
+
+} // end namespace llvm
+
+#endif
@@ -12,6 +12,8 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "CompileServer.h"
+#include "ParallelCodeGen.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
@@ -134,6 +136,34 @@ static cl::opt<bool> DiscardValueNames(
 
 static cl::list<std::string> IncludeDirs("I", cl::desc("include search path"));
 
+static cl::opt<unsigned> CodeGenThreads(
+    "codegen-threads", cl::init(0), cl::value_desc("N"),
+    cl::desc("Generate code for the functions of an EVM module on N threads"));
+
+static cl::opt<unsigned> CodeGenPartitions(
+    "codegen-partitions", cl::init(16), cl::value_desc("N"),
+    cl::desc("Number of pieces -codegen-threads splits a module into; the "
+             "output depends on it, not on the number of threads"));
+
+static cl::opt<bool> CompileServerMode(
+    "compile-server",
+    cl::desc("Compile the 'input output' file pairs read from stdin, one per "
+             "line, until the end of the input"));
+
+static cl::opt<unsigned> CompileServerThreads(
+    "compile-server-threads", cl::init(1), cl::value_desc("N"),
+    cl::desc("Number of threads of -compile-server, each with its own target "
+             "machine"));
+
+static cl::opt<std::string> CompileCacheDir(
+    "compile-cache-dir", cl::value_desc("directory"),
+    cl::desc("Directory in which -compile-server caches its outputs"));
+
+static cl::opt<std::string> CompileCachePolicy(
+    "compile-cache-policy", cl::value_desc("policy"),
+    cl::desc("Pruning policy of -compile-cache-dir, as for "
+             "-thinlto-cache-policy"));
+
 static cl::opt<bool> RemarksWithHotness(
     "pass-remarks-with-hotness",
     cl::desc("With PGO, include profile count in optimization remarks"),
@@ -184,6 +214,7 @@ static cl::opt<RunPassOption, true, cl::parser<std::string>> RunPass(
     cl::value_desc("pass-name"), cl::ZeroOrMore, cl::location(RunPassOpt));
 
 static int compileModule(char **, LLVMContext &);
+static int startCompileServer(int, char **);
 
 static std::unique_ptr<ToolOutputFile> GetOutputStream(const char *TargetName,
                                                        Triple::OSType OS,
@@ -350,6 +381,9 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  if (CompileServerMode)
+    return startCompileServer(argc, argv);
+
   // Compile the module TimeCompilations times to give better compile time
   // metrics.
   for (unsigned I = TimeCompilations; I; --I)
@@ -389,6 +423,33 @@ static bool addPass(PassManagerBase &PM, const char *argv0,
   return false;
 }
 
+static bool getCodeGenOptLevel(const char *argv0, CodeGenOpt::Level &OLvl) {
+  OLvl = CodeGenOpt::Default;
+  switch (OptLevel) {
+  default:
+    WithColor::error(errs(), argv0) << "invalid optimization level.\n";
+    return true;
+  case ' ': break;
+  case '0': OLvl = CodeGenOpt::None; break;
+  case '1': OLvl = CodeGenOpt::Less; break;
+  case '2': OLvl = CodeGenOpt::Default; break;
+  case '3': OLvl = CodeGenOpt::Aggressive; break;
+  }
+  return false;
+}
+
+static TargetOptions getTargetOptions() {
+  TargetOptions Options = InitTargetOptionsFromCodeGenFlags();
+  Options.DisableIntegratedAS = NoIntegratedAssembler;
+  Options.MCOptions.ShowMCEncoding = ShowMCEncoding;
+  Options.MCOptions.MCUseDwarfDirectory = EnableDwarfDirectory;
+  Options.MCOptions.AsmVerbose = AsmVerbose;
+  Options.MCOptions.PreserveAsmComments = PreserveComments;
+  Options.MCOptions.IASSearchPaths = IncludeDirs;
+  Options.MCOptions.SplitDwarfFile = SplitDwarfFile;
+  return Options;
+}
+
 static int compileModule(char **argv, LLVMContext &Context) {
   // Load the module to be compiled...
   SMDiagnostic Err;
@@ -440,26 +501,11 @@ static int compileModule(char **argv, LLVMContext &Context) {
     return 1;
   }
 
-  CodeGenOpt::Level OLvl = CodeGenOpt::Default;
-  switch (OptLevel) {
-  default:
-    WithColor::error(errs(), argv[0]) << "invalid optimization level.\n";
+  CodeGenOpt::Level OLvl;
+  if (getCodeGenOptLevel(argv[0], OLvl))
     return 1;
-  case ' ': break;
-  case '0': OLvl = CodeGenOpt::None; break;
-  case '1': OLvl = CodeGenOpt::Less; break;
-  case '2': OLvl = CodeGenOpt::Default; break;
-  case '3': OLvl = CodeGenOpt::Aggressive; break;
-  }
 
-  TargetOptions Options = InitTargetOptionsFromCodeGenFlags();
-  Options.DisableIntegratedAS = NoIntegratedAssembler;
-  Options.MCOptions.ShowMCEncoding = ShowMCEncoding;
-  Options.MCOptions.MCUseDwarfDirectory = EnableDwarfDirectory;
-  Options.MCOptions.AsmVerbose = AsmVerbose;
-  Options.MCOptions.PreserveAsmComments = PreserveComments;
-  Options.MCOptions.IASSearchPaths = IncludeDirs;
-  Options.MCOptions.SplitDwarfFile = SplitDwarfFile;
+  TargetOptions Options = getTargetOptions();
 
   std::unique_ptr<TargetMachine> Target(TheTarget->createTargetMachine(
       TheTriple.getTriple(), CPUStr, FeaturesStr, Options, getRelocModel(),
@@ -529,6 +575,37 @@ static int compileModule(char **argv, LLVMContext &Context) {
     WithColor::warning(errs(), argv[0])
         << ": warning: ignoring -mc-relax-all because filetype != obj";
 
+  if (CodeGenThreads) {
+    if (TheTriple.getArch() != Triple::evm || MIR || !RunPassNames->empty() ||
+        CompileTwice || CodeGenPartitions == 0) {
+      WithColor::error(errs(), argv[0])
+          << "-codegen-threads needs IR input for EVM and at least one "
+             "partition\n";
+      return 1;
+    }
+    ParallelCodeGenConfig Config;
+    Config.TheTarget = TheTarget;
+    Config.TripleStr = TheTriple.getTriple();
+    Config.CPU = CPUStr;
+    Config.Features = FeaturesStr;
+    Config.Options = Options;
+    Config.RM = getRelocModel();
+    Config.CM = getCodeModel();
+    Config.OptLevel = OLvl;
+    Config.FileType = FileType;
+    Config.Threads = CodeGenThreads;
+    Config.Partitions = CodeGenPartitions;
+
+    // Object output is written at once, so it may go to a pipe.
+    SmallVector<char, 0> Buffer;
+    raw_svector_ostream BOS(Buffer);
+    if (codegenInParallel(*M, Config, TLII, BOS, argv[0]))
+      return 1;
+    Out->os() << Buffer;
+    Out->keep();
+    return 0;
+  }
+
   {
     raw_pwrite_stream *OS = &Out->os();
 
@@ -640,3 +717,57 @@ static int compileModule(char **argv, LLVMContext &Context) {
 
   return 0;
 }
+
+// The server compiles IR for the target of the command line; inputs and
+// outputs come from stdin instead of -o and the positional argument.
+static int startCompileServer(int argc, char **argv) {
+  if (InputFilename != "-" || !OutputFilename.empty() ||
+      InputLanguage == "mir" || !RunPassNames->empty() || CodeGenThreads ||
+      CompileServerThreads == 0) {
+    WithColor::error(errs(), argv[0])
+        << "-compile-server reads the names of its IR inputs and outputs "
+           "from stdin and needs at least one thread\n";
+    return 1;
+  }
+
+  Triple TheTriple(Triple::normalize(
+      TargetTriple.empty() ? sys::getDefaultTargetTriple() : TargetTriple));
+  std::string Error;
+  const Target *TheTarget =
+      TargetRegistry::lookupTarget(MArch, TheTriple, Error);
+  if (!TheTarget) {
+    WithColor::error(errs(), argv[0]) << Error;
+    return 1;
+  }
+
+  CompileServerConfig Config;
+  if (getCodeGenOptLevel(argv[0], Config.OptLevel))
+    return 1;
+  Config.TheTarget = TheTarget;
+  Config.TripleStr = TheTriple.getTriple();
+  Config.CPU = getCPUStr();
+  Config.Features = getFeaturesStr();
+  Config.Options = getTargetOptions();
+  if (FloatABIForCalls != FloatABI::Default)
+    Config.Options.FloatABIType = FloatABIForCalls;
+  Config.RM = getRelocModel();
+  Config.CM = getCodeModel();
+  Config.FileType = FileType;
+  Config.PrepareModule = [&Config](Module &M) {
+    setFunctionAttributes(Config.CPU, Config.Features, M);
+  };
+  Config.Threads = CompileServerThreads;
+  Config.CacheDir = CompileCacheDir;
+  Config.CachePolicy = CompileCachePolicy;
+
+  // The options of the server itself do not change the output.
+  for (int I = 1; I < argc; ++I) {
+    StringRef Arg = StringRef(argv[I]).ltrim('-');
+    if (Arg.startswith("compile-server") || Arg.startswith("compile-cache"))
+      continue;
+    Config.OptionsKey += Arg;
+    Config.OptionsKey += '\0';
+  }
+
+  return runCompileServer(Config, argv[0]) ? 1 : 0;
+}
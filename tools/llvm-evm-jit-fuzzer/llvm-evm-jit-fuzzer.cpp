@@ -0,0 +1,114 @@
+//===-- llvm-evm-jit-fuzzer.cpp - Fuzz a contract natively ----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Fuzzes the call data of a contract written in EVM IR, compiled for the
+// host with ORC as in llvm-evm-jit:
+//
+//   llvm-evm-jit-fuzzer <corpus> -ignore_remaining_args=1 -ir=contract.ll
+//
+// A run that hits INVALID, which is how contracts fail an assertion, is a
+// crash. With -compare=contract.o every input is also run through the
+// bytecode of the contract in the interpreter, and a difference is a crash.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/HostJIT.h"
+#include "lib/Interpreter.h"
+#include "llvm/FuzzMutate/FuzzerCLI.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace llvm::evmrun;
+
+static cl::opt<std::string> IRFile("ir", cl::desc("Contract to fuzz"),
+                                   cl::value_desc("filename"));
+
+static cl::opt<std::string>
+    EntryName("entry", cl::desc("Entry function (default main)"),
+              cl::init("main"));
+
+static cl::opt<std::string>
+    CompareFile("compare",
+                cl::desc("Bytecode of the contract to compare every run with"),
+                cl::value_desc("filename"));
+
+static std::unique_ptr<HostContract> Contract;
+static HostRuntime Host;
+static Interpreter EVM;
+static std::vector<uint8_t> Code;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
+  ArrayRef<uint8_t> CallData(Data, Size);
+  Host.clearStorage();
+  ExecutionResult R = Contract->run(Host, CallData);
+  if (R.Result == Status::InvalidOpcode) {
+    errs() << "contract hit INVALID\n";
+    abort();
+  }
+  if (Code.empty())
+    return 0;
+
+  EVM.clearStorage();
+  ExecutionResult E = EVM.run(Code, CallData, 10000000);
+  bool Same = R.succeeded() == E.succeeded() &&
+              (R.Result == Status::Revert) == (E.Result == Status::Revert);
+  if (Same && (R.succeeded() || R.Result == Status::Revert))
+    Same = R.Result == E.Result && R.Output == E.Output;
+  if (!Same) {
+    errs() << "host gives " << getStatusName(R.Result) << ", bytecode gives "
+           << getStatusName(E.Result) << '\n';
+    abort();
+  }
+  return 0;
+}
+
+extern "C" LLVM_ATTRIBUTE_USED int LLVMFuzzerInitialize(int *argc,
+                                                        char ***argv) {
+  parseFuzzerCLOpts(*argc, *argv);
+  if (IRFile.empty()) {
+    errs() << *argv[0] << ": -ir must be specified\n";
+    exit(1);
+  }
+  if (InitializeNativeTarget() || InitializeNativeTargetAsmPrinter()) {
+    errs() << *argv[0] << ": no native target to compile for\n";
+    exit(1);
+  }
+
+  auto Ctx = std::make_unique<LLVMContext>();
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseIRFile(IRFile, Err, *Ctx);
+  if (!M) {
+    Err.print(*argv[0], errs());
+    exit(1);
+  }
+  auto C = HostContract::create(std::move(M), std::move(Ctx), EntryName);
+  if (!C) {
+    errs() << *argv[0] << ": " << toString(C.takeError()) << '\n';
+    exit(1);
+  }
+  Contract = std::move(*C);
+
+  if (!CompareFile.empty()) {
+    auto BufOrErr = MemoryBuffer::getFile(CompareFile);
+    if (!BufOrErr) {
+      errs() << *argv[0] << ": " << CompareFile << ": "
+             << BufOrErr.getError().message() << '\n';
+      exit(1);
+    }
+    StringRef Contents = (*BufOrErr)->getBuffer();
+    Code.assign(Contents.bytes_begin(), Contents.bytes_end());
+  }
+  return 0;
+}
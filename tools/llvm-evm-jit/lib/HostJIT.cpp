@@ -0,0 +1,181 @@
+//===-- HostJIT.cpp - Run EVM IR on the host with ORC ---------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "HostJIT.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+using namespace llvm::evmrun;
+
+// The number of operands the host function of I takes.
+static unsigned getNumHostArgs(const Instruction &I) {
+  if (const auto *CI = dyn_cast<CallInst>(&I))
+    return CI->getNumArgOperands();
+  return I.getNumOperands();
+}
+
+// The host function that replaces I, or an empty name if I stays.
+static StringRef getHostName(const Instruction &I) {
+  if (const auto *CI = dyn_cast<CallInst>(&I)) {
+    const Function *Callee = CI->getCalledFunction();
+    if (Callee && Callee->getName().startswith("llvm.evm."))
+      return Callee->getName().drop_front(strlen("llvm.evm."));
+    return "";
+  }
+  if (!I.getType()->isIntegerTy() ||
+      I.getType()->getIntegerBitWidth() <= 128)
+    return "";
+  switch (I.getOpcode()) {
+  case Instruction::UDiv:
+    return "div";
+  case Instruction::SDiv:
+    return "sdiv";
+  case Instruction::URem:
+    return "mod";
+  case Instruction::SRem:
+    return "smod";
+  default:
+    return "";
+  }
+}
+
+Error llvm::evmrun::lowerForHost(Module &M) {
+  LLVMContext &Ctx = M.getContext();
+  Type *WordTy = Type::getIntNTy(Ctx, 256);
+  auto *HostTy =
+      FunctionType::get(Type::getVoidTy(Ctx),
+                        {WordTy->getPointerTo(), WordTy->getPointerTo()},
+                        false);
+
+  for (Function &F : M) {
+    SmallVector<std::pair<Instruction *, StringRef>, 16> Calls;
+    unsigned MaxArgs = 1;
+    for (Instruction &I : instructions(F)) {
+      if (isa<IntToPtrInst>(I))
+        return createStringError(inconvertibleErrorCode(),
+                                 "%s: pointers made from integers cannot "
+                                 "run on the host",
+                                 F.getName().str().c_str());
+      StringRef Name = getHostName(I);
+      if (Name.empty())
+        continue;
+      if (!HostRuntime::getFunction(Name) ||
+          (isa<BinaryOperator>(I) && I.getType() != WordTy))
+        return createStringError(inconvertibleErrorCode(),
+                                 "%s: '%s' cannot run on the host",
+                                 F.getName().str().c_str(),
+                                 isa<CallInst>(I)
+                                     ? ("llvm.evm." + Name).str().c_str()
+                                     : I.getOpcodeName());
+      Calls.emplace_back(&I, Name);
+      MaxArgs = std::max(MaxArgs, getNumHostArgs(I));
+    }
+    if (Calls.empty())
+      continue;
+
+    // The operands and result of every call go through two buffers in the
+    // frame.
+    IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
+    Value *Args = Builder.CreateAlloca(ArrayType::get(WordTy, MaxArgs),
+                                       nullptr, "evm.args");
+    Value *Result = Builder.CreateAlloca(WordTy, nullptr, "evm.result");
+    Value *ArgsPtr = Builder.CreateConstInBoundsGEP2_32(
+        Args->getType()->getPointerElementType(), Args, 0, 0);
+
+    for (auto &Call : Calls) {
+      Instruction *I = Call.first;
+      Builder.SetInsertPoint(I);
+      for (unsigned N = 0, E = getNumHostArgs(*I); N != E; ++N)
+        Builder.CreateStore(I->getOperand(N),
+                            Builder.CreateConstInBoundsGEP1_32(WordTy, ArgsPtr,
+                                                               N));
+      FunctionCallee Host = M.getOrInsertFunction(
+          (HostRuntime::SymbolPrefix + Call.second).str(), HostTy);
+      Builder.CreateCall(Host, {Result, ArgsPtr});
+      if (!I->getType()->isVoidTy()) {
+        Value *V = Builder.CreateLoad(WordTy, Result);
+        V->takeName(I);
+        I->replaceAllUsesWith(V);
+      }
+      I->eraseFromParent();
+    }
+  }
+
+  for (Function &F : make_early_inc_range(M.functions()))
+    if (F.getName().startswith("llvm.evm.") && F.use_empty())
+      F.eraseFromParent();
+  return Error::success();
+}
+
+Expected<std::unique_ptr<HostContract>>
+HostContract::create(std::unique_ptr<Module> M,
+                     std::unique_ptr<LLVMContext> Ctx, StringRef Entry) {
+  auto JTMB = orc::JITTargetMachineBuilder::detectHost();
+  if (!JTMB)
+    return JTMB.takeError();
+  JTMB->setCodeGenOptLevel(CodeGenOpt::Default);
+  auto DL = JTMB->getDefaultDataLayoutForTarget();
+  if (!DL)
+    return DL.takeError();
+
+  if (!M->getFunction(Entry))
+    return createStringError(inconvertibleErrorCode(),
+                             "no entry function '%s'", Entry.str().c_str());
+  M->setDataLayout(*DL);
+  M->setTargetTriple(JTMB->getTargetTriple().str());
+  if (Error E = lowerForHost(*M))
+    return std::move(E);
+
+  auto JIT = orc::LLJITBuilder()
+                 .setJITTargetMachineBuilder(std::move(*JTMB))
+                 .create();
+  if (!JIT)
+    return JIT.takeError();
+
+  // The host functions, and the C library for the memcpy and memset calls
+  // of the contract.
+  orc::JITDylib &Main = (*JIT)->getMainJITDylib();
+  orc::MangleAndInterner Mangle((*JIT)->getExecutionSession(),
+                                (*JIT)->getDataLayout());
+  orc::SymbolMap Symbols;
+  for (Function &F : *M) {
+    StringRef Name = F.getName();
+    if (!F.isDeclaration() || !Name.startswith(HostRuntime::SymbolPrefix))
+      continue;
+    HostFunction Fn = HostRuntime::getFunction(
+        Name.drop_front(strlen(HostRuntime::SymbolPrefix)));
+    Symbols[Mangle(Name)] = JITEvaluatedSymbol(
+        pointerToJITTargetAddress(Fn), JITSymbolFlags::Exported);
+  }
+  if (Error E = Main.define(orc::absoluteSymbols(std::move(Symbols))))
+    return std::move(E);
+  auto Process = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      (*JIT)->getDataLayout().getGlobalPrefix());
+  if (!Process)
+    return Process.takeError();
+  Main.addGenerator(std::move(*Process));
+
+  if (Error E = (*JIT)->addIRModule(
+          orc::ThreadSafeModule(std::move(M), std::move(Ctx))))
+    return std::move(E);
+  auto Sym = (*JIT)->lookup(Entry);
+  if (!Sym)
+    return Sym.takeError();
+
+  std::unique_ptr<HostContract> C(new HostContract());
+  C->Entry = jitTargetAddressToFunction<void (*)()>(Sym->getAddress());
+  C->JIT = std::move(*JIT);
+  return std::move(C);
+}
@@ -0,0 +1,64 @@
+//===-- HostJIT.h -----------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// Compiles IR written for the EVM for the host with ORC, so that contract
+/// logic runs natively against the HostRuntime.
+///
+/// The intrinsic calls of the IR, and its 256-bit divisions, are lowered to
+/// calls to the host functions of the runtime. Plain loads and stores use
+/// host memory, while EVM memory is only reached through the intrinsics,
+/// so IR that makes pointers from integers is rejected. Control flow
+/// intrinsics that need EVM bytecode, such as llvm.evm.jump and
+/// llvm.evm.getpc, are rejected too.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLVM_EVM_JIT_HOSTJIT_H
+#define LLVM_TOOLS_LLVM_EVM_JIT_HOSTJIT_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Support/Error.h"
+#include "lib/HostRuntime.h"
+#include <memory>
+
+namespace llvm {
+class LLVMContext;
+class Module;
+
+namespace evmrun {
+
+// Rewrites the EVM intrinsic calls and 256-bit divisions of M into calls to
+// the host functions, which are declared as external functions named with
+// HostRuntime::SymbolPrefix.
+Error lowerForHost(Module &M);
+
+class HostContract {
+public:
+  // Compiles M, whose entry function is Entry, for the host.
+  static Expected<std::unique_ptr<HostContract>>
+  create(std::unique_ptr<Module> M, std::unique_ptr<LLVMContext> Ctx,
+         StringRef Entry);
+
+  ExecutionResult run(HostRuntime &R, ArrayRef<uint8_t> CallData) const {
+    return R.run(Entry, CallData);
+  }
+
+private:
+  HostContract() = default;
+
+  std::unique_ptr<orc::LLJIT> JIT;
+  void (*Entry)() = nullptr;
+};
+
+} // namespace evmrun
+} // namespace llvm
+
+#endif // LLVM_TOOLS_LLVM_EVM_JIT_HOSTJIT_H
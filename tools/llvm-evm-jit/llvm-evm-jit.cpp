@@ -0,0 +1,265 @@
+//===-- llvm-evm-jit.cpp - Run EVM IR natively ------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Compiles IR written for the EVM for the host with ORC and calls its entry
+/// function with the given call data, printing the returned data like
+/// llvm-evm-run. The EVM intrinsics run in the HostRuntime, see HostJIT.h.
+///
+/// In batch mode every line of the input names one test case:
+///   <name> [<0x-prefixed call data>]
+/// and one result line is printed per case.
+///
+/// With --compare the same call data is also run through the bytecode the
+/// IR compiles to, such as the output of llc -mtriple=evm -filetype=obj, in
+/// the Interpreter, and any difference in status, returned data or logs is
+/// reported: a differential test of the EVM backend.
+///
+/// With --print-lowered the IR is printed after its intrinsics are lowered,
+/// without compiling it.
+///
+//===----------------------------------------------------------------------===//
+
+#include "lib/HostJIT.h"
+#include "lib/Interpreter.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+
+using namespace llvm;
+using namespace llvm::evmrun;
+
+static cl::OptionCategory EVMJITCat("llvm-evm-jit Options");
+
+static cl::opt<std::string> InputFilename(cl::Positional,
+                                          cl::desc("<IR file>"),
+                                          cl::init("-"), cl::cat(EVMJITCat));
+
+static cl::opt<std::string> CallDataHex("input",
+                                        cl::desc("Hex encoded call data"),
+                                        cl::cat(EVMJITCat));
+
+static cl::opt<std::string>
+    EntryName("entry", cl::desc("Entry function (default main)"),
+              cl::init("main"), cl::cat(EVMJITCat));
+
+static cl::opt<std::string>
+    BatchFile("batch",
+              cl::desc("Read one test case per line from the given file"),
+              cl::value_desc("filename"), cl::cat(EVMJITCat));
+
+static cl::opt<std::string>
+    CompareFile("compare",
+                cl::desc("Also run this bytecode in the interpreter and "
+                         "report any difference"),
+                cl::value_desc("filename"), cl::cat(EVMJITCat));
+
+static cl::opt<bool> PrintLogs("print-logs", cl::desc("Print emitted logs"),
+                               cl::cat(EVMJITCat));
+
+static cl::opt<bool>
+    PrintLowered("print-lowered",
+                 cl::desc("Print the IR with its intrinsics lowered for the "
+                          "host instead of running it"),
+                 cl::cat(EVMJITCat));
+
+static cl::opt<unsigned>
+    Repeat("repeat",
+           cl::desc("Run each case this many times and print the time"),
+           cl::init(1), cl::cat(EVMJITCat));
+
+static StringRef ToolName;
+
+static void reportError(const Twine &Message) {
+  WithColor::error(errs(), ToolName) << Message << '\n';
+  exit(1);
+}
+
+static bool parseHex(StringRef Text, std::vector<uint8_t> &Bytes) {
+  Text = Text.trim();
+  if (Text.startswith("0x") || Text.startswith("0X"))
+    Text = Text.drop_front(2);
+  if (Text.size() % 2 || !all_of(Text, isHexDigit))
+    return false;
+  std::string Raw = fromHex(Text);
+  Bytes.assign(Raw.begin(), Raw.end());
+  return true;
+}
+
+static std::string formatHex(ArrayRef<uint8_t> Bytes) {
+  return "0x" + llvm::toHex(Bytes, /*LowerCase=*/true);
+}
+
+static std::string formatHex(const Word &W) {
+  uint8_t Bytes[32];
+  W.toBytes(Bytes);
+  return formatHex(makeArrayRef(Bytes));
+}
+
+static void printLogs(const ExecutionResult &R, raw_ostream &OS) {
+  for (const LogEntry &Log : R.Logs) {
+    OS << "log";
+    for (const Word &Topic : Log.Topics)
+      OS << ' ' << formatHex(Topic);
+    OS << " data " << formatHex(Log.Data) << '\n';
+  }
+}
+
+static bool sameLogs(const ExecutionResult &A, const ExecutionResult &B) {
+  if (A.Logs.size() != B.Logs.size())
+    return false;
+  for (unsigned N = 0; N != A.Logs.size(); ++N)
+    if (A.Logs[N].Topics != B.Logs[N].Topics ||
+        A.Logs[N].Data != B.Logs[N].Data)
+      return false;
+  return true;
+}
+
+// Failures other than a revert are not told apart: the host does not meter
+// gas, and reaches no bad jumps.
+static bool sameResult(const ExecutionResult &Host,
+                       const ExecutionResult &EVM) {
+  if (Host.succeeded() != EVM.succeeded() ||
+      (Host.Result == Status::Revert) != (EVM.Result == Status::Revert))
+    return false;
+  if (!Host.succeeded() && Host.Result != Status::Revert)
+    return true;
+  return Host.Result == EVM.Result && Host.Output == EVM.Output &&
+         sameLogs(Host, EVM);
+}
+
+struct Runner {
+  const HostContract &Contract;
+  HostRuntime Host;
+  Interpreter EVM;
+  std::vector<uint8_t> Code;
+  std::chrono::nanoseconds Time{0};
+  uint64_t Runs = 0;
+
+  // Runs one case and prints its result, prefixed with Name in batch mode.
+  // Returns false if the case failed or differs from the bytecode.
+  bool run(StringRef Name, ArrayRef<uint8_t> CallData) {
+    ExecutionResult R;
+    auto Start = std::chrono::steady_clock::now();
+    for (unsigned N = 0; N != std::max(1u, unsigned(Repeat)); ++N) {
+      // Each run starts from empty storage.
+      Host.clearStorage();
+      R = Contract.run(Host, CallData);
+    }
+    Time += std::chrono::steady_clock::now() - Start;
+    Runs += std::max(1u, unsigned(Repeat));
+
+    if (!Name.empty())
+      outs() << Name << ' ' << getStatusName(R.Result) << ' ';
+    outs() << formatHex(R.Output) << '\n';
+    if (PrintLogs)
+      printLogs(R, outs());
+
+    if (CompareFile.empty())
+      return R.succeeded();
+    EVM.clearStorage();
+    ExecutionResult E = EVM.run(Code, CallData, 10000000);
+    if (sameResult(R, E))
+      return R.succeeded();
+    WithColor::error(errs(), ToolName)
+        << (Name.empty() ? "" : (Name + ": ").str())
+        << "the bytecode gives " << getStatusName(E.Result) << ' '
+        << formatHex(E.Output) << '\n';
+    if (PrintLogs)
+      printLogs(E, errs());
+    return false;
+  }
+};
+
+static int runBatch(Runner &R) {
+  auto BufOrErr = MemoryBuffer::getFile(BatchFile);
+  if (!BufOrErr)
+    reportError(BatchFile + ": " + BufOrErr.getError().message());
+
+  bool AllPassed = true;
+  SmallVector<StringRef, 0> Lines;
+  (*BufOrErr)->getBuffer().split(Lines, '\n', -1, false);
+  for (StringRef Line : Lines) {
+    Line = Line.trim();
+    if (Line.empty() || Line.startswith("#"))
+      continue;
+
+    SmallVector<StringRef, 2> Fields;
+    Line.split(Fields, ' ', -1, false);
+    std::vector<uint8_t> CallData;
+    if (Fields.size() > 1 && !parseHex(Fields[1], CallData))
+      reportError(Fields[0] + ": invalid call data");
+    AllPassed &= R.run(Fields[0], CallData);
+  }
+  return AllPassed ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  cl::HideUnrelatedOptions(EVMJITCat);
+  cl::ParseCommandLineOptions(argc, argv, "EVM IR runner for the host\n");
+  ToolName = argv[0];
+
+  auto Ctx = std::make_unique<LLVMContext>();
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseIRFile(InputFilename, Err, *Ctx);
+  if (!M) {
+    Err.print(argv[0], errs());
+    return 1;
+  }
+
+  if (PrintLowered) {
+    if (Error E = lowerForHost(*M))
+      reportError(toString(std::move(E)));
+    M->print(outs(), nullptr);
+    return 0;
+  }
+
+  if (InitializeNativeTarget() || InitializeNativeTargetAsmPrinter())
+    reportError("no native target to compile for");
+  auto Contract = HostContract::create(std::move(M), std::move(Ctx), EntryName);
+  if (!Contract)
+    reportError(toString(Contract.takeError()));
+
+  Runner R{**Contract};
+  if (!CompareFile.empty()) {
+    auto BufOrErr = MemoryBuffer::getFile(CompareFile);
+    if (!BufOrErr)
+      reportError(CompareFile + ": " + BufOrErr.getError().message());
+    StringRef Contents = (*BufOrErr)->getBuffer();
+    if (!parseHex(Contents, R.Code))
+      R.Code.assign(Contents.bytes_begin(), Contents.bytes_end());
+  }
+
+  int Ret;
+  if (!BatchFile.empty()) {
+    Ret = runBatch(R);
+  } else {
+    std::vector<uint8_t> CallData;
+    if (!CallDataHex.empty() && !parseHex(CallDataHex, CallData))
+      reportError("invalid hex in --input");
+    Ret = R.run("", CallData) ? 0 : 1;
+  }
+
+  if (Repeat > 1) {
+    double Seconds = std::max(R.Time.count(), int64_t(1)) * 1e-9;
+    outs() << format("%llu runs in %.3f s (%.0f runs/s)\n",
+                     (unsigned long long)R.Runs, Seconds, R.Runs / Seconds);
+  }
+  return Ret;
+}
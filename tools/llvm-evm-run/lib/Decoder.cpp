@@ -0,0 +1,111 @@
+//===-- Decoder.cpp ---------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Decoder.h"
+#include "Interpreter.h"
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::evmrun;
+
+namespace {
+
+struct OpcodeInfoTable {
+  OpcodeInfo Info[256];
+
+  OpcodeInfoTable() {
+    for (unsigned Op = 0; Op != 256; ++Op) {
+      OpcodeInfo &I = Info[Op];
+      I.ImmSize = Op >= 0x60 && Op <= 0x7f ? Op - 0x5f : 0;
+      // Undefined opcodes halt like INVALID.
+      I.Flags = getOpcodeName(Op) ? OpcodeInfo::Defined
+                                  : OpcodeInfo::Terminator;
+    }
+    for (uint8_t Op : {0x00 /*STOP*/, 0x56 /*JUMP*/, 0xb0 /*JUMPTO*/,
+                       0xb7 /*RETURNSUB*/, 0xf3 /*RETURN*/, 0xfd /*REVERT*/,
+                       0xfe /*INVALID*/, 0xff /*SELFDESTRUCT*/})
+      Info[Op].Flags |= OpcodeInfo::Terminator;
+    // A subroutine returns to the instruction after JUMPSUB.
+    for (uint8_t Op : {0x57 /*JUMPI*/, 0xb3 /*JUMPSUB*/})
+      Info[Op].Flags |= OpcodeInfo::Terminator | OpcodeInfo::FallsThrough;
+    for (uint8_t Op : {0x5b /*JUMPDEST*/, 0xb5 /*BEGINSUB*/})
+      Info[Op].Flags |= OpcodeInfo::BlockEntry;
+  }
+};
+
+} // end anonymous namespace
+
+const OpcodeInfo *llvm::evmrun::getOpcodeInfoTable() {
+  static const OpcodeInfoTable Table;
+  return Table.Info;
+}
+
+void llvm::evmrun::decodeBytecode(ArrayRef<uint8_t> Code,
+                                  DecodedCode &Result) {
+  const OpcodeInfo *Table = getOpcodeInfoTable();
+  const uint32_t Size = Code.size();
+  const uint8_t *Bytes = Code.data();
+
+  Result.Instrs.clear();
+  Result.Blocks.clear();
+  Result.JumpDests.clear();
+  Result.JumpDests.resize(Size);
+  Result.SubroutineEntries.clear();
+  Result.SubroutineEntries.resize(Size);
+  // Compiled code averages well over one byte per instruction.
+  Result.Instrs.reserve(Size / 2 + 1);
+
+  // The block being built, if any.
+  bool InBlock = false;
+  DecodedBlock Block = {};
+  auto closeBlock = [&](uint32_t End, bool FallsThrough) {
+    Block.End = End;
+    Block.LastInstr = Result.Instrs.size();
+    Block.FallsThrough = FallsThrough;
+    Result.Blocks.push_back(Block);
+    InBlock = false;
+  };
+
+  for (uint32_t PC = 0; PC < Size;) {
+    const uint8_t Op = Bytes[PC];
+    const OpcodeInfo Info = Table[Op];
+
+    if (Info.Flags & OpcodeInfo::BlockEntry) {
+      if (InBlock)
+        closeBlock(PC, /*FallsThrough=*/true);
+      if (Op == 0x5b)
+        Result.JumpDests.set(PC);
+      else
+        Result.SubroutineEntries.set(PC);
+    }
+    if (!InBlock) {
+      Block.Begin = PC;
+      Block.FirstInstr = Result.Instrs.size();
+      Block.IsEntry = Info.Flags & OpcodeInfo::BlockEntry;
+      InBlock = true;
+    }
+
+    const uint32_t ImmSize = std::min<uint32_t>(Info.ImmSize, Size - PC - 1);
+    Result.Instrs.push_back({PC, Op, uint8_t(ImmSize)});
+    PC += 1 + ImmSize;
+
+    if (Info.Flags & OpcodeInfo::Terminator)
+      closeBlock(PC, Info.Flags & OpcodeInfo::FallsThrough);
+  }
+  // Running off the end of the code stops execution.
+  if (InBlock)
+    closeBlock(Size, /*FallsThrough=*/false);
+}
+
+Word llvm::evmrun::getImmediate(ArrayRef<uint8_t> Code,
+                                const DecodedInstr &I) {
+  const unsigned Size = getOpcodeInfoTable()[I.Opcode].ImmSize;
+  uint8_t Buf[32] = {0};
+  std::copy_n(Code.begin() + I.Offset + 1, I.ImmSize, Buf);
+  return Word::fromBytes(Buf, Size);
+}
@@ -0,0 +1,82 @@
+//===-- Decoder.h -----------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// A bulk decoder for EVM bytecode. One linear pass over the code, driven by
+/// a 256-entry opcode table, produces the instruction list, the basic blocks
+/// and the valid jump destinations. It is meant for analyzing many contracts
+/// at once, where decoding one instruction at a time through MCDisassembler
+/// is too slow.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLVM_EVM_RUN_DECODER_H
+#define LLVM_TOOLS_LLVM_EVM_RUN_DECODER_H
+
+#include "Word.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include <vector>
+
+namespace llvm {
+namespace evmrun {
+
+struct OpcodeInfo {
+  enum Flag : uint8_t {
+    Defined = 1 << 0,
+    // Ends a basic block. Execution does not fall through unless the
+    // instruction is also marked FallsThrough.
+    Terminator = 1 << 1,
+    FallsThrough = 1 << 2,
+    // Starts a basic block: JUMPDEST and BEGINSUB.
+    BlockEntry = 1 << 3,
+  };
+  uint8_t ImmSize;
+  uint8_t Flags;
+};
+
+// Properties of every opcode, indexed by the opcode byte.
+const OpcodeInfo *getOpcodeInfoTable();
+
+struct DecodedInstr {
+  uint32_t Offset;
+  uint8_t Opcode;
+  // Bytes of immediate actually present; less than the PUSH size when the
+  // code ends inside the immediate.
+  uint8_t ImmSize;
+};
+
+struct DecodedBlock {
+  // Byte range [Begin, End) and instruction range [FirstInstr, LastInstr).
+  uint32_t Begin, End;
+  uint32_t FirstInstr, LastInstr;
+  // The block starts with a JUMPDEST or BEGINSUB.
+  bool IsEntry;
+  // Execution may continue into the next block.
+  bool FallsThrough;
+};
+
+struct DecodedCode {
+  std::vector<DecodedInstr> Instrs;
+  std::vector<DecodedBlock> Blocks;
+  // Offsets of JUMPDEST and BEGINSUB outside PUSH immediates.
+  BitVector JumpDests;
+  BitVector SubroutineEntries;
+};
+
+// Decode Code into Result, reusing its storage.
+void decodeBytecode(ArrayRef<uint8_t> Code, DecodedCode &Result);
+
+// The immediate of a PUSH, zero padded past the end of the code.
+Word getImmediate(ArrayRef<uint8_t> Code, const DecodedInstr &I);
+
+} // namespace evmrun
+} // namespace llvm
+
+#endif // LLVM_TOOLS_LLVM_EVM_RUN_DECODER_H
@@ -0,0 +1,323 @@
+//===-- HostRuntime.cpp - EVM intrinsics on the host ----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "HostRuntime.h"
+#include "llvm/ADT/StringSwitch.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace llvm;
+using namespace llvm::evmrun;
+
+// The runtime whose contract is running on this thread.
+static thread_local HostRuntime *Active = nullptr;
+
+// Offsets and sizes above this cannot be paid for with any realistic gas
+// limit.
+static const uint64_t MaxMemoryWords = (uint64_t(1) << 32) / 32;
+
+static uint64_t memoryCost(uint64_t Words) {
+  return Words * 3 + Words * Words / 512;
+}
+
+// Copy Size bytes starting at Offset of Src to Dst, padding with zeros.
+static void copyPadded(uint8_t *Dst, ArrayRef<uint8_t> Src,
+                       const Word &OffsetW, uint64_t Size) {
+  uint64_t Avail = 0, Offset = 0;
+  if (OffsetW.fitsU64() && OffsetW.low() < Src.size()) {
+    Offset = OffsetW.low();
+    Avail = std::min<uint64_t>(Size, Src.size() - Offset);
+  }
+  if (Avail)
+    std::memcpy(Dst, Src.data() + Offset, Avail);
+  std::memset(Dst + Avail, 0, Size - Avail);
+}
+
+Word HostRuntime::loadStorage(const Word &Key) const {
+  auto It = StorageMap.find(Key);
+  return It == StorageMap.end() ? Word() : It->second;
+}
+
+void HostRuntime::storeStorage(const Word &Key, const Word &Value) {
+  if (Value.isZero())
+    StorageMap.erase(Key);
+  else
+    StorageMap[Key] = Value;
+}
+
+ExecutionResult HostRuntime::run(void (*Entry)(),
+                                 ArrayRef<uint8_t> Data) {
+  HostRuntime *Outer = Active;
+  Active = this;
+  CallData = Data;
+  Memory.clear();
+  Result = ExecutionResult();
+  // Halting unwinds the frames of the contract, which own no resources.
+  if (!setjmp(Halt)) {
+    Entry();
+    Result.Result = Status::Stop;
+  }
+  Active = Outer;
+  return std::move(Result);
+}
+
+void HostRuntime::halt(Status S) {
+  Result.Result = S;
+  if (!Result.succeeded() && S != Status::Revert)
+    Result.Logs.clear();
+  std::longjmp(Halt, 1);
+}
+
+// Memory is not metered, but it is bounded by what the gas limit would pay
+// for, which is also what keeps the Interpreter from growing it.
+uint8_t *HostRuntime::access(const Word &OffsetW, const Word &SizeW) {
+  if (SizeW.isZero())
+    return nullptr;
+  if (!OffsetW.fitsU64() || !SizeW.fitsU64() ||
+      OffsetW.low() + SizeW.low() < OffsetW.low())
+    halt(Status::OutOfGas);
+  uint64_t Words = (OffsetW.low() + SizeW.low() + 31) / 32;
+  if (Words > Memory.size() / 32) {
+    if (Words > MaxMemoryWords ||
+        (Env.GasLimit.fitsU64() && memoryCost(Words) > Env.GasLimit.low()))
+      halt(Status::OutOfGas);
+    Memory.resize(Words * 32);
+  }
+  return Memory.data() + OffsetW.low();
+}
+
+namespace llvm {
+namespace evmrun {
+
+// The host functions. They only use values that need no destruction around
+// a halt, which does not unwind them.
+struct HostCalls {
+  static HostRuntime &R() { return *Active; }
+  static const Environment &Env() { return Active->Env; }
+
+  static void stop(Word *, const Word *) { R().halt(Status::Stop); }
+
+  static void mload(Word *Res, const Word *A) {
+    *Res = Word::fromBytes(R().access(A[0], Word(32)));
+  }
+
+  static void mstore(Word *, const Word *A) {
+    A[1].toBytes(R().access(A[0], Word(32)));
+  }
+
+  static void mstore8(Word *, const Word *A) {
+    *R().access(A[0], Word(1)) = uint8_t(A[1].low());
+  }
+
+  static void exp(Word *Res, const Word *A) { *Res = A[0].pow(A[1]); }
+
+  static void byte(Word *Res, const Word *A) {
+    *Res = A[0].fitsU64() && A[0].low() < 32 ? Word(A[1].byte(A[0].low()))
+                                             : Word();
+  }
+
+  static void shl(Word *Res, const Word *A) {
+    *Res = A[0].fitsU64() && A[0].low() < 256 ? A[1].shl(A[0].low()) : Word();
+  }
+
+  static void shr(Word *Res, const Word *A) {
+    *Res = A[0].fitsU64() && A[0].low() < 256 ? A[1].lshr(A[0].low()) : Word();
+  }
+
+  static void sar(Word *Res, const Word *A) {
+    *Res = A[1].ashr(A[0].fitsU64() && A[0].low() < 256 ? A[0].low() : 256);
+  }
+
+  // Division and remainder by zero give zero, as on the EVM.
+  static void div(Word *Res, const Word *A) {
+    *Res = A[1].isZero()
+               ? Word()
+               : Word::fromAPInt(A[0].toAPInt().udiv(A[1].toAPInt()));
+  }
+
+  static void sdiv(Word *Res, const Word *A) {
+    *Res = A[1].isZero()
+               ? Word()
+               : Word::fromAPInt(A[0].toAPInt().sdiv(A[1].toAPInt()));
+  }
+
+  static void mod(Word *Res, const Word *A) {
+    *Res = A[1].isZero()
+               ? Word()
+               : Word::fromAPInt(A[0].toAPInt().urem(A[1].toAPInt()));
+  }
+
+  static void smod(Word *Res, const Word *A) {
+    *Res = A[1].isZero()
+               ? Word()
+               : Word::fromAPInt(A[0].toAPInt().srem(A[1].toAPInt()));
+  }
+
+  static void sha3(Word *Res, const Word *A) {
+    const uint8_t *P = R().access(A[0], A[1]);
+    *Res = keccak256(makeArrayRef(P, A[1].low()));
+  }
+
+  static void address(Word *Res, const Word *) { *Res = Env().Address; }
+  static void origin(Word *Res, const Word *) { *Res = Env().Origin; }
+  static void caller(Word *Res, const Word *) { *Res = Env().Caller; }
+  static void callvalue(Word *Res, const Word *) { *Res = Env().CallValue; }
+  static void gasprice(Word *Res, const Word *) { *Res = Env().GasPrice; }
+  static void coinbase(Word *Res, const Word *) { *Res = Env().Coinbase; }
+  static void timestamp(Word *Res, const Word *) { *Res = Env().Timestamp; }
+  static void number(Word *Res, const Word *) { *Res = Env().Number; }
+  static void difficulty(Word *Res, const Word *) { *Res = Env().Difficulty; }
+  static void gaslimit(Word *Res, const Word *) { *Res = Env().GasLimit; }
+  // All of the gas is left.
+  static void gas(Word *Res, const Word *) { *Res = Env().GasLimit; }
+
+  // No other accounts or blocks exist, there is no code to copy, and calls
+  // return no data.
+  static void zero(Word *Res, const Word *) { *Res = Word(); }
+
+  static void calldataload(Word *Res, const Word *A) {
+    uint8_t Buf[32];
+    copyPadded(Buf, R().CallData, A[0], 32);
+    *Res = Word::fromBytes(Buf);
+  }
+
+  static void calldatasize(Word *Res, const Word *) {
+    *Res = Word(R().CallData.size());
+  }
+
+  static void calldatacopy(Word *, const Word *A) {
+    if (uint8_t *P = R().access(A[0], A[2]))
+      copyPadded(P, R().CallData, A[1], A[2].low());
+  }
+
+  static void codecopy(Word *, const Word *A) {
+    if (uint8_t *P = R().access(A[0], A[2]))
+      std::memset(P, 0, A[2].low());
+  }
+
+  static void extcodecopy(Word *, const Word *A) {
+    if (uint8_t *P = R().access(A[1], A[3]))
+      std::memset(P, 0, A[3].low());
+  }
+
+  static void returndatacopy(Word *, const Word *A) {
+    if (!A[1].isZero() || !A[2].isZero())
+      R().halt(Status::OutOfBounds);
+  }
+
+  static void sload(Word *Res, const Word *A) { *Res = R().loadStorage(A[0]); }
+
+  static void sstore(Word *, const Word *A) { R().storeStorage(A[0], A[1]); }
+
+  static void msize(Word *Res, const Word *) {
+    *Res = Word(R().Memory.size());
+  }
+
+  template <unsigned N> static void log(Word *, const Word *A) {
+    const uint8_t *P = R().access(A[0], A[1]);
+    LogEntry Log;
+    Log.Topics.assign(A + 2, A + 2 + N);
+    if (P)
+      Log.Data.assign(P, P + A[1].low());
+    R().Result.Logs.push_back(std::move(Log));
+  }
+
+  // Contract creation and calls fail, as there are no other contracts.
+  static void create(Word *Res, const Word *A) {
+    R().access(A[1], A[2]);
+    *Res = Word();
+  }
+
+  template <unsigned Args> static void call(Word *Res, const Word *A) {
+    R().access(A[Args], A[Args + 1]);
+    R().access(A[Args + 2], A[Args + 3]);
+    *Res = Word();
+  }
+
+  static void output(const Word *A) {
+    const uint8_t *P = R().access(A[0], A[1]);
+    R().Result.Output.clear();
+    if (P)
+      R().Result.Output.assign(P, P + A[1].low());
+  }
+
+  static void ret(Word *, const Word *A) {
+    output(A);
+    R().halt(Status::Return);
+  }
+
+  static void revert(Word *, const Word *A) {
+    output(A);
+    R().halt(Status::Revert);
+  }
+
+  static void invalid(Word *, const Word *) {
+    R().halt(Status::InvalidOpcode);
+  }
+
+  static void selfdestruct(Word *, const Word *) {
+    R().halt(Status::SelfDestruct);
+  }
+};
+
+} // namespace evmrun
+} // namespace llvm
+
+HostFunction HostRuntime::getFunction(StringRef Name) {
+  using H = HostCalls;
+  return StringSwitch<HostFunction>(Name)
+      .Case("stop", H::stop)
+      .Case("mload", H::mload)
+      .Case("mstore", H::mstore)
+      .Case("mstore8", H::mstore8)
+      .Case("exp", H::exp)
+      .Case("byte", H::byte)
+      .Case("shl", H::shl)
+      .Case("shr", H::shr)
+      .Case("sar", H::sar)
+      .Case("div", H::div)
+      .Case("sdiv", H::sdiv)
+      .Case("mod", H::mod)
+      .Case("smod", H::smod)
+      .Case("sha3", H::sha3)
+      .Case("address", H::address)
+      .Case("origin", H::origin)
+      .Case("caller", H::caller)
+      .Case("callvalue", H::callvalue)
+      .Case("gasprice", H::gasprice)
+      .Case("coinbase", H::coinbase)
+      .Case("timestamp", H::timestamp)
+      .Case("number", H::number)
+      .Case("difficulty", H::difficulty)
+      .Case("gaslimit", H::gaslimit)
+      .Case("gas", H::gas)
+      .Cases("balance", "extcodesize", "blockhash", "codesize", H::zero)
+      .Case("returndatasize", H::zero)
+      .Case("calldataload", H::calldataload)
+      .Case("calldatasize", H::calldatasize)
+      .Case("calldatacopy", H::calldatacopy)
+      .Case("codecopy", H::codecopy)
+      .Case("extcodecopy", H::extcodecopy)
+      .Case("returndatacopy", H::returndatacopy)
+      .Case("sload", H::sload)
+      .Case("sstore", H::sstore)
+      .Case("msize", H::msize)
+      .Case("log0", H::log<0>)
+      .Case("log1", H::log<1>)
+      .Case("log2", H::log<2>)
+      .Case("log3", H::log<3>)
+      .Case("log4", H::log<4>)
+      .Cases("create", "create2", H::create)
+      .Cases("call", "callcode", H::call<3>)
+      .Cases("delegatecall", "staticcall", H::call<2>)
+      .Case("return", H::ret)
+      .Case("revert", H::revert)
+      .Case("invalid", H::invalid)
+      .Case("selfdestruct", H::selfdestruct)
+      .Default(nullptr);
+}
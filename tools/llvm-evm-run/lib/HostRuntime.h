@@ -0,0 +1,86 @@
+//===-- HostRuntime.h -------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// The host side of contracts compiled for the host instead of the EVM, see
+/// llvm-evm-jit. Every EVM intrinsic, and 256-bit division, becomes a call
+/// to a host function of this runtime:
+///
+///   void __evm_<name>(Word *Result, const Word *Args)
+///
+/// where Args holds the operands in the order of the intrinsic, the first
+/// one being the top of the stack of the opcode. The functions act on the
+/// state of the HostRuntime that is running, and follow the Interpreter: the
+/// same memory, storage, logs and failed calls, so that the two can be
+/// compared. Gas is not metered.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLVM_EVM_RUN_HOSTRUNTIME_H
+#define LLVM_TOOLS_LLVM_EVM_RUN_HOSTRUNTIME_H
+
+#include "Interpreter.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include <csetjmp>
+#include <map>
+#include <vector>
+
+namespace llvm {
+namespace evmrun {
+
+using HostFunction = void (*)(Word *Result, const Word *Args);
+
+class HostRuntime {
+public:
+  HostRuntime() = default;
+
+  Environment &getEnvironment() { return Env; }
+
+  // Persistent storage, shared by every run of this runtime.
+  Word loadStorage(const Word &Key) const;
+  void storeStorage(const Word &Key, const Word &Value);
+  void clearStorage() { StorageMap.clear(); }
+
+  // Call Entry, a contract entry compiled for the host, with the given call
+  // data. The contract halts through the runtime, or by returning from
+  // Entry, which stops.
+  ExecutionResult run(void (*Entry)(), ArrayRef<uint8_t> CallData);
+
+  // The host function for the intrinsic or operation Name, such as
+  // "calldataload" or "sdiv", or nullptr if there is none.
+  static HostFunction getFunction(StringRef Name);
+
+  // Prefix of the symbols of the host functions.
+  static constexpr const char *SymbolPrefix = "__evm_";
+
+private:
+  friend struct HostCalls;
+
+  // Make [Offset, Offset + Size) of memory addressable, or halt.
+  uint8_t *access(const Word &Offset, const Word &Size);
+  [[noreturn]] void halt(Status S);
+
+  Environment Env;
+  struct WordLess {
+    bool operator()(const Word &A, const Word &B) const { return ult(A, B); }
+  };
+  std::map<Word, Word, WordLess> StorageMap;
+
+  // State of the current run.
+  ArrayRef<uint8_t> CallData;
+  std::vector<uint8_t> Memory;
+  ExecutionResult Result;
+  std::jmp_buf Halt;
+};
+
+} // namespace evmrun
+} // namespace llvm
+
+#endif // LLVM_TOOLS_LLVM_EVM_RUN_HOSTRUNTIME_H
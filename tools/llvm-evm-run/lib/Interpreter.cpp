@@ -0,0 +1,1036 @@
+//===-- Interpreter.cpp -----------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The dispatch loop is direct-threaded (computed goto) when the host compiler
+// supports labels as values, and a plain switch otherwise. Each handler is
+// reached with its stack arguments and static gas already checked.
+//
+// Gas follows the Istanbul schedule without refunds. SSTORE costs 20000 when
+// a zero slot becomes non-zero and 5000 otherwise. The subroutine opcodes of
+// this target use the costs from EVMInstrInfo.td.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Interpreter.h"
+#include "llvm/Support/ErrorHandling.h"
+#include <algorithm>
+#include <cstdio>
+
+#if defined(__GNUC__)
+#define EVMRUN_THREADED_DISPATCH 1
+#endif
+
+using namespace llvm;
+using namespace llvm::evmrun;
+
+// Opcode, name, stack items popped, stack items pushed, static gas.
+#define EVMRUN_OPCODES(X)                                                      \
+  X(0x00, STOP, 0, 0, 0)                                                       \
+  X(0x01, ADD, 2, 1, 3)                                                        \
+  X(0x02, MUL, 2, 1, 5)                                                        \
+  X(0x03, SUB, 2, 1, 3)                                                        \
+  X(0x04, DIV, 2, 1, 5)                                                        \
+  X(0x05, SDIV, 2, 1, 5)                                                       \
+  X(0x06, MOD, 2, 1, 5)                                                        \
+  X(0x07, SMOD, 2, 1, 5)                                                       \
+  X(0x08, ADDMOD, 3, 1, 8)                                                     \
+  X(0x09, MULMOD, 3, 1, 8)                                                     \
+  X(0x0a, EXP, 2, 1, 10)                                                       \
+  X(0x0b, SIGNEXTEND, 2, 1, 5)                                                 \
+  X(0x10, LT, 2, 1, 3)                                                         \
+  X(0x11, GT, 2, 1, 3)                                                         \
+  X(0x12, SLT, 2, 1, 3)                                                        \
+  X(0x13, SGT, 2, 1, 3)                                                        \
+  X(0x14, EQ, 2, 1, 3)                                                         \
+  X(0x15, ISZERO, 1, 1, 3)                                                     \
+  X(0x16, AND, 2, 1, 3)                                                        \
+  X(0x17, OR, 2, 1, 3)                                                         \
+  X(0x18, XOR, 2, 1, 3)                                                        \
+  X(0x19, NOT, 1, 1, 3)                                                        \
+  X(0x1a, BYTE, 2, 1, 3)                                                       \
+  X(0x1b, SHL, 2, 1, 3)                                                        \
+  X(0x1c, SHR, 2, 1, 3)                                                        \
+  X(0x1d, SAR, 2, 1, 3)                                                        \
+  X(0x20, SHA3, 2, 1, 30)                                                      \
+  X(0x30, ADDRESS, 0, 1, 2)                                                    \
+  X(0x31, BALANCE, 1, 1, 700)                                                  \
+  X(0x32, ORIGIN, 0, 1, 2)                                                     \
+  X(0x33, CALLER, 0, 1, 2)                                                     \
+  X(0x34, CALLVALUE, 0, 1, 2)                                                  \
+  X(0x35, CALLDATALOAD, 1, 1, 3)                                               \
+  X(0x36, CALLDATASIZE, 0, 1, 2)                                               \
+  X(0x37, CALLDATACOPY, 3, 0, 3)                                               \
+  X(0x38, CODESIZE, 0, 1, 2)                                                   \
+  X(0x39, CODECOPY, 3, 0, 3)                                                   \
+  X(0x3a, GASPRICE, 0, 1, 2)                                                   \
+  X(0x3b, EXTCODESIZE, 1, 1, 700)                                              \
+  X(0x3c, EXTCODECOPY, 4, 0, 700)                                              \
+  X(0x3d, RETURNDATASIZE, 0, 1, 2)                                             \
+  X(0x3e, RETURNDATACOPY, 3, 0, 3)                                             \
+  X(0x3f, EXTCODEHASH, 1, 1, 700)                                              \
+  X(0x40, BLOCKHASH, 1, 1, 20)                                                 \
+  X(0x41, COINBASE, 0, 1, 2)                                                   \
+  X(0x42, TIMESTAMP, 0, 1, 2)                                                  \
+  X(0x43, NUMBER, 0, 1, 2)                                                     \
+  X(0x44, DIFFICULTY, 0, 1, 2)                                                 \
+  X(0x45, GASLIMIT, 0, 1, 2)                                                   \
+  X(0x46, CHAINID, 0, 1, 2)                                                    \
+  X(0x47, SELFBALANCE, 0, 1, 5)                                                \
+  X(0x50, POP, 1, 0, 2)                                                        \
+  X(0x51, MLOAD, 1, 1, 3)                                                      \
+  X(0x52, MSTORE, 2, 0, 3)                                                     \
+  X(0x53, MSTORE8, 2, 0, 3)                                                    \
+  X(0x54, SLOAD, 1, 1, 800)                                                    \
+  X(0x55, SSTORE, 2, 0, 0)                                                     \
+  X(0x56, JUMP, 1, 0, 8)                                                       \
+  X(0x57, JUMPI, 2, 0, 10)                                                     \
+  X(0x58, PC, 0, 1, 2)                                                         \
+  X(0x59, MSIZE, 0, 1, 2)                                                      \
+  X(0x5a, GAS, 0, 1, 2)                                                        \
+  X(0x5b, JUMPDEST, 0, 0, 1)                                                   \
+  X(0xb0, JUMPTO, 1, 0, 8)                                                     \
+  X(0xb3, JUMPSUB, 1, 0, 8)                                                    \
+  X(0xb5, BEGINSUB, 0, 0, 1)                                                   \
+  X(0xb7, RETURNSUB, 0, 0, 2)                                                  \
+  X(0xf0, CREATE, 3, 1, 32000)                                                 \
+  X(0xf1, CALL, 7, 1, 700)                                                     \
+  X(0xf2, CALLCODE, 7, 1, 700)                                                 \
+  X(0xf3, RETURN, 2, 0, 0)                                                     \
+  X(0xf4, DELEGATECALL, 6, 1, 700)                                             \
+  X(0xf5, CREATE2, 4, 1, 32000)                                                \
+  X(0xfa, STATICCALL, 6, 1, 700)                                               \
+  X(0xfd, REVERT, 2, 0, 0)                                                     \
+  X(0xfe, INVALID, 0, 0, 0)                                                    \
+  X(0xff, SELFDESTRUCT, 1, 0, 5000)
+
+namespace {
+
+// Handlers. PUSH, DUP, SWAP and LOG each share one handler for all widths.
+enum Kind : uint8_t {
+#define EVMRUN_KIND(Code, Name, Pops, Pushes, Gas) K_##Name,
+  EVMRUN_OPCODES(EVMRUN_KIND)
+#undef EVMRUN_KIND
+  K_PUSHN,
+  K_DUPN,
+  K_SWAPN,
+  K_LOGN,
+  K_UNDEFINED,
+};
+
+struct OpInfo {
+  const char *Name;
+  Kind K;
+  uint8_t Pops;
+  uint8_t Pushes;
+  uint16_t Gas;
+};
+
+struct OpTable {
+  OpInfo Info[256];
+  char Names[4][16][8];
+
+  OpTable() {
+    for (unsigned I = 0; I != 256; ++I)
+      Info[I] = {nullptr, K_UNDEFINED, 0, 0, 0};
+#define EVMRUN_INFO(Code, Name, Pops, Pushes, Gas)                             \
+  Info[Code] = {#Name, K_##Name, Pops, Pushes, Gas};
+    EVMRUN_OPCODES(EVMRUN_INFO)
+#undef EVMRUN_INFO
+    for (unsigned N = 1; N <= 32; ++N) {
+      char *Name = N <= 16 ? Names[0][N - 1] : Names[1][N - 17];
+      snprintf(Name, 8, "PUSH%u", N);
+      Info[0x5f + N] = {Name, K_PUSHN, 0, 1, 3};
+    }
+    for (unsigned N = 1; N <= 16; ++N) {
+      snprintf(Names[2][N - 1], 8, "DUP%u", N);
+      Info[0x7f + N] = {Names[2][N - 1], K_DUPN, uint8_t(N), uint8_t(N + 1),
+                        3};
+      snprintf(Names[3][N - 1], 8, "SWAP%u", N);
+      Info[0x8f + N] = {Names[3][N - 1], K_SWAPN, uint8_t(N + 1),
+                        uint8_t(N + 1), 3};
+    }
+    static const char *LogNames[] = {"LOG0", "LOG1", "LOG2", "LOG3", "LOG4"};
+    for (unsigned N = 0; N <= 4; ++N)
+      Info[0xa0 + N] = {LogNames[N], K_LOGN, uint8_t(N + 2), 0,
+                        uint16_t(375 * (N + 1))};
+  }
+};
+
+const OpTable &getOpTable() {
+  static const OpTable Table;
+  return Table;
+}
+
+const unsigned MaxStackSize = 1024;
+
+// Offsets and sizes above this cannot be paid for with any realistic gas
+// limit, so they are treated as running out of gas.
+const uint64_t MaxMemoryOffset = uint64_t(1) << 32;
+
+uint64_t memoryCost(uint64_t Words) { return Words * 3 + Words * Words / 512; }
+
+uint64_t numWords(uint64_t Size) { return (Size + 31) / 32; }
+
+// Mutable state of one execution, shared by the handlers.
+struct Frame {
+  uint64_t Gas;
+  std::vector<uint8_t> Memory;
+  OpcodeStats *Stats;
+  uint8_t Op = 0;
+
+  bool charge(uint64_t Amount) {
+    if (Gas < Amount)
+      return false;
+    Gas -= Amount;
+    if (Stats)
+      Stats->Gas[Op] += Amount;
+    return true;
+  }
+
+  // Make [Offset, Offset + Size) addressable, paying for the expansion.
+  bool access(const Word &OffsetW, const Word &SizeW, uint64_t &Offset,
+              uint64_t &Size) {
+    Offset = 0;
+    if (!SizeW.fitsU64() || SizeW.low() > MaxMemoryOffset)
+      return false;
+    Size = SizeW.low();
+    if (Size == 0)
+      return true;
+    if (!OffsetW.fitsU64() || OffsetW.low() > MaxMemoryOffset)
+      return false;
+    Offset = OffsetW.low();
+    uint64_t Words = numWords(Offset + Size);
+    uint64_t Current = Memory.size() / 32;
+    if (Words <= Current)
+      return true;
+    if (!charge(memoryCost(Words) - memoryCost(Current)))
+      return false;
+    Memory.resize(Words * 32);
+    return true;
+  }
+};
+
+// Copy Size bytes starting at Offset of Src to Dst, padding with zeros.
+void copyPadded(uint8_t *Dst, ArrayRef<uint8_t> Src, const Word &OffsetW,
+                uint64_t Size) {
+  uint64_t Avail = 0, Offset = 0;
+  if (OffsetW.fitsU64() && OffsetW.low() < Src.size()) {
+    Offset = OffsetW.low();
+    Avail = std::min<uint64_t>(Size, Src.size() - Offset);
+  }
+  if (Avail)
+    std::memcpy(Dst, Src.data() + Offset, Avail);
+  std::memset(Dst + Avail, 0, Size - Avail);
+}
+
+} // end anonymous namespace
+
+StringRef llvm::evmrun::getStatusName(Status S) {
+  switch (S) {
+  case Status::Stop:
+    return "stop";
+  case Status::Return:
+    return "return";
+  case Status::Revert:
+    return "revert";
+  case Status::OutOfGas:
+    return "out-of-gas";
+  case Status::StackUnderflow:
+    return "stack-underflow";
+  case Status::StackOverflow:
+    return "stack-overflow";
+  case Status::BadJump:
+    return "bad-jump";
+  case Status::InvalidOpcode:
+    return "invalid-opcode";
+  case Status::OutOfBounds:
+    return "out-of-bounds";
+  case Status::SelfDestruct:
+    return "selfdestruct";
+  }
+  llvm_unreachable("unknown status");
+}
+
+const char *llvm::evmrun::getOpcodeName(uint8_t Opcode) {
+  return getOpTable().Info[Opcode].Name;
+}
+
+Word Interpreter::loadStorage(const Word &Key) const {
+  auto It = StorageMap.find(Key);
+  return It == StorageMap.end() ? Word() : It->second;
+}
+
+void Interpreter::storeStorage(const Word &Key, const Word &Value) {
+  if (Value.isZero())
+    StorageMap.erase(Key);
+  else
+    StorageMap[Key] = Value;
+}
+
+ExecutionResult Interpreter::run(ArrayRef<uint8_t> CodeRef,
+                                 ArrayRef<uint8_t> CallData,
+                                 uint64_t GasLimit) {
+  const OpInfo *Info = getOpTable().Info;
+  ExecutionResult R;
+
+  // Pad the code so that PUSH immediates and falling off the end read zeros,
+  // which decode as STOP.
+  const uint64_t CodeSize = CodeRef.size();
+  std::vector<uint8_t> CodeBuf(CodeRef.begin(), CodeRef.end());
+  CodeBuf.resize(CodeSize + 33, 0);
+  const uint8_t *Code = CodeBuf.data();
+
+  // Valid JUMPDEST and BEGINSUB positions, skipping PUSH immediates.
+  enum : uint8_t { NotDest, IsJumpDest, IsBeginSub };
+  std::vector<uint8_t> Dest(CodeSize, NotDest);
+  for (uint64_t I = 0; I < CodeSize; ++I) {
+    if (Code[I] == 0x5b)
+      Dest[I] = IsJumpDest;
+    else if (Code[I] == 0xb5)
+      Dest[I] = IsBeginSub;
+    else if (Code[I] >= 0x60 && Code[I] <= 0x7f)
+      I += Code[I] - 0x5f;
+  }
+
+  std::vector<Word> StackBuf(MaxStackSize);
+  Word *Stack = StackBuf.data();
+  unsigned SP = 0;
+  std::vector<uint64_t> ReturnStack;
+  std::vector<uint8_t> ReturnData;
+
+  Frame F;
+  F.Gas = GasLimit;
+  F.Stats = CollectStats ? &Stats : nullptr;
+
+  uint64_t PC = 0;
+  uint8_t Op = 0;
+  Status S = Status::Stop;
+
+#define TOP(N) Stack[SP - 1 - (N)]
+#define CHARGE(Amount)                                                         \
+  do {                                                                         \
+    if (!F.charge(Amount))                                                     \
+      goto OutOfGas;                                                           \
+  } while (0)
+#define ACCESS(OffsetW, SizeW, Offset, Size)                                   \
+  do {                                                                         \
+    if (!F.access(OffsetW, SizeW, Offset, Size))                               \
+      goto OutOfGas;                                                           \
+  } while (0)
+
+  // Common prologue of every instruction: decode, check the stack, and pay
+  // the static cost.
+#define DECODE()                                                               \
+  do {                                                                         \
+    Op = Code[PC];                                                             \
+    F.Op = Op;                                                                 \
+    const OpInfo &I = Info[Op];                                                \
+    if (SP < I.Pops)                                                           \
+      goto StackUnderflow;                                                     \
+    if (SP - I.Pops + I.Pushes > MaxStackSize)                                 \
+      goto StackOverflow;                                                      \
+    if (F.Gas < I.Gas)                                                         \
+      goto OutOfGas;                                                           \
+    F.Gas -= I.Gas;                                                            \
+    ++R.Steps;                                                                 \
+    if (F.Stats) {                                                             \
+      ++Stats.Count[Op];                                                       \
+      Stats.Gas[Op] += I.Gas;                                                  \
+    }                                                                          \
+  } while (0)
+
+#ifdef EVMRUN_THREADED_DISPATCH
+  static void *const Labels[] = {
+#define EVMRUN_LABEL(Code, Name, Pops, Pushes, Gas) &&L_##Name,
+      EVMRUN_OPCODES(EVMRUN_LABEL)
+#undef EVMRUN_LABEL
+      &&L_PUSHN, &&L_DUPN, &&L_SWAPN, &&L_LOGN, &&L_UNDEFINED};
+#define CASE(Name) L_##Name
+#define NEXT()                                                                 \
+  do {                                                                         \
+    DECODE();                                                                  \
+    goto *Labels[Info[Op].K];                                                  \
+  } while (0)
+
+  NEXT();
+#else
+#define CASE(Name) case K_##Name
+#define NEXT() continue
+
+  for (;;) {
+    DECODE();
+    switch (Info[Op].K) {
+#endif
+
+  CASE(STOP):
+    S = Status::Stop;
+    goto Halt;
+
+  CASE(ADD):
+    TOP(1) = TOP(0) + TOP(1);
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(MUL):
+    TOP(1) = TOP(0) * TOP(1);
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(SUB):
+    TOP(1) = TOP(0) - TOP(1);
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(DIV): {
+    const Word &A = TOP(0), &B = TOP(1);
+    if (B.isZero())
+      TOP(1) = Word();
+    else if (A.fitsU64() && B.fitsU64())
+      TOP(1) = Word(A.low() / B.low());
+    else
+      TOP(1) = Word::fromAPInt(A.toAPInt().udiv(B.toAPInt()));
+    --SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(SDIV): {
+    const Word &A = TOP(0), &B = TOP(1);
+    if (B.isZero())
+      TOP(1) = Word();
+    else
+      TOP(1) = Word::fromAPInt(A.toAPInt().sdiv(B.toAPInt()));
+    --SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(MOD): {
+    const Word &A = TOP(0), &B = TOP(1);
+    if (B.isZero())
+      TOP(1) = Word();
+    else if (A.fitsU64() && B.fitsU64())
+      TOP(1) = Word(A.low() % B.low());
+    else
+      TOP(1) = Word::fromAPInt(A.toAPInt().urem(B.toAPInt()));
+    --SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(SMOD): {
+    const Word &A = TOP(0), &B = TOP(1);
+    if (B.isZero())
+      TOP(1) = Word();
+    else
+      TOP(1) = Word::fromAPInt(A.toAPInt().srem(B.toAPInt()));
+    --SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(ADDMOD): {
+    const Word &N = TOP(2);
+    if (N.isZero()) {
+      TOP(2) = Word();
+    } else {
+      APInt Sum = TOP(0).toAPInt().zext(257) + TOP(1).toAPInt().zext(257);
+      TOP(2) = Word::fromAPInt(Sum.urem(N.toAPInt().zext(257)));
+    }
+    SP -= 2;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(MULMOD): {
+    const Word &N = TOP(2);
+    if (N.isZero()) {
+      TOP(2) = Word();
+    } else {
+      APInt Prod = TOP(0).toAPInt().zext(512) * TOP(1).toAPInt().zext(512);
+      TOP(2) = Word::fromAPInt(Prod.urem(N.toAPInt().zext(512)));
+    }
+    SP -= 2;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(EXP): {
+    CHARGE(50 * TOP(1).byteWidth());
+    TOP(1) = TOP(0).pow(TOP(1));
+    --SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(SIGNEXTEND): {
+    const Word &B = TOP(0);
+    if (B.fitsU64() && B.low() < 31) {
+      unsigned Bits = 256 - 8 * (B.low() + 1);
+      TOP(1) = TOP(1).shl(Bits).ashr(Bits);
+    }
+    --SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(LT):
+    TOP(1) = Word(ult(TOP(0), TOP(1)));
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(GT):
+    TOP(1) = Word(ult(TOP(1), TOP(0)));
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(SLT):
+    TOP(1) = Word(slt(TOP(0), TOP(1)));
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(SGT):
+    TOP(1) = Word(slt(TOP(1), TOP(0)));
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(EQ):
+    TOP(1) = Word(TOP(0) == TOP(1));
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(ISZERO):
+    TOP(0) = Word(TOP(0).isZero());
+    ++PC;
+    NEXT();
+
+  CASE(AND):
+    TOP(1) = TOP(0) & TOP(1);
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(OR):
+    TOP(1) = TOP(0) | TOP(1);
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(XOR):
+    TOP(1) = TOP(0) ^ TOP(1);
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(NOT):
+    TOP(0) = ~TOP(0);
+    ++PC;
+    NEXT();
+
+  CASE(BYTE): {
+    const Word &N = TOP(0);
+    TOP(1) = N.fitsU64() && N.low() < 32 ? Word(TOP(1).byte(N.low())) : Word();
+    --SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(SHL): {
+    const Word &N = TOP(0);
+    TOP(1) = N.fitsU64() && N.low() < 256 ? TOP(1).shl(N.low()) : Word();
+    --SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(SHR): {
+    const Word &N = TOP(0);
+    TOP(1) = N.fitsU64() && N.low() < 256 ? TOP(1).lshr(N.low()) : Word();
+    --SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(SAR): {
+    const Word &N = TOP(0);
+    TOP(1) = TOP(1).ashr(N.fitsU64() && N.low() < 256 ? N.low() : 256);
+    --SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(SHA3): {
+    uint64_t Offset, Size;
+    ACCESS(TOP(0), TOP(1), Offset, Size);
+    CHARGE(6 * numWords(Size));
+    TOP(1) = keccak256(makeArrayRef(F.Memory.data() + Offset, Size));
+    --SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(ADDRESS):
+    Stack[SP++] = Env.Address;
+    ++PC;
+    NEXT();
+
+  CASE(BALANCE):
+  CASE(EXTCODESIZE):
+  CASE(EXTCODEHASH):
+  CASE(BLOCKHASH):
+    // No other accounts or blocks exist.
+    TOP(0) = Word();
+    ++PC;
+    NEXT();
+
+  CASE(ORIGIN):
+    Stack[SP++] = Env.Origin;
+    ++PC;
+    NEXT();
+
+  CASE(CALLER):
+    Stack[SP++] = Env.Caller;
+    ++PC;
+    NEXT();
+
+  CASE(CALLVALUE):
+    Stack[SP++] = Env.CallValue;
+    ++PC;
+    NEXT();
+
+  CASE(CALLDATALOAD): {
+    uint8_t Buf[32];
+    copyPadded(Buf, CallData, TOP(0), 32);
+    TOP(0) = Word::fromBytes(Buf);
+    ++PC;
+    NEXT();
+  }
+
+  CASE(CALLDATASIZE):
+    Stack[SP++] = Word(CallData.size());
+    ++PC;
+    NEXT();
+
+  CASE(CALLDATACOPY):
+  CASE(CODECOPY): {
+    uint64_t Offset, Size;
+    ACCESS(TOP(0), TOP(2), Offset, Size);
+    CHARGE(3 * numWords(Size));
+    ArrayRef<uint8_t> Src =
+        Info[Op].K == K_CODECOPY ? CodeRef : CallData;
+    if (Size)
+      copyPadded(F.Memory.data() + Offset, Src, TOP(1), Size);
+    SP -= 3;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(CODESIZE):
+    Stack[SP++] = Word(CodeSize);
+    ++PC;
+    NEXT();
+
+  CASE(GASPRICE):
+    Stack[SP++] = Env.GasPrice;
+    ++PC;
+    NEXT();
+
+  CASE(EXTCODECOPY): {
+    uint64_t Offset, Size;
+    ACCESS(TOP(1), TOP(3), Offset, Size);
+    CHARGE(3 * numWords(Size));
+    if (Size)
+      std::memset(F.Memory.data() + Offset, 0, Size);
+    SP -= 4;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(RETURNDATASIZE):
+    Stack[SP++] = Word(ReturnData.size());
+    ++PC;
+    NEXT();
+
+  CASE(RETURNDATACOPY): {
+    const Word &From = TOP(1), &Len = TOP(2);
+    if (!From.fitsU64() || !Len.fitsU64() ||
+        From.low() + Len.low() < From.low() ||
+        From.low() + Len.low() > ReturnData.size()) {
+      S = Status::OutOfBounds;
+      goto Fail;
+    }
+    uint64_t Offset, Size;
+    ACCESS(TOP(0), Len, Offset, Size);
+    CHARGE(3 * numWords(Size));
+    if (Size)
+      std::memcpy(F.Memory.data() + Offset, ReturnData.data() + From.low(),
+                  Size);
+    SP -= 3;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(COINBASE):
+    Stack[SP++] = Env.Coinbase;
+    ++PC;
+    NEXT();
+
+  CASE(TIMESTAMP):
+    Stack[SP++] = Env.Timestamp;
+    ++PC;
+    NEXT();
+
+  CASE(NUMBER):
+    Stack[SP++] = Env.Number;
+    ++PC;
+    NEXT();
+
+  CASE(DIFFICULTY):
+    Stack[SP++] = Env.Difficulty;
+    ++PC;
+    NEXT();
+
+  CASE(GASLIMIT):
+    Stack[SP++] = Env.GasLimit;
+    ++PC;
+    NEXT();
+
+  CASE(CHAINID):
+    Stack[SP++] = Env.ChainId;
+    ++PC;
+    NEXT();
+
+  CASE(SELFBALANCE):
+    Stack[SP++] = Word();
+    ++PC;
+    NEXT();
+
+  CASE(POP):
+    --SP;
+    ++PC;
+    NEXT();
+
+  CASE(MLOAD): {
+    uint64_t Offset, Size;
+    ACCESS(TOP(0), Word(32), Offset, Size);
+    TOP(0) = Word::fromBytes(F.Memory.data() + Offset);
+    ++PC;
+    NEXT();
+  }
+
+  CASE(MSTORE): {
+    uint64_t Offset, Size;
+    ACCESS(TOP(0), Word(32), Offset, Size);
+    TOP(1).toBytes(F.Memory.data() + Offset);
+    SP -= 2;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(MSTORE8): {
+    uint64_t Offset, Size;
+    ACCESS(TOP(0), Word(1), Offset, Size);
+    F.Memory[Offset] = uint8_t(TOP(1).low());
+    SP -= 2;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(SLOAD):
+    TOP(0) = loadStorage(TOP(0));
+    ++PC;
+    NEXT();
+
+  CASE(SSTORE): {
+    bool WasZero = loadStorage(TOP(0)).isZero();
+    CHARGE(WasZero && !TOP(1).isZero() ? 20000 : 5000);
+    storeStorage(TOP(0), TOP(1));
+    SP -= 2;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(JUMP):
+  CASE(JUMPTO): {
+    const Word &Target = TOP(0);
+    if (!Target.fitsU64() || Target.low() >= CodeSize ||
+        Dest[Target.low()] != IsJumpDest)
+      goto BadJump;
+    PC = Target.low();
+    --SP;
+    NEXT();
+  }
+
+  CASE(JUMPI): {
+    const Word &Target = TOP(0);
+    if (TOP(1).isZero()) {
+      ++PC;
+    } else {
+      if (!Target.fitsU64() || Target.low() >= CodeSize ||
+          Dest[Target.low()] != IsJumpDest)
+        goto BadJump;
+      PC = Target.low();
+    }
+    SP -= 2;
+    NEXT();
+  }
+
+  CASE(PC):
+    Stack[SP++] = Word(PC);
+    ++PC;
+    NEXT();
+
+  CASE(MSIZE):
+    Stack[SP++] = Word(F.Memory.size());
+    ++PC;
+    NEXT();
+
+  CASE(GAS):
+    Stack[SP++] = Word(F.Gas);
+    ++PC;
+    NEXT();
+
+  CASE(JUMPDEST):
+    ++PC;
+    NEXT();
+
+  CASE(JUMPSUB): {
+    const Word &Target = TOP(0);
+    if (!Target.fitsU64() || Target.low() >= CodeSize ||
+        Dest[Target.low()] != IsBeginSub || ReturnStack.size() >= 1023)
+      goto BadJump;
+    ReturnStack.push_back(PC + 1);
+    PC = Target.low() + 1;
+    --SP;
+    NEXT();
+  }
+
+  CASE(BEGINSUB):
+    // Subroutines can only be entered through JUMPSUB.
+    goto BadJump;
+
+  CASE(RETURNSUB):
+    if (ReturnStack.empty())
+      goto BadJump;
+    PC = ReturnStack.back();
+    ReturnStack.pop_back();
+    NEXT();
+
+  CASE(CREATE):
+  CASE(CREATE2): {
+    // Contract creation is not supported; it fails and returns address 0.
+    uint64_t Offset, Size;
+    ACCESS(TOP(1), TOP(2), Offset, Size);
+    if (Info[Op].K == K_CREATE2)
+      CHARGE(6 * numWords(Size));
+    SP -= Info[Op].Pops;
+    Stack[SP++] = Word();
+    ReturnData.clear();
+    ++PC;
+    NEXT();
+  }
+
+  CASE(CALL):
+  CASE(CALLCODE):
+  CASE(DELEGATECALL):
+  CASE(STATICCALL): {
+    // There are no other contracts, so every call fails.
+    unsigned Args = Info[Op].Pops == 7 ? 3 : 2;
+    uint64_t Offset, Size;
+    ACCESS(TOP(Args), TOP(Args + 1), Offset, Size);
+    ACCESS(TOP(Args + 2), TOP(Args + 3), Offset, Size);
+    SP -= Info[Op].Pops;
+    Stack[SP++] = Word();
+    ReturnData.clear();
+    ++PC;
+    NEXT();
+  }
+
+  CASE(RETURN):
+  CASE(REVERT): {
+    uint64_t Offset, Size;
+    ACCESS(TOP(0), TOP(1), Offset, Size);
+    R.Output.assign(F.Memory.begin() + Offset,
+                    F.Memory.begin() + Offset + Size);
+    S = Info[Op].K == K_RETURN ? Status::Return : Status::Revert;
+    goto Halt;
+  }
+
+  CASE(INVALID):
+  CASE(UNDEFINED):
+    S = Status::InvalidOpcode;
+    goto Fail;
+
+  CASE(SELFDESTRUCT):
+    S = Status::SelfDestruct;
+    goto Halt;
+
+  CASE(PUSHN): {
+    unsigned N = Op - 0x5f;
+    Stack[SP++] = Word::fromBytes(Code + PC + 1, N);
+    PC += N + 1;
+    NEXT();
+  }
+
+  CASE(DUPN): {
+    unsigned N = Op - 0x7f;
+    Stack[SP] = Stack[SP - N];
+    ++SP;
+    ++PC;
+    NEXT();
+  }
+
+  CASE(SWAPN): {
+    unsigned N = Op - 0x8f;
+    std::swap(TOP(0), TOP(N));
+    ++PC;
+    NEXT();
+  }
+
+  CASE(LOGN): {
+    unsigned N = Op - 0xa0;
+    uint64_t Offset, Size;
+    ACCESS(TOP(0), TOP(1), Offset, Size);
+    CHARGE(8 * Size);
+    LogEntry Log;
+    for (unsigned I = 0; I != N; ++I)
+      Log.Topics.push_back(TOP(2 + I));
+    Log.Data.assign(F.Memory.begin() + Offset,
+                    F.Memory.begin() + Offset + Size);
+    R.Logs.push_back(std::move(Log));
+    SP -= N + 2;
+    ++PC;
+    NEXT();
+  }
+
+#ifndef EVMRUN_THREADED_DISPATCH
+    }
+  }
+#endif
+
+#undef CASE
+#undef NEXT
+#undef DECODE
+#undef ACCESS
+#undef CHARGE
+#undef TOP
+
+OutOfGas:
+  S = Status::OutOfGas;
+  goto Fail;
+StackUnderflow:
+  S = Status::StackUnderflow;
+  goto Fail;
+StackOverflow:
+  S = Status::StackOverflow;
+  goto Fail;
+BadJump:
+  S = Status::BadJump;
+  goto Fail;
+
+Fail:
+  // Exceptional halts consume all remaining gas.
+  F.Gas = 0;
+  R.Logs.clear();
+Halt:
+  R.Result = S;
+  R.GasUsed = GasLimit - F.Gas;
+  R.PC = PC;
+  return R;
+}
+
+//===----------------------------------------------------------------------===//
+// Keccak-256
+//===----------------------------------------------------------------------===//
+
+static const uint64_t KeccakRoundConstants[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL,
+    0x8000000080008000ULL, 0x000000000000808bULL, 0x0000000080000001ULL,
+    0x8000000080008081ULL, 0x8000000000008009ULL, 0x000000000000008aULL,
+    0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+    0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL,
+    0x8000000000008003ULL, 0x8000000000008002ULL, 0x8000000000000080ULL,
+    0x000000000000800aULL, 0x800000008000000aULL, 0x8000000080008081ULL,
+    0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL};
+
+static const unsigned KeccakRotations[25] = {
+    0, 1, 62, 28, 27, 36, 44, 6, 55, 20, 3, 10, 43,
+    25, 39, 41, 45, 15, 21, 8, 18, 2, 61, 56, 14};
+
+static uint64_t rotl64(uint64_t X, unsigned N) {
+  return N ? (X << N) | (X >> (64 - N)) : X;
+}
+
+static void keccakF1600(uint64_t A[25]) {
+  for (unsigned Round = 0; Round != 24; ++Round) {
+    // Theta.
+    uint64_t C[5], D[5];
+    for (unsigned X = 0; X != 5; ++X)
+      C[X] = A[X] ^ A[X + 5] ^ A[X + 10] ^ A[X + 15] ^ A[X + 20];
+    for (unsigned X = 0; X != 5; ++X)
+      D[X] = C[(X + 4) % 5] ^ rotl64(C[(X + 1) % 5], 1);
+    for (unsigned I = 0; I != 25; ++I)
+      A[I] ^= D[I % 5];
+
+    // Rho and pi.
+    uint64_t B[25];
+    for (unsigned X = 0; X != 5; ++X)
+      for (unsigned Y = 0; Y != 5; ++Y)
+        B[Y + 5 * ((2 * X + 3 * Y) % 5)] =
+            rotl64(A[X + 5 * Y], KeccakRotations[X + 5 * Y]);
+
+    // Chi.
+    for (unsigned Y = 0; Y != 5; ++Y)
+      for (unsigned X = 0; X != 5; ++X)
+        A[X + 5 * Y] = B[X + 5 * Y] ^
+                       (~B[(X + 1) % 5 + 5 * Y] & B[(X + 2) % 5 + 5 * Y]);
+
+    // Iota.
+    A[0] ^= KeccakRoundConstants[Round];
+  }
+}
+
+Word llvm::evmrun::keccak256(ArrayRef<uint8_t> Data) {
+  const unsigned Rate = 136;
+  uint64_t State[25] = {0};
+
+  auto Absorb = [&](const uint8_t *Block) {
+    for (unsigned I = 0; I != Rate / 8; ++I) {
+      uint64_t Lane = 0;
+      for (unsigned J = 0; J != 8; ++J)
+        Lane |= uint64_t(Block[I * 8 + J]) << (8 * J);
+      State[I] ^= Lane;
+    }
+    keccakF1600(State);
+  };
+
+  size_t Pos = 0;
+  for (; Data.size() - Pos >= Rate; Pos += Rate)
+    Absorb(Data.data() + Pos);
+
+  // Original Keccak padding (0x01 ... 0x80), not the SHA-3 one.
+  uint8_t Last[Rate] = {0};
+  if (Data.size() > Pos)
+    std::memcpy(Last, Data.data() + Pos, Data.size() - Pos);
+  Last[Data.size() - Pos] ^= 0x01;
+  Last[Rate - 1] ^= 0x80;
+  Absorb(Last);
+
+  uint8_t Digest[32];
+  for (unsigned I = 0; I != 32; ++I)
+    Digest[I] = uint8_t(State[I / 8] >> (8 * (I % 8)));
+  return Word::fromBytes(Digest);
+}
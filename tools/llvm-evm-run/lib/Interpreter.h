@@ -0,0 +1,125 @@
+//===-- Interpreter.h -------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// A small EVM bytecode interpreter with gas metering, used to run the code
+/// produced by the EVM backend without an external client. It executes a
+/// single frame: calls to other contracts and contract creation fail, and
+/// storage lives in memory for the lifetime of the Interpreter.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLVM_EVM_RUN_INTERPRETER_H
+#define LLVM_TOOLS_LLVM_EVM_RUN_INTERPRETER_H
+
+#include "Word.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include <map>
+#include <vector>
+
+namespace llvm {
+namespace evmrun {
+
+enum class Status {
+  Stop,         // STOP, or ran off the end of the code
+  Return,       // RETURN
+  Revert,       // REVERT
+  OutOfGas,
+  StackUnderflow,
+  StackOverflow,
+  BadJump,
+  InvalidOpcode,
+  OutOfBounds,  // RETURNDATACOPY past the end of the return data
+  SelfDestruct,
+};
+
+StringRef getStatusName(Status S);
+
+// Mnemonic of an opcode, or nullptr when it is not defined.
+const char *getOpcodeName(uint8_t Opcode);
+
+struct LogEntry {
+  std::vector<Word> Topics;
+  std::vector<uint8_t> Data;
+};
+
+struct ExecutionResult {
+  Status Result = Status::Stop;
+  uint64_t GasUsed = 0;
+  uint64_t Steps = 0;
+  // Program counter of the instruction that stopped execution.
+  uint64_t PC = 0;
+  std::vector<uint8_t> Output;
+  std::vector<LogEntry> Logs;
+
+  bool succeeded() const {
+    return Result == Status::Stop || Result == Status::Return ||
+           Result == Status::SelfDestruct;
+  }
+};
+
+// Execution counts and gas spent, per opcode.
+struct OpcodeStats {
+  uint64_t Count[256] = {0};
+  uint64_t Gas[256] = {0};
+
+  void clear() { *this = OpcodeStats(); }
+};
+
+struct Environment {
+  Word Address;
+  Word Caller;
+  Word Origin;
+  Word CallValue;
+  Word GasPrice;
+  Word Coinbase;
+  Word Timestamp;
+  Word Number;
+  Word Difficulty;
+  Word GasLimit = Word(10000000);
+  Word ChainId = Word(1);
+};
+
+class Interpreter {
+public:
+  Interpreter() = default;
+
+  Environment &getEnvironment() { return Env; }
+
+  // Collect per-opcode counters while running. This costs a few percent.
+  void setCollectStats(bool Enable) { CollectStats = Enable; }
+  const OpcodeStats &getStats() const { return Stats; }
+
+  // Persistent storage, shared by every run of this interpreter.
+  Word loadStorage(const Word &Key) const;
+  void storeStorage(const Word &Key, const Word &Value);
+  void clearStorage() { StorageMap.clear(); }
+
+  // Execute Code with the given call data and gas limit.
+  ExecutionResult run(ArrayRef<uint8_t> Code, ArrayRef<uint8_t> CallData,
+                      uint64_t GasLimit);
+
+private:
+  Environment Env;
+  bool CollectStats = false;
+  OpcodeStats Stats;
+  struct WordLess {
+    bool operator()(const Word &A, const Word &B) const { return ult(A, B); }
+  };
+  std::map<Word, Word, WordLess> StorageMap;
+};
+
+// Keccak-256 as used by SHA3.
+Word keccak256(ArrayRef<uint8_t> Data);
+
+} // namespace evmrun
+} // namespace llvm
+
+#endif // LLVM_TOOLS_LLVM_EVM_RUN_INTERPRETER_H
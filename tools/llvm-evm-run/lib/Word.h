@@ -0,0 +1,229 @@
+//===-- Word.h --------------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// A fixed-size 256-bit machine word. The common operations (add, sub, mul,
+/// bitwise, shifts and comparisons) work directly on four 64-bit limbs; the
+/// rare ones (division and modular arithmetic) go through APInt.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLVM_EVM_RUN_WORD_H
+#define LLVM_TOOLS_LLVM_EVM_RUN_WORD_H
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include <cstdint>
+#include <cstring>
+
+namespace llvm {
+namespace evmrun {
+
+struct Word {
+  // Least significant limb first.
+  uint64_t Limb[4];
+
+  Word() : Limb{0, 0, 0, 0} {}
+  Word(uint64_t V) : Limb{V, 0, 0, 0} {}
+
+  static Word fromAPInt(const APInt &V) {
+    Word W;
+    APInt Z = V.zextOrTrunc(256);
+    for (unsigned I = 0; I != 4; ++I)
+      W.Limb[I] = Z.getRawData()[I];
+    return W;
+  }
+
+  APInt toAPInt() const { return APInt(256, makeArrayRef(Limb, 4)); }
+
+  // Big-endian 32-byte encoding, as used by memory and calldata.
+  static Word fromBytes(const uint8_t *P, unsigned N = 32) {
+    Word W;
+    for (unsigned I = 0; I != N; ++I) {
+      unsigned Byte = N - 1 - I;
+      W.Limb[Byte / 8] |= uint64_t(P[I]) << (8 * (Byte % 8));
+    }
+    return W;
+  }
+
+  void toBytes(uint8_t *P) const {
+    for (unsigned I = 0; I != 32; ++I) {
+      unsigned Byte = 31 - I;
+      P[I] = uint8_t(Limb[Byte / 8] >> (8 * (Byte % 8)));
+    }
+  }
+
+  bool isZero() const { return (Limb[0] | Limb[1] | Limb[2] | Limb[3]) == 0; }
+  bool isNegative() const { return Limb[3] >> 63; }
+
+  // Whether the value fits in 64 bits.
+  bool fitsU64() const { return (Limb[1] | Limb[2] | Limb[3]) == 0; }
+  uint64_t low() const { return Limb[0]; }
+
+  // Number of significant bytes.
+  unsigned byteWidth() const {
+    for (int I = 3; I >= 0; --I)
+      if (Limb[I])
+        return I * 8 + (64 - countLeadingZeros(Limb[I]) + 7) / 8;
+    return 0;
+  }
+
+  friend bool operator==(const Word &A, const Word &B) {
+    return std::memcmp(A.Limb, B.Limb, sizeof(A.Limb)) == 0;
+  }
+  friend bool operator!=(const Word &A, const Word &B) { return !(A == B); }
+
+  friend bool ult(const Word &A, const Word &B) {
+    for (int I = 3; I >= 0; --I)
+      if (A.Limb[I] != B.Limb[I])
+        return A.Limb[I] < B.Limb[I];
+    return false;
+  }
+
+  friend bool slt(const Word &A, const Word &B) {
+    if (A.isNegative() != B.isNegative())
+      return A.isNegative();
+    return ult(A, B);
+  }
+
+  friend Word operator+(const Word &A, const Word &B) {
+    Word R;
+    uint64_t Carry = 0;
+    for (unsigned I = 0; I != 4; ++I) {
+      uint64_t S = A.Limb[I] + B.Limb[I];
+      uint64_t C1 = S < A.Limb[I];
+      R.Limb[I] = S + Carry;
+      Carry = C1 | (R.Limb[I] < S);
+    }
+    return R;
+  }
+
+  friend Word operator-(const Word &A, const Word &B) {
+    Word R;
+    uint64_t Borrow = 0;
+    for (unsigned I = 0; I != 4; ++I) {
+      uint64_t D = A.Limb[I] - B.Limb[I];
+      uint64_t B1 = A.Limb[I] < B.Limb[I];
+      R.Limb[I] = D - Borrow;
+      Borrow = B1 | (D < Borrow);
+    }
+    return R;
+  }
+
+  friend Word operator*(const Word &A, const Word &B) {
+    // Schoolbook multiplication on 32-bit halves, truncated to 256 bits.
+    uint32_t X[8], Y[8];
+    for (unsigned I = 0; I != 4; ++I) {
+      X[2 * I] = uint32_t(A.Limb[I]);
+      X[2 * I + 1] = uint32_t(A.Limb[I] >> 32);
+      Y[2 * I] = uint32_t(B.Limb[I]);
+      Y[2 * I + 1] = uint32_t(B.Limb[I] >> 32);
+    }
+    uint32_t Z[8] = {0};
+    for (unsigned I = 0; I != 8; ++I) {
+      if (!X[I])
+        continue;
+      uint64_t Carry = 0;
+      for (unsigned J = 0; I + J < 8; ++J) {
+        uint64_t T = uint64_t(X[I]) * Y[J] + Z[I + J] + Carry;
+        Z[I + J] = uint32_t(T);
+        Carry = T >> 32;
+      }
+    }
+    Word R;
+    for (unsigned I = 0; I != 4; ++I)
+      R.Limb[I] = uint64_t(Z[2 * I]) | (uint64_t(Z[2 * I + 1]) << 32);
+    return R;
+  }
+
+  friend Word operator&(const Word &A, const Word &B) {
+    Word R;
+    for (unsigned I = 0; I != 4; ++I)
+      R.Limb[I] = A.Limb[I] & B.Limb[I];
+    return R;
+  }
+
+  friend Word operator|(const Word &A, const Word &B) {
+    Word R;
+    for (unsigned I = 0; I != 4; ++I)
+      R.Limb[I] = A.Limb[I] | B.Limb[I];
+    return R;
+  }
+
+  friend Word operator^(const Word &A, const Word &B) {
+    Word R;
+    for (unsigned I = 0; I != 4; ++I)
+      R.Limb[I] = A.Limb[I] ^ B.Limb[I];
+    return R;
+  }
+
+  Word operator~() const {
+    Word R;
+    for (unsigned I = 0; I != 4; ++I)
+      R.Limb[I] = ~Limb[I];
+    return R;
+  }
+
+  Word shl(unsigned N) const {
+    Word R;
+    if (N >= 256)
+      return R;
+    unsigned L = N / 64, B = N % 64;
+    for (int I = 3; I >= int(L); --I) {
+      R.Limb[I] = Limb[I - L] << B;
+      if (B && I - int(L) - 1 >= 0)
+        R.Limb[I] |= Limb[I - L - 1] >> (64 - B);
+    }
+    return R;
+  }
+
+  Word lshr(unsigned N) const {
+    Word R;
+    if (N >= 256)
+      return R;
+    unsigned L = N / 64, B = N % 64;
+    for (unsigned I = 0; I + L < 4; ++I) {
+      R.Limb[I] = Limb[I + L] >> B;
+      if (B && I + L + 1 < 4)
+        R.Limb[I] |= Limb[I + L + 1] << (64 - B);
+    }
+    return R;
+  }
+
+  Word ashr(unsigned N) const {
+    if (!isNegative())
+      return lshr(N);
+    if (N >= 256)
+      return ~Word();
+    return ~((~*this).lshr(N));
+  }
+
+  // Exponentiation modulo 2^256, as the EXP opcode defines it.
+  Word pow(Word Exponent) const {
+    Word Result(1), Base = *this;
+    while (!Exponent.isZero()) {
+      if (Exponent.low() & 1)
+        Result = Result * Base;
+      Base = Base * Base;
+      Exponent = Exponent.lshr(1);
+    }
+    return Result;
+  }
+
+  // The byte at big-endian index N, as the BYTE opcode defines it.
+  uint8_t byte(unsigned N) const {
+    unsigned Byte = 31 - N;
+    return uint8_t(Limb[Byte / 8] >> (8 * (Byte % 8)));
+  }
+};
+
+} // namespace evmrun
+} // namespace llvm
+
+#endif // LLVM_TOOLS_LLVM_EVM_RUN_WORD_H
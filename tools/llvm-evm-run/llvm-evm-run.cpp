@@ -0,0 +1,436 @@
+//===-- llvm-evm-run.cpp - EVM bytecode interpreter -------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Runs EVM bytecode, such as the output of llc -mtriple=evm -filetype=obj,
+/// and prints the returned data together with the gas used.
+///
+/// In batch mode every line of the input names one test case:
+///   <name> <code file or 0x-prefixed code> [<0x-prefixed call data>]
+/// and one result line is printed per case, so that a whole test suite runs
+/// in a single process.
+///
+/// With --blocks the code is decoded instead of run: its basic blocks and
+/// instructions are listed, or in batch mode summarized one line per case.
+///
+/// With --deploy the code is init code: it is run first, and the runtime
+/// code it returns is then called with the call data.
+///
+/// With --profile-map the code is taken to be built with
+/// llc -evm-profile-generate: the counters it logs in all runs are summed,
+/// and written as an indexed profile for llc -evm-profile-use.
+///
+//===----------------------------------------------------------------------===//
+
+#include "lib/Decoder.h"
+#include "lib/Interpreter.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/BinaryFormat/EVM.h"
+#include "llvm/ProfileData/InstrProfWriter.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace llvm;
+using namespace llvm::evmrun;
+
+static cl::OptionCategory EVMRunCat("llvm-evm-run Options");
+
+static cl::opt<std::string> InputFilename(cl::Positional,
+                                          cl::desc("<bytecode file>"),
+                                          cl::init("-"), cl::cat(EVMRunCat));
+
+static cl::opt<std::string>
+    CodeHex("code", cl::desc("Hex encoded bytecode to run instead of a file"),
+            cl::cat(EVMRunCat));
+
+static cl::opt<std::string> CallDataHex("input",
+                                        cl::desc("Hex encoded call data"),
+                                        cl::cat(EVMRunCat));
+
+static cl::opt<uint64_t> GasLimit("gas", cl::desc("Gas limit (default 10M)"),
+                                  cl::init(10000000), cl::cat(EVMRunCat));
+
+static cl::opt<bool> PrintGas("print-gas",
+                              cl::desc("Print the gas used and the status"),
+                              cl::cat(EVMRunCat));
+
+static cl::opt<bool>
+    PrintStats("stats",
+               cl::desc("Print execution counts and gas per opcode"),
+               cl::cat(EVMRunCat));
+
+static cl::opt<bool> PrintLogs("print-logs", cl::desc("Print emitted logs"),
+                               cl::cat(EVMRunCat));
+
+static cl::opt<unsigned>
+    Repeat("repeat", cl::desc("Run the code this many times, for timing"),
+           cl::init(1), cl::cat(EVMRunCat));
+
+static cl::opt<bool>
+    Batch("batch",
+          cl::desc("Read one test case per line from the input file"),
+          cl::cat(EVMRunCat));
+
+static cl::opt<bool>
+    Blocks("blocks",
+           cl::desc("Decode the code and list its basic blocks instead of "
+                    "running it"),
+           cl::cat(EVMRunCat));
+
+static cl::opt<bool>
+    Deploy("deploy",
+           cl::desc("Run the code as init code, then call the runtime code "
+                    "it returns"),
+           cl::cat(EVMRunCat));
+
+static cl::opt<std::string>
+    ProfileMap("profile-map",
+               cl::desc("Collect the profile counters described by the map "
+                        "llc -evm-profile-generate wrote"),
+               cl::value_desc("filename"), cl::cat(EVMRunCat));
+
+static cl::opt<std::string>
+    ProfileOutput("profile-output",
+                  cl::desc("Write the collected profile to this file"),
+                  cl::value_desc("filename"), cl::init("default.profdata"),
+                  cl::cat(EVMRunCat));
+
+static StringRef ToolName;
+
+// The counters logged by all runs of a profiled contract.
+static std::vector<uint64_t> ProfileCounts;
+
+static void reportError(const Twine &Message) {
+  WithColor::error(errs(), ToolName) << Message << '\n';
+  exit(1);
+}
+
+static bool parseHex(StringRef Text, std::vector<uint8_t> &Bytes) {
+  Text = Text.trim();
+  if (Text.startswith("0x") || Text.startswith("0X"))
+    Text = Text.drop_front(2);
+  if (Text.size() % 2 || !all_of(Text, isHexDigit))
+    return false;
+  std::string Raw = fromHex(Text);
+  Bytes.assign(Raw.begin(), Raw.end());
+  return true;
+}
+
+// Files holding hex text are decoded; anything else is taken as raw bytecode.
+static bool readCode(StringRef Path, std::vector<uint8_t> &Code,
+                     std::string &Error) {
+  auto BufOrErr = MemoryBuffer::getFileOrSTDIN(Path);
+  if (!BufOrErr) {
+    Error = BufOrErr.getError().message();
+    return false;
+  }
+  StringRef Contents = (*BufOrErr)->getBuffer();
+  if (!parseHex(Contents, Code))
+    Code.assign(Contents.bytes_begin(), Contents.bytes_end());
+  return true;
+}
+
+static std::string formatHex(ArrayRef<uint8_t> Bytes) {
+  return "0x" + llvm::toHex(Bytes, /*LowerCase=*/true);
+}
+
+static std::string formatHex(const Word &W) {
+  uint8_t Bytes[32];
+  W.toBytes(Bytes);
+  return formatHex(makeArrayRef(Bytes));
+}
+
+static void printStats(const OpcodeStats &Stats, raw_ostream &OS) {
+  std::vector<unsigned> Opcodes;
+  for (unsigned Op = 0; Op != 256; ++Op)
+    if (Stats.Count[Op])
+      Opcodes.push_back(Op);
+  llvm::sort(Opcodes, [&](unsigned A, unsigned B) {
+    return Stats.Gas[A] != Stats.Gas[B] ? Stats.Gas[A] > Stats.Gas[B]
+                                        : A < B;
+  });
+
+  OS << format("%-16s %12s %12s\n", (const char *)"opcode",
+               (const char *)"count", (const char *)"gas");
+  for (unsigned Op : Opcodes) {
+    const char *Name = getOpcodeName(Op);
+    OS << format("%-16s %12llu %12llu\n", Name ? Name : "?",
+                 (unsigned long long)Stats.Count[Op],
+                 (unsigned long long)Stats.Gas[Op]);
+  }
+}
+
+static void printLogs(const ExecutionResult &R, raw_ostream &OS) {
+  for (const LogEntry &Log : R.Logs) {
+    OS << "log";
+    for (const Word &Topic : Log.Topics)
+      OS << ' ' << formatHex(Topic);
+    OS << " data " << formatHex(Log.Data) << '\n';
+  }
+}
+
+// Logs of reverted runs are discarded, like their counts.
+static void collectProfile(const ExecutionResult &R) {
+  if (ProfileMap.empty() || !R.succeeded())
+    return;
+  StringRef Name(EVM::ProfileLogTopic);
+  Word Topic = Word::fromBytes(Name.bytes_begin(), Name.size());
+  for (const LogEntry &Log : R.Logs) {
+    if (Log.Topics.size() != 1 || !(Log.Topics[0] == Topic))
+      continue;
+    if (Log.Data.size() != ProfileCounts.size() * 32)
+      reportError("profile log of " + Twine(Log.Data.size()) +
+                  " bytes does not match " + ProfileMap);
+    for (unsigned N = 0; N != ProfileCounts.size(); ++N)
+      ProfileCounts[N] += Word::fromBytes(&Log.Data[N * 32]).low();
+  }
+}
+
+static json::Value readProfileMap() {
+  auto BufOrErr = MemoryBuffer::getFile(ProfileMap);
+  if (!BufOrErr)
+    reportError(ProfileMap + ": " + BufOrErr.getError().message());
+  Expected<json::Value> Map = json::parse((*BufOrErr)->getBuffer());
+  if (!Map)
+    reportError(ProfileMap + ": " + toString(Map.takeError()));
+  const json::Object *Obj = Map->getAsObject();
+  Optional<int64_t> Num = Obj ? Obj->getInteger("counters") : None;
+  if (!Num || *Num < 0)
+    reportError(ProfileMap + ": missing counters");
+  ProfileCounts.assign(*Num, 0);
+  return std::move(*Map);
+}
+
+static void writeProfile(const json::Value &Map) {
+  InstrProfWriter Writer;
+  cantFail(Writer.setIsIRLevelProfile(/*IsIRLevel=*/true, /*WithCS=*/false));
+  const json::Array *Functions = Map.getAsObject()->getArray("functions");
+  for (const json::Value &F : Functions ? *Functions : json::Array()) {
+    const json::Object *Obj = F.getAsObject();
+    Optional<StringRef> Name = Obj ? Obj->getString("name") : None;
+    Optional<StringRef> HashText = Obj ? Obj->getString("hash") : None;
+    Optional<int64_t> Offset = Obj ? Obj->getInteger("offset") : None;
+    Optional<int64_t> Num = Obj ? Obj->getInteger("counters") : None;
+    uint64_t Hash;
+    if (!Name || !HashText || HashText->getAsInteger(16, Hash) || !Offset ||
+        !Num || *Offset < 0 || *Num < 0 ||
+        uint64_t(*Offset + *Num) > ProfileCounts.size())
+      reportError(ProfileMap + ": malformed function entry");
+
+    std::vector<uint64_t> Counts(ProfileCounts.begin() + *Offset,
+                                 ProfileCounts.begin() + *Offset + *Num);
+    Writer.addRecord(NamedInstrProfRecord(*Name, Hash, std::move(Counts)),
+                     [&](Error E) {
+                       reportError(*Name + ": " + toString(std::move(E)));
+                     });
+  }
+
+  std::error_code EC;
+  raw_fd_ostream OS(ProfileOutput, EC, sys::fs::OF_None);
+  if (EC)
+    reportError(ProfileOutput + ": " + EC.message());
+  Writer.write(OS);
+}
+
+static void printBlocks(ArrayRef<uint8_t> Code, const DecodedCode &D,
+                        raw_ostream &OS) {
+  for (const DecodedBlock &B : D.Blocks) {
+    OS << format("block 0x%x-0x%x", B.Begin, B.End);
+    if (B.IsEntry)
+      OS << " entry";
+    if (B.FallsThrough)
+      OS << " fallthrough";
+    OS << '\n';
+    for (uint32_t N = B.FirstInstr; N != B.LastInstr; ++N) {
+      const DecodedInstr &I = D.Instrs[N];
+      const char *Name = getOpcodeName(I.Opcode);
+      OS << format("  0x%x: ", I.Offset);
+      if (Name)
+        OS << Name;
+      else
+        OS << format("0x%02x", I.Opcode);
+      if (getOpcodeInfoTable()[I.Opcode].ImmSize)
+        OS << " 0x"
+           << StringRef(getImmediate(Code, I).toAPInt().toString(16, false))
+                  .lower();
+      OS << '\n';
+    }
+  }
+}
+
+static void printDecodeSummary(ArrayRef<uint8_t> Code, const DecodedCode &D,
+                               raw_ostream &OS) {
+  OS << Code.size() << " bytes, " << D.Instrs.size() << " instructions, "
+     << D.Blocks.size() << " blocks, " << D.JumpDests.count()
+     << " jump destinations\n";
+}
+
+static void printThroughput(uint64_t Bytes, std::chrono::nanoseconds Time,
+                            raw_ostream &OS) {
+  double Seconds = std::max(Time.count(), int64_t(1)) * 1e-9;
+  OS << format("decoded %llu bytes in %.3f s (%.1f MB/s)\n",
+               (unsigned long long)Bytes, Seconds, Bytes / Seconds / 1e6);
+}
+
+static int runBatch(Interpreter &I) {
+  auto BufOrErr = MemoryBuffer::getFileOrSTDIN(InputFilename);
+  if (!BufOrErr)
+    reportError(InputFilename + ": " + BufOrErr.getError().message());
+
+  bool AllPassed = true;
+  DecodedCode Decoded;
+  uint64_t DecodedBytes = 0;
+  std::chrono::nanoseconds DecodeTime(0);
+  SmallVector<StringRef, 0> Lines;
+  (*BufOrErr)->getBuffer().split(Lines, '\n', -1, false);
+  for (StringRef Line : Lines) {
+    Line = Line.trim();
+    if (Line.empty() || Line.startswith("#"))
+      continue;
+
+    SmallVector<StringRef, 3> Fields;
+    Line.split(Fields, ' ', -1, false);
+    if (Fields.size() < 2)
+      reportError("malformed batch line: " + Line);
+
+    std::vector<uint8_t> Code, CallData;
+    std::string Error;
+    if (Fields[1].startswith("0x")) {
+      if (!parseHex(Fields[1], Code))
+        reportError(Fields[0] + ": invalid bytecode");
+    } else if (!readCode(Fields[1], Code, Error)) {
+      reportError(Fields[1] + ": " + Error);
+    }
+    if (Fields.size() > 2 && !parseHex(Fields[2], CallData))
+      reportError(Fields[0] + ": invalid call data");
+
+    if (Blocks) {
+      auto Start = std::chrono::steady_clock::now();
+      decodeBytecode(Code, Decoded);
+      DecodeTime += std::chrono::steady_clock::now() - Start;
+      DecodedBytes += Code.size();
+      outs() << Fields[0] << ' ';
+      printDecodeSummary(Code, Decoded, outs());
+      continue;
+    }
+
+    // Each case starts from empty storage.
+    I.clearStorage();
+    ExecutionResult R = I.run(Code, CallData, GasLimit);
+    AllPassed &= R.succeeded();
+    outs() << Fields[0] << ' ' << getStatusName(R.Result)
+           << ' ' << R.GasUsed << ' ' << formatHex(R.Output) << '\n';
+    if (PrintLogs)
+      printLogs(R, outs());
+    collectProfile(R);
+  }
+
+  if (Blocks && PrintStats)
+    printThroughput(DecodedBytes, DecodeTime, outs());
+  else if (PrintStats)
+    printStats(I.getStats(), outs());
+  return AllPassed ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  cl::HideUnrelatedOptions(EVMRunCat);
+  cl::ParseCommandLineOptions(argc, argv, "EVM bytecode interpreter\n");
+  ToolName = argv[0];
+
+  Interpreter I;
+  I.setCollectStats(PrintStats);
+
+  json::Value Map = nullptr;
+  if (!ProfileMap.empty())
+    Map = readProfileMap();
+
+  if (Batch) {
+    int Ret = runBatch(I);
+    if (!ProfileMap.empty())
+      writeProfile(Map);
+    return Ret;
+  }
+
+  std::vector<uint8_t> Code, CallData;
+  if (!CodeHex.empty()) {
+    if (!parseHex(CodeHex, Code))
+      reportError("invalid hex in --code");
+  } else {
+    std::string Error;
+    if (!readCode(InputFilename, Code, Error))
+      reportError(InputFilename + ": " + Error);
+  }
+  if (!CallDataHex.empty() && !parseHex(CallDataHex, CallData))
+    reportError("invalid hex in --input");
+
+  if (Blocks) {
+    DecodedCode Decoded;
+    auto Start = std::chrono::steady_clock::now();
+    for (unsigned N = 0; N != std::max(1u, unsigned(Repeat)); ++N)
+      decodeBytecode(Code, Decoded);
+    auto Time = std::chrono::steady_clock::now() - Start;
+    printBlocks(Code, Decoded, outs());
+    printDecodeSummary(Code, Decoded, outs());
+    if (PrintStats)
+      printThroughput(uint64_t(Code.size()) * std::max(1u, unsigned(Repeat)),
+                      Time, outs());
+    return 0;
+  }
+
+  ExecutionResult Init, R;
+  std::vector<uint8_t> Runtime;
+  for (unsigned N = 0; N != std::max(1u, unsigned(Repeat)); ++N) {
+    I.clearStorage();
+    if (Deploy) {
+      // The runtime code sees the storage written by the init code.
+      Init = I.run(Code, {}, GasLimit);
+      if (!Init.succeeded()) {
+        WithColor::error(errs(), ToolName)
+            << "init code: " << getStatusName(Init.Result) << " at pc "
+            << Init.PC << '\n';
+        return 1;
+      }
+      Runtime = Init.Output;
+    }
+    R = I.run(Deploy ? Runtime : Code, CallData, GasLimit);
+  }
+
+  if (Deploy && PrintGas)
+    outs() << "runtime code: " << Runtime.size() << " bytes\n"
+           << "deploy gas used: " << Init.GasUsed << '\n';
+  outs() << formatHex(R.Output) << '\n';
+  if (PrintLogs)
+    printLogs(R, outs());
+  if (PrintGas)
+    outs() << "status: " << getStatusName(R.Result) << '\n'
+           << "gas used: " << R.GasUsed << '\n'
+           << "steps: " << R.Steps << '\n';
+  if (PrintStats)
+    printStats(I.getStats(), outs());
+  if (!ProfileMap.empty()) {
+    collectProfile(Init);
+    collectProfile(R);
+    writeProfile(Map);
+  }
+
+  if (!R.succeeded()) {
+    WithColor::error(errs(), ToolName)
+        << getStatusName(R.Result) << " at pc " << R.PC << '\n';
+    return 1;
+  }
+  return 0;
+}
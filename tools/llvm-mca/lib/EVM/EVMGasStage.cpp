@@ -0,0 +1,71 @@
+//===--------------------- EVMGasStage.cpp ----------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+/// \file
+///
+/// This file defines the execution stage of the EVM pipeline.
+///
+//===----------------------------------------------------------------------===//
+
+#include "EVMGasStage.h"
+#include "MCTargetDesc/EVMMCTargetDesc.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/IR/Constants.h"
+
+namespace llvm {
+namespace mca {
+
+// Memory beyond this would cost more gas than a block holds.
+static const uint64_t MaxAddress = uint64_t(1) << 32;
+
+// The value MCI pushes, if it pushes a literal below MaxAddress.
+static Optional<uint64_t> getPushedAddress(const MCInst &MCI,
+                                           const MCInstrDesc &Desc) {
+  if (EVM::getStackDelta(Desc) != 0 || EVM::getStackAlpha(Desc) != 1 ||
+      MCI.getNumOperands() != 1)
+    return None;
+  const MCOperand &Op = MCI.getOperand(0);
+  if (Op.isImm() && static_cast<uint64_t>(Op.getImm()) < MaxAddress)
+    return Op.getImm();
+  if (Op.isCImm() && Op.getCImm()->getValue().ult(MaxAddress))
+    return Op.getCImm()->getZExtValue();
+  return None;
+}
+
+Error EVMGasStage::execute(InstRef &IR) {
+  Busy = true;
+  const MCInst &MCI = Source[IR.getSourceIndex() % Source.size()];
+  const MCInstrDesc &Desc = MCII.get(MCI.getOpcode());
+
+  // A memory access right after a PUSH of its address touches a known word.
+  uint64_t MemoryGas = 0;
+  unsigned Opcode = MCI.getOpcode();
+  Optional<uint64_t> Address;
+  if ((Opcode == EVM::MLOAD || Opcode == EVM::MSTORE ||
+       Opcode == EVM::MSTORE8) && Prev)
+    Address = getPushedAddress(*Prev, MCII.get(Prev->getOpcode()));
+  if (Address) {
+    uint64_t End = *Address + (Opcode == EVM::MSTORE8 ? 1 : 32);
+    uint64_t Words = (End + 31) / 32;
+    if (Words > MemoryWords) {
+      MemoryGas = EVM::getMemoryExpansionGas(Words) -
+                  EVM::getMemoryExpansionGas(MemoryWords);
+      MemoryWords = Words;
+    }
+  }
+  Prev = &MCI;
+
+  int StackReach = StackHeight - static_cast<int>(EVM::getStackDelta(Desc));
+  StackHeight = StackReach + static_cast<int>(EVM::getStackAlpha(Desc));
+  notifyEvent<HWInstructionEvent>(
+      EVMGasEvent(IR, EVM::getGasCost(Desc) + MemoryGas, MemoryGas,
+                  EVM::hasDynamicGas(Opcode), StackReach, StackHeight));
+  return ErrorSuccess();
+}
+
+} // namespace mca
+} // namespace llvm
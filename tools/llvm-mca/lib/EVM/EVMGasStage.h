@@ -0,0 +1,81 @@
+//===--------------------- EVMGasStage.h ------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+/// \file
+///
+/// The execution stage of the EVM pipeline. The EVM runs one instruction
+/// after the other, and what an instruction costs is gas, not cycles: this
+/// stage executes one instruction per cycle and reports, for each, the gas
+/// it is charged, including the expansion of memory to a constant address,
+/// and the height of the stack after it.
+///
+/// The height of the stack is relative to the entry of the code region, so
+/// it goes below zero where the region reads its inputs.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLVM_MCA_EVM_EVMGASSTAGE_H
+#define LLVM_TOOLS_LLVM_MCA_EVM_EVMGASSTAGE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MCA/HWEventListener.h"
+#include "llvm/MCA/Stages/Stage.h"
+
+namespace llvm {
+namespace mca {
+
+class EVMGasEvent : public HWInstructionEvent {
+public:
+  enum : unsigned { Executed = HWInstructionEvent::LastGenericEventType };
+
+  EVMGasEvent(const InstRef &IR, uint64_t Gas, uint64_t MemoryGas,
+              bool HasDynamicGas, int StackReach, int StackHeight)
+      : HWInstructionEvent(Executed, IR), Gas(Gas), MemoryGas(MemoryGas),
+        HasDynamicGas(HasDynamicGas), StackReach(StackReach),
+        StackHeight(StackHeight) {}
+
+  // Gas charged for the instruction, MemoryGas of which is for expanding
+  // memory.
+  uint64_t Gas;
+  uint64_t MemoryGas;
+  // The instruction also costs gas that depends on its operands, which is
+  // not included.
+  bool HasDynamicGas;
+  // Lowest height of the stack the instruction reads, and the height after
+  // it.
+  int StackReach;
+  int StackHeight;
+};
+
+class EVMGasStage final : public Stage {
+  const MCInstrInfo &MCII;
+  ArrayRef<MCInst> Source;
+
+  bool Busy = false;
+  int StackHeight = 0;
+  uint64_t MemoryWords = 0;
+  const MCInst *Prev = nullptr;
+
+public:
+  EVMGasStage(const MCInstrInfo &MCII, ArrayRef<MCInst> Source)
+      : MCII(MCII), Source(Source) {}
+
+  bool hasWorkToComplete() const override { return false; }
+  bool isAvailable(const InstRef &IR) const override { return !Busy; }
+  Error cycleStart() override {
+    Busy = false;
+    return ErrorSuccess();
+  }
+  Error execute(InstRef &IR) override;
+};
+
+} // namespace mca
+} // namespace llvm
+
+#endif // LLVM_TOOLS_LLVM_MCA_EVM_EVMGASSTAGE_H
@@ -0,0 +1,150 @@
+//===--------------------- EVMGasViews.cpp ----------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+/// \file
+///
+/// This file implements the views of the EVM pipeline.
+///
+//===----------------------------------------------------------------------===//
+
+#include "EVMGasViews.h"
+#include "EVMGasStage.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormattedStream.h"
+#include <algorithm>
+#include <numeric>
+
+namespace llvm {
+namespace mca {
+
+// The EVM stack holds at most this many items.
+static const int MaxStackHeight = 1024;
+
+static const EVMGasEvent *getGasEvent(const HWInstructionEvent &Event) {
+  if (Event.Type != EVMGasEvent::Executed)
+    return nullptr;
+  return static_cast<const EVMGasEvent *>(&Event);
+}
+
+static void printInstruction(formatted_raw_ostream &OS,
+                             const MCSubtargetInfo &STI, MCInstPrinter &MCIP,
+                             const MCInst &Inst, bool HasDynamicGas) {
+  std::string Instruction;
+  raw_string_ostream InstrStream(Instruction);
+  MCIP.printInst(&Inst, 0, "", STI, InstrStream);
+  InstrStream.flush();
+  // Consume any tabs or spaces at the beginning of the string.
+  OS << StringRef(Instruction).ltrim();
+  if (HasDynamicGas)
+    OS << " +";
+  OS << '\n';
+}
+
+void EVMGasSummaryView::onEvent(const HWInstructionEvent &Event) {
+  const EVMGasEvent *E = getGasEvent(Event);
+  if (!E)
+    return;
+  unsigned Index = E->IR.getSourceIndex();
+  LastInstructionIdx = Index;
+  TotalGas += E->Gas;
+  MemoryGas += E->MemoryGas;
+  MinStack = std::min(MinStack, E->StackReach);
+  MaxStack = std::max(MaxStack, E->StackHeight);
+  if (Index < Source.size()) {
+    NumDynamic += E->HasDynamicGas;
+    if (Index + 1 == Source.size())
+      IterationGrowth = E->StackHeight;
+  }
+}
+
+void EVMGasSummaryView::printView(raw_ostream &OS) const {
+  unsigned Instructions = Source.size();
+  unsigned Iterations = (LastInstructionIdx / Instructions) + 1;
+
+  std::string Buffer;
+  raw_string_ostream TempStream(Buffer);
+  TempStream << "Iterations:        " << Iterations;
+  TempStream << "\nInstructions:      " << Instructions * Iterations;
+  TempStream << "\nTotal Gas:         " << TotalGas;
+  TempStream << "\nGas Per Iteration: "
+             << format("%.2f", (double)TotalGas / Iterations);
+  TempStream << "\nMemory Gas:        " << MemoryGas;
+  if (NumDynamic)
+    TempStream << "\nDynamic Gas:       " << NumDynamic
+               << " instructions per iteration, not included";
+  TempStream << "\n\nStack Inputs:      " << -MinStack;
+  TempStream << "\nStack Peak:        " << format("%+d", MaxStack);
+  TempStream << "\nStack Growth:      " << format("%+d", IterationGrowth)
+             << " per iteration";
+  if (MaxStack > MaxStackHeight)
+    TempStream << "\nStack Overflow:    the stack grows past "
+               << MaxStackHeight << " items";
+  TempStream << '\n';
+  TempStream.flush();
+  OS << Buffer;
+}
+
+void EVMGasTimelineView::onEvent(const HWInstructionEvent &Event) {
+  const EVMGasEvent *E = getGasEvent(Event);
+  if (!E)
+    return;
+  TotalGas += E->Gas;
+  if (E->IR.getSourceIndex() < MaxIterations * Source.size())
+    Timeline.push_back(
+        {E->Gas, TotalGas, E->HasDynamicGas, E->StackHeight});
+}
+
+void EVMGasTimelineView::printView(raw_ostream &OS) const {
+  formatted_raw_ostream FOS(OS);
+  FOS << "\n\nGas Timeline - number of iterations: "
+      << Timeline.size() / Source.size() << '\n'
+      << "\nIndex     Gas    Total  Stack  Instruction\n";
+  for (unsigned I = 0, E = Timeline.size(); I != E; ++I) {
+    const TimelineEntry &Entry = Timeline[I];
+    std::string Index = "[" + std::to_string(I / Source.size()) + "," +
+                        std::to_string(I % Source.size()) + "]";
+    FOS << format("%-8s", Index.c_str())
+        << format("%5llu", (unsigned long long)Entry.Gas)
+        << format("%9llu", (unsigned long long)Entry.TotalGas)
+        << format("%+7d", Entry.StackHeight) << "  ";
+    printInstruction(FOS, STI, MCIP, Source[I % Source.size()],
+                     Entry.HasDynamicGas);
+  }
+}
+
+void EVMHotspotView::onEvent(const HWInstructionEvent &Event) {
+  const EVMGasEvent *E = getGasEvent(Event);
+  if (!E)
+    return;
+  unsigned Index = E->IR.getSourceIndex() % Source.size();
+  Gas[Index] += E->Gas;
+  HasDynamicGas[Index] = E->HasDynamicGas;
+  TotalGas += E->Gas;
+}
+
+void EVMHotspotView::printView(raw_ostream &OS) const {
+  std::vector<unsigned> Order(Source.size());
+  std::iota(Order.begin(), Order.end(), 0);
+  llvm::stable_sort(Order,
+                    [this](unsigned A, unsigned B) { return Gas[A] > Gas[B]; });
+
+  formatted_raw_ostream FOS(OS);
+  FOS << "\n\nGas Hotspots:\n"
+      << "\nIndex       Gas   Share  Instruction\n";
+  for (unsigned I : Order) {
+    double Share = TotalGas ? 100.0 * Gas[I] / TotalGas : 0;
+    FOS << format("[%u]", I);
+    FOS.PadToColumn(6);
+    FOS << format("%9llu", (unsigned long long)Gas[I])
+        << format("%7.1f%%", Share) << "  ";
+    printInstruction(FOS, STI, MCIP, Source[I], HasDynamicGas[I]);
+  }
+}
+
+} // namespace mca
+} // namespace llvm
@@ -0,0 +1,101 @@
+//===--------------------- EVMGasViews.h ------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+/// \file
+///
+/// Views of the EVM pipeline, built from the events of the EVMGasStage:
+///
+///  - the summary: gas in total and per iteration, memory expansion, and how
+///    the region uses the stack;
+///  - the gas timeline: every instruction of the first iterations with its
+///    gas, the gas so far and the height of the stack;
+///  - the hotspots: the instructions of the region by the share of the gas
+///    they cost.
+///
+/// Gas that depends on the operands of an instruction is not included, and
+/// the instruction is marked with a '+'.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLVM_MCA_EVM_EVMGASVIEWS_H
+#define LLVM_TOOLS_LLVM_MCA_EVM_EVMGASVIEWS_H
+
+#include "Views/View.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstPrinter.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include <vector>
+
+namespace llvm {
+namespace mca {
+
+class EVMGasSummaryView : public View {
+  ArrayRef<MCInst> Source;
+  unsigned LastInstructionIdx = 0;
+  uint64_t TotalGas = 0;
+  uint64_t MemoryGas = 0;
+  // Instructions of an iteration with operand dependent gas.
+  unsigned NumDynamic = 0;
+  // Stack heights relative to the entry of the region.
+  int MinStack = 0;
+  int MaxStack = 0;
+  int IterationGrowth = 0;
+
+public:
+  EVMGasSummaryView(ArrayRef<MCInst> Source) : Source(Source) {}
+
+  void onEvent(const HWInstructionEvent &Event) override;
+  void printView(raw_ostream &OS) const override;
+};
+
+class EVMGasTimelineView : public View {
+  const MCSubtargetInfo &STI;
+  MCInstPrinter &MCIP;
+  ArrayRef<MCInst> Source;
+  unsigned MaxIterations;
+
+  struct TimelineEntry {
+    uint64_t Gas;
+    uint64_t TotalGas;
+    bool HasDynamicGas;
+    int StackHeight;
+  };
+  std::vector<TimelineEntry> Timeline;
+  uint64_t TotalGas = 0;
+
+public:
+  EVMGasTimelineView(const MCSubtargetInfo &STI, MCInstPrinter &MCIP,
+                     ArrayRef<MCInst> Source, unsigned MaxIterations)
+      : STI(STI), MCIP(MCIP), Source(Source), MaxIterations(MaxIterations) {}
+
+  void onEvent(const HWInstructionEvent &Event) override;
+  void printView(raw_ostream &OS) const override;
+};
+
+class EVMHotspotView : public View {
+  const MCSubtargetInfo &STI;
+  MCInstPrinter &MCIP;
+  ArrayRef<MCInst> Source;
+  std::vector<uint64_t> Gas;
+  std::vector<bool> HasDynamicGas;
+  uint64_t TotalGas = 0;
+
+public:
+  EVMHotspotView(const MCSubtargetInfo &STI, MCInstPrinter &MCIP,
+                 ArrayRef<MCInst> Source)
+      : STI(STI), MCIP(MCIP), Source(Source), Gas(Source.size()),
+        HasDynamicGas(Source.size()) {}
+
+  void onEvent(const HWInstructionEvent &Event) override;
+  void printView(raw_ostream &OS) const override;
+};
+
+} // namespace mca
+} // namespace llvm
+
+#endif // LLVM_TOOLS_LLVM_MCA_EVM_EVMGASVIEWS_H
@@ -59,6 +59,10 @@
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/WithColor.h"
+#ifdef LLVM_MCA_HAS_EVM
+#include "lib/EVM/EVMGasStage.h"
+#include "lib/EVM/EVMGasViews.h"
+#endif
 
 using namespace llvm;
 
@@ -208,6 +212,11 @@ static cl::opt<bool> EnableBottleneckAnalysis(
     cl::desc("Enable bottleneck analysis (disabled by default)"),
     cl::cat(ViewOptions), cl::init(false));
 
+static cl::opt<bool> PrintHotspotView(
+    "hotspots",
+    cl::desc("Print the instructions that cost the most gas (EVM only)"),
+    cl::cat(ViewOptions), cl::init(false));
+
 static cl::opt<bool> ShowEncoding(
     "show-encoding",
     cl::desc("Print encoding information in the instruction info view"),
@@ -261,6 +270,7 @@ static void processViewOptions() {
     processOptionImpl(PrintResourcePressureView, EnableAllViews);
     processOptionImpl(PrintTimelineView, EnableAllViews);
     processOptionImpl(PrintInstructionInfoView, EnableAllViews);
+    processOptionImpl(PrintHotspotView, EnableAllViews);
   }
 
   const cl::opt<bool> &Default =
@@ -323,15 +333,25 @@ int main(int argc, char **argv) {
   // Apply overrides to llvm-mca specific options.
   processViewOptions();
 
+  // The EVM executes in order, and has a pipeline of its own.
+  bool IsEVM = TheTriple.getArch() == Triple::evm;
+#ifndef LLVM_MCA_HAS_EVM
+  if (IsEVM) {
+    WithColor::error() << "llvm-mca was built without the EVM pipeline.\n";
+    return 1;
+  }
+#endif
+
   if (!MCPU.compare("native"))
-    MCPU = llvm::sys::getHostCPUName();
+    MCPU = IsEVM ? "generic" : llvm::sys::getHostCPUName();
 
   std::unique_ptr<MCSubtargetInfo> STI(
       TheTarget->createMCSubtargetInfo(TripleName, MCPU, MATTR));
   if (!STI->isCPUStringValid(MCPU))
     return 1;
 
-  if (!PrintInstructionTables && !STI->getSchedModel().isOutOfOrder()) {
+  if (!PrintInstructionTables && !IsEVM &&
+      !STI->getSchedModel().isOutOfOrder()) {
     WithColor::error() << "please specify an out-of-order cpu. '" << MCPU
                        << "' is an in-order cpu.\n";
     return 1;
@@ -512,6 +532,41 @@ int main(int argc, char **argv) {
       continue;
     }
 
+#ifdef LLVM_MCA_HAS_EVM
+    if (IsEVM) {
+      // Instructions run one after the other, and cost gas.
+      auto P = std::make_unique<mca::Pipeline>();
+      P->appendStage(std::make_unique<mca::EntryStage>(S));
+      P->appendStage(std::make_unique<mca::EVMGasStage>(*MCII, Insts));
+      mca::PipelinePrinter Printer(*P);
+
+      if (PrintSummaryView)
+        Printer.addView(std::make_unique<mca::EVMGasSummaryView>(Insts));
+
+      if (PrintInstructionInfoView)
+        Printer.addView(std::make_unique<mca::InstructionInfoView>(
+            *STI, *MCII, CE, ShowEncoding, Insts, *IP));
+
+      if (PrintHotspotView)
+        Printer.addView(
+            std::make_unique<mca::EVMHotspotView>(*STI, *IP, Insts));
+
+      if (PrintTimelineView) {
+        unsigned TimelineIterations =
+            TimelineMaxIterations ? TimelineMaxIterations : 10;
+        Printer.addView(std::make_unique<mca::EVMGasTimelineView>(
+            *STI, *IP, Insts,
+            std::min(TimelineIterations, S.getNumIterations())));
+      }
+
+      if (!runPipeline(*P))
+        return 1;
+
+      Printer.printReport(TOF->os());
+      continue;
+    }
+#endif
+
     // Create a basic pipeline simulating an out-of-order backend.
     auto P = MCA.createDefaultPipeline(PO, S);
     mca::PipelinePrinter Printer(*P);